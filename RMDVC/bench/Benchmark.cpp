@@ -0,0 +1,385 @@
+/*
+ * Benchmark.cpp
+ *
+ * Runs the game loop headless (no window, random player input) with a configurable number
+ * of MeleeAi actors on a map of configurable size and reports the turn throughput and the
+ * time spent in the phases of the loop.
+ *
+ * With --save, every actor gets a Body (instantiated from Body.xml in the working directory) and
+ * the game is saved to and loaded from an XML and a binary save afterwards, comparing time and size.
+ *
+ * With --budget, the memory budget of the map chunks is set (in KB), --chunk-dir sets the directory
+ * modified chunks are paged out to.
+ *
+ * With --hits, the player gets a Body and the given number of hit locations is drawn on it in one batch.
+ *
+ * With --threads, the Ais decide on the given number of threads (default: one per hardware thread).
+ *
+ * With --autosave, every turn is journaled and a snapshot is taken every N turns (to bench_autosave.*),
+ * see Autosave. The time the writer thread still needs after the run is reported as the flush.
+ *
+ * With --trace, timed zones are recorded and the trace is written to the given file when the run is
+ * over (Chrome trace JSON if it ends with .json, binary otherwise). The counters and histograms of
+ * the trace are always reported.
+ *
+ * With --think, the time the player takes to think is simulated: before every turn, the Engine
+ * speculates on it until there is nothing left to do (see Engine::speculate()). That time is reported
+ * as the think time and not part of the total, which then is the time from the key to the outcome.
+ *
+ * Everything random (the placement of the actors, the player input, hit locations and UUIDs) is drawn
+ * from streams derived from the seed, so runs with the same seed do exactly the same work.
+ *
+ * Usage: RMDBench [--actors N] [--turns M] [--width W] [--height H] [--seed S] [--no-render] [--save]
+ *                 [--budget KB] [--chunk-dir DIR] [--hits N] [--threads N]
+ *                 [--autosave N] [--trace FILE] [--think]
+ */
+
+#include "libtcod.hpp"
+#include "Engine.hpp"
+#include "Input.hpp"
+#include "Map.hpp"
+#include "Actor.hpp"
+#include "ChaseMap.hpp"
+#include "Action.hpp"
+#include "Destructible.hpp"
+#include "BodyTemplateRegistry.hpp"
+#include "HitLocationSampler.hpp"
+#include "SaveGame.hpp"
+#include "Random.hpp"
+#include "Journal.hpp"
+#include "Trace.hpp"
+
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+struct BenchmarkConfig {
+	int actors;
+	int turns;
+	int width;
+	int height;
+	unsigned int seed;
+	bool render;
+	bool save;
+
+	/** The memory budget of the map chunks in KB (0 for the default) and the directory chunks are paged out to.
+	*/
+	int budget_kb;
+	const char* chunk_dir;
+
+	/** The number of hit locations drawn on the body of the player (0 for none).
+	*/
+	int hits;
+
+	/** The number of threads the Ais decide on (0 for one per hardware thread).
+	*/
+	int threads;
+
+	/** The number of turns between autosave snapshots (0 for no autosave).
+	*/
+	int autosave;
+
+	/** The file the trace is written to (nullptr for no trace).
+	*/
+	const char* trace;
+
+	/** Whether the Engine speculates on every turn before it is played.
+	*/
+	bool think;
+
+	BenchmarkConfig() : actors(100), turns(1000), width(120), height(70), seed(1234), render(true), save(false),
+		budget_kb(0), chunk_dir(nullptr), hits(0), threads(0), autosave(0), trace(nullptr), think(false) {};
+};
+
+static void printUsage()
+{
+	printf("Usage: RMDBench [--actors N] [--turns M] [--width W] [--height H] [--seed S] [--no-render] [--save]\n");
+	printf("                [--budget KB] [--chunk-dir DIR] [--hits N] [--threads N]\n");
+	printf("                [--autosave N] [--trace FILE] [--think]\n");
+}
+
+static bool parseArgs(int argc, char* argv[], BenchmarkConfig* config)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+
+		if (!strcmp(argv[i], "--actors") && has_value) { config->actors = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--turns") && has_value) { config->turns = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--width") && has_value) { config->width = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--height") && has_value) { config->height = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--seed") && has_value) { config->seed = (unsigned int)strtoul(argv[++i], NULL, 10); }
+		else if (!strcmp(argv[i], "--no-render")) { config->render = false; }
+		else if (!strcmp(argv[i], "--save")) { config->save = true; }
+		else if (!strcmp(argv[i], "--budget") && has_value) { config->budget_kb = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--chunk-dir") && has_value) { config->chunk_dir = argv[++i]; }
+		else if (!strcmp(argv[i], "--hits") && has_value) { config->hits = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--threads") && has_value) { config->threads = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--autosave") && has_value) { config->autosave = atoi(argv[++i]); }
+		else if (!strcmp(argv[i], "--trace") && has_value) { config->trace = argv[++i]; }
+		else if (!strcmp(argv[i], "--think")) { config->think = true; }
+		else { return false; }
+	}
+
+	return config->actors >= 0 && config->hits >= 0 && config->autosave >= 0 && config->turns > 0 && config->width > 0 && config->height > 0;
+}
+
+static void printPhase(const char* name, double seconds, double total_seconds, int turns)
+{
+	printf("  %-12s %10.3f ms  %8.4f ms/turn  %5.1f%%\n", name, seconds * 1000.0, seconds * 1000.0 / turns,
+		total_seconds > 0.0 ? seconds / total_seconds * 100.0 : 0.0);
+}
+
+/** Prints the allocations of an action pool during the run and how many of them had to go to the heap.
+*/
+static void printPool(const char* name, const PoolStats& stats, const PoolStats& start)
+{
+	printf("  %-12s %10llu  allocations, %llu heap blocks during the run (%llu total), %llu live\n", name,
+		stats.allocations - start.allocations, stats.heap_allocations - start.heap_allocations,
+		stats.heap_allocations, stats.getLiveCount());
+}
+
+static bool attachBody(Engine* engine, Actor* actor)
+{
+	Body* body = engine->body_templates->instantiate("Body.xml");
+	if (body == nullptr) { return false; }
+
+	actor->destructible = new Destructible(100);
+	actor->destructible->body = body;
+	return true;
+}
+
+static long long getFileSize(const char* filename)
+{
+	std::ifstream is(filename, std::ios::binary | std::ios::ate);
+	return is ? (long long)is.tellg() : -1;
+}
+
+/** Saves the game of the engine to the given file and loads it again, printing the times and the file size.
+*/
+static void benchmarkSaveFormat(Engine* engine, const char* name, const char* filename, SaveFormat format)
+{
+	typedef std::chrono::high_resolution_clock bench_clock;
+
+	SaveGameData data;
+	data.actors = engine->actors;
+	data.map = engine->map;
+	data.scheduler = engine->scheduler;
+	data.player = engine->player;
+	data.random = RandomService::getInstance()->getState();
+
+	bench_clock::time_point start = bench_clock::now();
+	bool saved = saveGame(filename, format, data);
+	double save_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	SaveGameData loaded;
+	start = bench_clock::now();
+	bool load_ok = saved && loadGame(filename, format, &loaded);
+	double load_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	if (!load_ok)
+	{
+		printf("  %-8s failed\n", name);
+		return;
+	}
+
+	printf("  %-8s save %10.3f ms  load %10.3f ms  size %10lld bytes\n", name,
+		save_seconds * 1000.0, load_seconds * 1000.0, getFileSize(filename));
+
+	delete loaded.actors;
+	delete loaded.map;
+	delete loaded.scheduler;
+}
+
+/** Draws the given number of hit locations on the body in one batch, printing the time and how
+* often the most frequently hit organs were hit.
+*/
+static void benchmarkHits(Body* body, int hits)
+{
+	typedef std::chrono::high_resolution_clock bench_clock;
+
+	RandomStream rng = RandomService::getInstance()->deriveStream(RANDOM_BODY, 0);
+	HitLocationSampler* sampler = body->getHitSampler();
+	std::vector<HitLocation> locations;
+	locations.reserve(hits);
+
+	bench_clock::time_point start = bench_clock::now();
+	int drawn = sampler->sampleBatch(&rng, hits, &locations);
+	double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	std::vector<int> counts(body->getLayout()->getPartCount(), 0);
+	for (auto it = locations.begin(); it != locations.end(); it++) { counts[it->organ]++; }
+
+	std::vector<int> organs;
+	for (int i = 0; i < (int)counts.size(); i++) { if (counts[i] > 0) { organs.push_back(i); } }
+	std::sort(organs.begin(), organs.end(), [&](int a, int b) { return counts[a] > counts[b]; });
+
+	printf("Hit locations:\n");
+	printf("  %i hits     %10.3f ms  (%.1f ns per hit, %llu tables built)\n", drawn, seconds * 1000.0,
+		drawn > 0 ? seconds * 1e9 / drawn : 0.0, sampler->getBuildCount());
+	for (size_t i = 0; i < organs.size() && i < 5; i++)
+	{
+		printf("  %-24s %6.2f%%\n", body->getLayout()->getName(organs[i]).c_str(), counts[organs[i]] * 100.0 / drawn);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkConfig bench;
+	if (!parseArgs(argc, argv, &bench))
+	{
+		printUsage();
+		return 1;
+	}
+
+	EngineConfig config;
+	config.headless = true;
+	config.map_width = bench.width;
+	config.map_height = bench.height;
+	config.ai_threads = bench.threads;
+	config.autosave_interval = bench.autosave;
+	config.autosave_path = "bench_autosave";
+	if (bench.trace != nullptr) { config.trace_path = bench.trace; }
+
+	//The input is created before the Engine, which seeds the service again with the same
+	// (with --seed 0, the picked) seed
+	RandomService::getInstance()->setSeed(bench.seed);
+	bench.seed = RandomService::getInstance()->getSeed();
+	config.seed = bench.seed;
+	config.input = new RandomInput(*RandomService::getInstance()->getStream(RANDOM_INPUT));
+
+	Engine* engine = new Engine(config);
+
+	if (bench.chunk_dir != nullptr) { engine->map->setChunkDirectory(bench.chunk_dir); }
+	if (bench.budget_kb > 0) { engine->map->setMemoryBudget((size_t)bench.budget_kb * 1024); }
+
+	//Place the actors on random free cells
+	RandomStream* rng = RandomService::getInstance()->getStream(RANDOM_MAP);
+	int spawned = 0;
+	int attempts = 0;
+	while (spawned < bench.actors && attempts < bench.actors * 100)
+	{
+		attempts++;
+		Actor* mob = engine->spawnMeleeActor(rng->getInt(0, bench.width - 1), rng->getInt(0, bench.height - 1));
+		if (mob != nullptr)
+		{
+			if (bench.save) { attachBody(engine, mob); }
+			spawned++;
+		}
+	}
+
+	if ((bench.save || bench.hits > 0) && !attachBody(engine, engine->player))
+	{
+		printf("Warning: Body.xml could not be loaded, the saves contain no bodies.\n");
+	}
+
+	if (spawned < bench.actors)
+	{
+		printf("Warning: only %i of %i actors could be placed.\n", spawned, bench.actors);
+	}
+
+	//Spawning lets every actor schedule its first action, which is not part of the measurement
+	engine->resetStats();
+	unsigned long long fov_count_start = engine->map->getFovComputeCount();
+	engine->getPlayerChaseMap();
+	unsigned long long chase_count_start = engine->getChaseMapComputeCount();
+	PoolStats move_pool_start = MoveAction::getPoolStats();
+	PoolStats idle_pool_start = IdleAction::getPoolStats();
+
+	typedef std::chrono::high_resolution_clock bench_clock;
+	bench_clock::time_point start = bench_clock::now();
+	double think_seconds = 0.0;
+
+	for (int turn = 0; turn < bench.turns; turn++)
+	{
+		if (bench.think)
+		{
+			bench_clock::time_point think_start = bench_clock::now();
+			while (engine->speculate()) {}
+			think_seconds += std::chrono::duration<double>(bench_clock::now() - think_start).count();
+		}
+
+		engine->update();
+		if (bench.render) { engine->render(); }
+	}
+
+	double total_seconds = std::chrono::duration<double>(bench_clock::now() - start).count() - think_seconds;
+
+	//The writer thread may still be busy, which is not part of the game loop
+	double flush_seconds = 0.0;
+	if (engine->getAutosave() != nullptr)
+	{
+		bench_clock::time_point flush_start = bench_clock::now();
+		engine->getAutosave()->flush();
+		flush_seconds = std::chrono::duration<double>(bench_clock::now() - flush_start).count();
+	}
+
+	const EngineStats& stats = engine->getStats();
+	unsigned long long fov_count = engine->map->getFovComputeCount() - fov_count_start;
+	unsigned long long chase_count = engine->getChaseMapComputeCount() - chase_count_start;
+
+	printf("RMDBench: %i actors, %ix%i map, %i turns, seed %u%s\n",
+		spawned, bench.width, bench.height, bench.turns, bench.seed, bench.render ? "" : ", no rendering");
+	printf("  total        %10.3f ms\n", total_seconds * 1000.0);
+	printf("  turns/sec    %10.1f\n", stats.turns / total_seconds);
+	printf("  actions/sec  %10.1f  (%llu actions)\n", stats.actions / total_seconds, stats.actions);
+	printf("  fov passes   %10llu  (%.2f per action)\n", fov_count,
+		stats.actions > 0 ? (double)fov_count / stats.actions : 0.0);
+	printf("  chase maps   %10llu  (%.2f per turn)\n", chase_count, (double)chase_count / bench.turns);
+	printf("  decisions    %10llu  (%.1f per phase)\n", stats.decisions,
+		stats.decision_phases > 0 ? (double)stats.decisions / stats.decision_phases : 0.0);
+	printf("  chunks       %10i  resident (%u bytes), %llu generated, %llu loaded, %llu evicted\n",
+		engine->map->getResidentChunkCount(), (unsigned int)engine->map->getMemoryUsage(),
+		engine->map->getChunkGenerations(), engine->map->getChunkLoads(), engine->map->getChunkEvictions());
+	if (stats.frames > 0)
+	{
+		printf("  cells/frame  %10.1f  (of %i)\n", (double)stats.redrawn_cells / stats.frames,
+			std::min(config.view_width, bench.width) * std::min(config.view_height, bench.height));
+	}
+	printPool("move pool", MoveAction::getPoolStats(), move_pool_start);
+	printPool("idle pool", IdleAction::getPoolStats(), idle_pool_start);
+	printf("Phases:\n");
+	printPhase("scheduling", stats.scheduling_seconds, total_seconds, bench.turns);
+	printPhase("ai update", stats.ai_seconds, total_seconds, bench.turns);
+	printPhase("execute", stats.execute_seconds, total_seconds, bench.turns);
+	printPhase("render", stats.render_seconds, total_seconds, bench.turns);
+	if (bench.think)
+	{
+		printf("  think time   %10.3f ms  %llu speculation steps, not part of the total\n",
+			think_seconds * 1000.0, stats.speculations);
+	}
+	if (engine->getAutosave() != nullptr)
+	{
+		const AutosaveStats& autosave = engine->getAutosave()->getStats();
+		printPhase("autosave", stats.autosave_seconds, total_seconds, bench.turns);
+		printf("Autosave:\n");
+		printf("  journal      %10llu  turns, %llu bytes (%.1f per turn), %.3f ms\n", autosave.turns, autosave.journal_bytes,
+			autosave.turns > 0 ? (double)autosave.journal_bytes / autosave.turns : 0.0, autosave.journal_seconds * 1000.0);
+		printf("  snapshots    %10llu  %llu bytes, %.3f ms on the main thread\n", autosave.snapshots, autosave.snapshot_bytes,
+			autosave.snapshot_seconds * 1000.0);
+		printf("  flush        %10.3f ms\n", flush_seconds * 1000.0);
+	}
+
+	if (bench.save)
+	{
+		printf("Save formats:\n");
+		benchmarkSaveFormat(engine, "xml", "bench_save.xml", SaveFormat::XML);
+		benchmarkSaveFormat(engine, "binary", "bench_save.bin", SaveFormat::BINARY);
+	}
+
+	if (bench.hits > 0 && engine->player->destructible != nullptr)
+	{
+		benchmarkHits(engine->player->destructible->body, bench.hits);
+	}
+
+	printf("Metrics:\n");
+	Trace::writeMetrics(stdout);
+
+	//The trace is written by the Engine when it is destroyed
+	delete engine;
+	if (bench.trace != nullptr) { printf("Trace written to %s\n", bench.trace); }
+	return 0;
+}
@@ -1,86 +1,97 @@
 #include "Action.hpp"
 #include "Map.hpp"
 #include "Actor.hpp"
+#include "Journal.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+static ObjectPool<MoveAction> move_action_pool;
+static ObjectPool<IdleAction> idle_action_pool;
 
 void ActionScheduler::scheduleAction(Action* action, bool playerAction)
 {
+	TRACE_ZONE("ActionScheduler::scheduleAction");
 	assert(action != nullptr);
-	bool inserted = false;
 
-	double time_to_exec = calculateTimeToExec(action->getActorSpeed(), action->getCost());
-	double prev_time = 0.0;
+	double exec_time = current_time + calculateTimeToExec(action->getActorSpeed(), action->getCost());
+	unsigned long long sequence = next_sequence++;
 
-	ActionQueueEntry* td = new ActionQueueEntry(action, time_to_exec);
+	queue->push_back(ActionQueueEntry(action, exec_time, sequence));
+	std::push_heap(queue->begin(), queue->end(), ActionQueueEntryLater());
 
-	if (queue->size() == 0)
+	if (playerAction)
 	{
-		queue->push_front(td);
-		inserted = true;
-	}
-	else {
-		for (auto it = queue->begin(); it != queue->end(); it++)
-		{
-			if ((*it)->time_to_exec > time_to_exec && prev_time <= time_to_exec)
-			{
-				queue->insert(it, td);
-				inserted = true;
-			}
-			prev_time = (*it)->time_to_exec;
-		}
-		//If not inserted, it must be added at the end
-		if (!inserted)
-		{
-			queue->push_back(td);
-			inserted = true;
-		}
+		player_action_scheduled = true;
+		player_action_sequence = sequence;
 	}
 
-	if (inserted = true && playerAction)
-		nextPlayerAction = td;
+	if (journal != nullptr) { journal->recordSchedule(action, playerAction); }
+}
+
+ActionScheduler::~ActionScheduler()
+{
+	//The actions still in the queue are owned by the scheduler
+	for (auto it = queue->begin(); it != queue->end(); it++) { delete it->action; }
+	delete queue;
 }
 
 Action* ActionScheduler::nextAction()
 {
+	TRACE_ZONE("ActionScheduler::nextAction");
 	if (queue->empty()) { return nullptr; }
 
-	ActionQueueEntry* ent = queue->front();
-	Action* action = ent->action;
-	
-	//Need to deep copy value from ActionQueueEntry, otherwise it would always reduce by
-	// ent->tte - ent->tte, because this is first in queue.
-	double reduction = ent->time_to_exec;
+	//Move the front entry to the back of the vector, restoring the heap
+	// property for the remaining entries, then remove it.
+	std::pop_heap(queue->begin(), queue->end(), ActionQueueEntryLater());
+	ActionQueueEntry ent = queue->back();
+	queue->pop_back();
 
-	//Reduce time_to_exec for all elements in queue by the
-	// time_to_exec of the next action.
-	for (auto it = queue->begin(); it != queue->end(); it++)
-	{
-		(*it)->time_to_exec -= reduction;
-	}
+	//Advance the game clock. Entries are dequeued in order of their
+	// execution time, so the clock never runs backwards.
+	assert(ent.exec_time >= current_time);
+	current_time = ent.exec_time;
+
+	if (player_action_scheduled && ent.sequence == player_action_sequence)
+		player_action_scheduled = false;
 
-	if (ent == nextPlayerAction)
-		nextPlayerAction = nullptr;
+	if (journal != nullptr) { journal->recordDequeue(); }
 
-	queue->pop_front();
-	return action;
+	return ent.action;
 }
 
-const ActionResult* MoveAction::execute()
+ActionResult MoveAction::execute()
 {
 	if (map->isWall(actor->getPosX() + d_x, actor->getPosY() + d_y))
 	{
-		return new const ActionResult(actor->getUUID(), false);
+		return ActionResult(actor->getHandle(), false);
 	}
 
-	std::string occ_actor = actor_map->isOccupied(actor->getPosX() + d_x, actor->getPosY() + d_y);
-	if (occ_actor != "")
+	Actor* occ_actor = actor_map->getActorAt(actor->getPosX() + d_x, actor->getPosY() + d_y);
+	if (occ_actor != nullptr)
 	{
 		//TODO: return interact/attack Action
-		return new const ActionResult(actor->getUUID(), false);
+		return ActionResult(actor->getHandle(), false);
 	}
 
-	actor_map->moveActor(actor->getUUID(), actor->getPosX() + d_x, actor->getPosY() + d_y);
+	actor_map->moveActor(actor->getHandle(), actor->getPosX() + d_x, actor->getPosY() + d_y);
 
-	return new const ActionResult(actor->getUUID(), true);
+	return ActionResult(actor->getHandle(), true);
+}
+
+void* MoveAction::operator new(size_t size)
+{
+	return move_action_pool.allocate(size);
+}
+
+void MoveAction::operator delete(void* p, size_t size)
+{
+	move_action_pool.release(p, size);
+}
+
+const PoolStats& MoveAction::getPoolStats()
+{
+	return move_action_pool.getStats();
 }
 
 const int Action::getActorSpeed()
@@ -93,7 +104,22 @@ IdleAction::IdleAction(Actor* actor) : Action(actor, ACTION_IDLE), cost(actor->g
 
 }
 
-const ActionResult* IdleAction::execute()
+ActionResult IdleAction::execute()
+{
+	return ActionResult(actor->getHandle(), true);
+}
+
+void* IdleAction::operator new(size_t size)
+{
+	return idle_action_pool.allocate(size);
+}
+
+void IdleAction::operator delete(void* p, size_t size)
+{
+	idle_action_pool.release(p, size);
+}
+
+const PoolStats& IdleAction::getPoolStats()
 {
-	return new const ActionResult(actor->getUUID(), true);
+	return idle_action_pool.getStats();
 }
\ No newline at end of file
@@ -2,16 +2,20 @@
 #define ACTION_HPP
 
 #include "Object.hpp"
+#include "Handle.hpp"
+#include "ObjectPool.hpp"
 
 class Actor;
 class Map;
 class ActorMap;
+class Journal;
 
 #include <string>
-#include <list>
+#include <vector>
+#include <cassert>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/base_object.hpp>
-#include <boost/serialization/list.hpp>
+#include <boost/serialization/vector.hpp>
 
 class Action;
 class ActionResult;
@@ -27,9 +31,13 @@ enum ActionType {
 static const char* ActionTypeNames[SIZE_OF_ACTION_TYPE_ENUM] = { "Move Action", "Idle Action", "Null Action" };
 
 /** 
-* A (double-linked) list of these stucts is used in the ActionScheduler as the queue element.
+* A binary heap of these structs is used in the ActionScheduler as the queue element.
+* The execution time is absolute (measured on the Schedulers game clock), so entries never
+* have to be touched again once they are queued. The sequence number is handed out by the
+* Scheduler in the order in which actions are scheduled and breaks ties between actions
+* with the same execution time (first come, first served).
 *
-* @brief A struct holding a pointer to an action, and the time to the actions execution (as double).
+* @brief A struct holding a pointer to an action, its absolute execution time and its sequence number.
 */
 struct ActionQueueEntry
 {
@@ -39,25 +47,44 @@ private:
 	void serialize(Archive & ar, const unsigned int version)
 	{
 		ar & BOOST_SERIALIZATION_NVP(action);
-		ar & BOOST_SERIALIZATION_NVP(time_to_exec);
+		ar & BOOST_SERIALIZATION_NVP(exec_time);
+		ar & BOOST_SERIALIZATION_NVP(sequence);
 	}
 
 public:
 	Action* action;
-	double time_to_exec;
+	double exec_time;
+	unsigned long long sequence;
 
-	/**Creates a new ActionQueueEntry with the given action and time to execution.
+	/**Creates a new ActionQueueEntry with the given action, absolute execution time and sequence number.
 	*/
-	ActionQueueEntry(Action* action, double time_to_exec) : action(action), time_to_exec(time_to_exec) {};
-	ActionQueueEntry() {};
+	ActionQueueEntry(Action* action, double exec_time, unsigned long long sequence) 
+		: action(action), exec_time(exec_time), sequence(sequence) {};
+	ActionQueueEntry() : action(nullptr), exec_time(0.0), sequence(0) {};
 	~ActionQueueEntry() {};
 };
+
+/** Used as the comparison function of the ActionSchedulers heap. Since the standard library heap
+* functions build a max-heap, the comparison is reversed: the entry with the _lowest_ execution time 
+* (and, on equal times, the lowest sequence number) ends up at the front of the heap.
+*
+* @brief Ordering of ActionQueueEntry structs for the ActionSchedulers heap.
+*/
+struct ActionQueueEntryLater
+{
+	bool operator()(const ActionQueueEntry& a, const ActionQueueEntry& b) const
+	{
+		if (a.exec_time != b.exec_time) { return a.exec_time > b.exec_time; }
+		return a.sequence > b.sequence;
+	}
+};
  
-/** It holds a double-linked list of ActionQueueEntry, which acts
-* as the FIFO queue of Actions.
-* The "time to execution" (TtE) is calculated as follows is an arbitrary number used to sort
-* the action queue. The action with the lowest TtE is executed next, and its TtE substracted from
-* all other TtEs in the queue.
+/** It holds a binary heap of ActionQueueEntry, which acts as the priority queue of Actions,
+* and the game clock, i.e. the absolute time of the last executed action.
+* The "time to execution" (TtE) of an action is calculated from its cost and the speed of the actor
+* and added to the game clock to get the absolute execution time, which is used to sort the queue.
+* The action with the lowest execution time is executed next and the game clock is advanced to its
+* execution time. Both scheduling and dequeuing an action are O(log n).
 * See the [action system reference](action_help.html) for more.
 *
 * @brief A class responsible for the correct execution order of actions scheduled for Actors.
@@ -69,18 +96,37 @@ private:
 	template<class Archive>
 	void serialize(Archive & ar, const unsigned int version)
 	{
+		//The heap is stored as-is, its order is preserved by the archive
 		ar & BOOST_SERIALIZATION_NVP(queue);
-		ar & BOOST_SERIALIZATION_NVP(nextPlayerAction);
+		ar & BOOST_SERIALIZATION_NVP(current_time);
+		ar & BOOST_SERIALIZATION_NVP(next_sequence);
+		ar & BOOST_SERIALIZATION_NVP(player_action_scheduled);
+		ar & BOOST_SERIALIZATION_NVP(player_action_sequence);
 	}
 
-	std::list<ActionQueueEntry*>* queue;
+	/**The queue, organized as a binary heap (see std::push_heap) using ActionQueueEntryLater.
+	*/
+	std::vector<ActionQueueEntry>* queue;
 
-	/**When a action is scheduled with scheduleAction(Action, playerAction = true), this pointer
-	* is set to the ActionQueueEntry that is added to the queue. When it is dequeued via nextAction(),
-	* the Scheduler sets nextPlayerAction to the nullptr. This allows the game loop to idle until
-	* the next player action is queued.
+	/**The game clock. It is set to the execution time of every action that is dequeued
+	* via nextAction() and therefore only ever increases.
 	*/
-	ActionQueueEntry* nextPlayerAction = nullptr;
+	double current_time = 0.0;
+
+	/**The sequence number that will be assigned to the next scheduled action.
+	*/
+	unsigned long long next_sequence = 0;
+
+	/**When a action is scheduled with scheduleAction(Action, playerAction = true), this flag is set
+	* and the sequence number of its ActionQueueEntry is stored. When that entry is dequeued via nextAction(),
+	* the flag is cleared. This allows the game loop to idle until the next player action is queued.
+	*/
+	bool player_action_scheduled = false;
+	unsigned long long player_action_sequence = 0;
+
+	/**The Journal every scheduled and dequeued action is recorded in (may be the nullptr).
+	*/
+	Journal* journal = nullptr;
 
 	/** This function calculates the time to execution as follows: (Action cost) / (Actor speed).
 	*
@@ -96,8 +142,8 @@ private:
 
 public:
 	/** This function enters an action into the Schedulers queue. The time to execution is
-	* calculated from the action itself. The action will be inserted at the position in the queue
-	* corresponding to its time to execution.
+	* calculated from the action itself and added to the current game time. 
+	* Actions with equal execution times are executed in the order they were scheduled in.
 	*
 	* @param action A pointer to the action to be scheduled.
 	* @param playerAction Wheter the action was scheduled by the PlayerAi, and will cause a block
@@ -105,7 +151,8 @@ public:
 	*/
 	void scheduleAction(Action* action, bool playerAction = false);
 
-	/** This function returns the next action in queue. The action is deleted from the queue.
+	/** This function returns the next action in queue. The action is deleted from the queue
+	* and the game clock is advanced to its execution time.
 	* _Important: The action instance must be destroyed by the caller after use, because it cannot be handled by
 	* the Scheduler or the Action itself!_
 	*
@@ -117,13 +164,30 @@ public:
 	* If there is none, it returns false. This allows the game loop to idle when there is no player 
 	* action scheduled.
 	*/
-	bool isPlayerActionScheduled() {if (nextPlayerAction == nullptr) { return false; } return true; }
+	bool isPlayerActionScheduled() { return player_action_scheduled; }
+
+	/** @brief Returns the game clock, i.e. the execution time of the last dequeued action.
+	*/
+	double getCurrentTime() const { return current_time; }
+
+	/** @brief Returns the number of actions in the queue.
+	*/
+	size_t getQueueSize() const { return queue->size(); }
+
+	/** @brief Sets the Journal every scheduled and dequeued action is recorded in.
+	*/
+	void setJournal(Journal* journal) { this->journal = journal; }
 
-	ActionScheduler() : queue(new std::list<ActionQueueEntry*>()) {};
-	~ActionScheduler()
+	/** @brief Returns the execution time of the next action in queue, which must not be empty.
+	*/
+	double getNextActionTime() const
 	{
-		delete queue;
-	};
+		assert(!queue->empty());
+		return queue->front().exec_time;
+	}
+
+	ActionScheduler() : queue(new std::vector<ActionQueueEntry>()) {};
+	~ActionScheduler();
 };
 
 /** 
@@ -155,11 +219,13 @@ public:
 	virtual const int getCost() = 0;
 	const int getActorSpeed();
 	const ActionType getActionType() { return type; }
+	Actor* getActor() const { return actor; }
 
 	/** This abstract function must be implemented by all Derivates of Action.
-	* It dictates what the Action actually _does_.
+	* It dictates what the Action actually _does_. The result is returned by value, so
+	* executing an action does not allocate anything.
 	*/
-	virtual const ActionResult* execute() = 0;
+	virtual ActionResult execute() = 0;
 
 	Action(Actor* actor, ActionType type) : actor(actor), type(type) {};
 	Action():type(ACTION_NULL){};
@@ -177,16 +243,16 @@ class ActionResult
 private:
 	const bool success;
 	const Action* alternative;
-	const std::string actor_uuid;
+	const ActorHandle actor;
 
 public:
 	const bool wasSuccessful() const { return success; };
 	const Action* getAlternative() const { return alternative; };
 
-	const std::string getActorUUID() const { return actor_uuid; }
+	const ActorHandle getActor() const { return actor; }
 
-	ActionResult(std::string actor_uuid, bool success, const Action* alternative = nullptr) 
-		: actor_uuid(actor_uuid), success(success), alternative(alternative) {};
+	ActionResult(ActorHandle actor, bool success, const Action* alternative = nullptr) 
+		: actor(actor), success(success), alternative(alternative) {};
 	~ActionResult(){};
 };
 
@@ -221,7 +287,16 @@ public:
 	//TODO: Add dynamic cost depending on terrain etc.
 	const int getCost() { return cost; }
 
-	const ActionResult* execute();
+	int getDeltaX() const { return d_x; }
+	int getDeltaY() const { return d_y; }
+
+	ActionResult execute();
+
+	/** MoveActions are allocated from an ObjectPool, as one is created for almost every turn of every Actor.
+	*/
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
+	static const PoolStats& getPoolStats();
 
 	MoveAction(Actor* actor, Map* map, ActorMap* actor_map, int d_x, int d_y) : Action(actor, ACTION_MOVE), map(map), actor_map(actor_map), d_x(d_x), d_y(d_y){};
 	MoveAction(){};
@@ -249,7 +324,14 @@ private:
 public:
 	const int getCost() { return cost; }
 
-	const ActionResult* execute();
+	ActionResult execute();
+
+	/** IdleActions are allocated from an ObjectPool, like MoveActions.
+	*/
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
+	static const PoolStats& getPoolStats();
+
 	IdleAction(Actor* actor);
 	IdleAction():cost(0){};
 };
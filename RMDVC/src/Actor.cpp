@@ -1,15 +1,22 @@
 #include "Actor.hpp"
+#include "Ai.hpp"
+#include "Destructible.hpp"
  
 Actor::Actor(int x, int y, int ch, const TCODColor &col, int speed) :
-   RenderObject(x,y,col, TCODColor::black, ch), speed(speed), destructible(NULL) {
+   RenderObject(x,y,col, TCODColor::black, ch), speed(speed), destructible(NULL), ai(NULL) {
 }
 
 Actor::~Actor()
 {
 	delete destructible;
+	delete ai;
 }
  
 void Actor::render(TCODConsole* con) {
-    con->setChar(pos_x,pos_y,ch);
-    con->setCharForeground(pos_x,pos_y,foreground_color);
+	render(con, 0, 0);
+}
+
+void Actor::render(TCODConsole* con, int view_x, int view_y) {
+    con->setChar(pos_x - view_x, pos_y - view_y, ch);
+    con->setCharForeground(pos_x - view_x, pos_y - view_y, foreground_color);
 }
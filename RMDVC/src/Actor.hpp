@@ -3,6 +3,7 @@
 
 #include "libtcod.hpp"
 #include "Object.hpp"
+#include "Handle.hpp"
 
 class Ai;
 class Destructible;
@@ -22,6 +23,11 @@ class Actor : public RenderObject {
 private:
 	int speed;
 
+	/**The handle under which the Actor is registered in the ActorMap. It is assigned
+	* by ActorMap::addActor() and not serialized (see ActorMap).
+	*/
+	ActorHandle handle;
+
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive & ar, const unsigned int version)
@@ -37,12 +43,19 @@ public :
 	Ai* ai;
 
 	const int getSpeed() { return speed; }
+
+	ActorHandle getHandle() const { return handle; }
+	void setHandle(ActorHandle handle) { this->handle = handle; }
  
     Actor(int x, int y, int ch, const TCODColor &col, int speed);
 	Actor(){};
     ~Actor();
 
     void render(TCODConsole* con);
+
+	/**Draws the actor onto the console whose top left corner shows the cell (view_x, view_y).
+	*/
+	void render(TCODConsole* con, int view_x, int view_y);
 };
 
 #endif
@@ -3,9 +3,20 @@
 #include "Engine.hpp"
 #include "Map.hpp"
 #include "Actor.hpp"
+#include "ChaseMap.hpp"
+#include "Trace.hpp"
+
+#include <utility>
+
+/** The time every Ai takes to decide, in nanoseconds.
+*/
+static TraceHistogram decide_histogram("ai decide ns");
+
+static TraceCounter speculative_fov_hits("speculative fov hits");
 
 void PlayerAi::update(Actor* owner, Engine* engine, TCOD_key_t key)
 {
+	TRACE_ZONE("PlayerAi::update");
 	Action* action = nullptr;
 
 	switch (key.vk) {
@@ -33,22 +44,85 @@ void PlayerAi::update(Actor* owner, Engine* engine, TCOD_key_t key)
 
 void MeleeAi::update(Actor* owner, Engine* engine, TCOD_key_t key)
 {
-	engine->map->tmap->computeFov(owner->getPosX(), owner->getPosY(), 10, true, FOV_BASIC);
-	if (engine->map->tmap->isInFov(engine->player->getPosX(), engine->player->getPosY()))
-	{
-		TCODPath* path = new TCODPath(engine->map->tmap);
-		path->compute(owner->getPosX(), owner->getPosY(), engine->player->getPosX(), engine->player->getPosY());
-		int x, y;
-		path->walk(&x, &y, true);
+	TRACE_ZONE("MeleeAi::update");
+	//Only recomputed if the owner has moved or the map has changed since the last update
+	adoptSpeculation(owner);
+	engine->map->updateFov(&fov, owner->getPosX(), owner->getPosY(), FOV_RADIUS);
+	engine->getPlayerChaseMap();
 
-		scheduleMove(owner, engine, x - owner->getPosX(), y- owner->getPosY());
-	}
-	else
+	ActionIntent intent;
+	choose(owner, engine, &intent);
+	commit(owner, engine, intent);
+}
+
+bool MeleeAi::prepare(Actor* owner, Engine* engine)
+{
+	TRACE_ZONE("MeleeAi::prepare");
+	adoptSpeculation(owner);
+	engine->map->prepareFov(&fov, owner->getPosX(), owner->getPosY(), FOV_RADIUS);
+	engine->getPlayerChaseMap();
+	return true;
+}
+
+void MeleeAi::decide(const Actor* owner, const Engine* engine, TCODMap** fov_map, ActionIntent* intent)
+{
+	TRACE_ZONE_HISTOGRAM("MeleeAi::decide", decide_histogram);
+	Map::computeFov(&fov, fov_map);
+	choose(owner, engine, intent);
+}
+
+void MeleeAi::choose(const Actor* owner, const Engine* engine, ActionIntent* intent) const
+{
+	intent->type = ACTION_IDLE;
+
+	if (fov.isInFov(engine->player->getPosX(), engine->player->getPosY()))
 	{
-		scheduleIdle(owner, engine);
+		//Step downhill on the distance field toward the player
+		if (engine->getChaseMap()->getStepToward(owner->getPosX(), owner->getPosY(), engine->actors, &intent->d_x, &intent->d_y))
+		{
+			intent->type = ACTION_MOVE;
+		}
 	}
 }
 
+void MeleeAi::commit(Actor* owner, Engine* engine, const ActionIntent& intent)
+{
+	TRACE_ZONE("MeleeAi::commit");
+	if (intent.type == ACTION_MOVE) { scheduleMove(owner, engine, intent.d_x, intent.d_y); }
+	else { scheduleIdle(owner, engine); }
+
+	planned_x = owner->getPosX() + (intent.type == ACTION_MOVE ? intent.d_x : 0);
+	planned_y = owner->getPosY() + (intent.type == ACTION_MOVE ? intent.d_y : 0);
+}
+
+void MeleeAi::adoptSpeculation(const Actor* owner)
+{
+	if (!speculative_fov.valid || speculative_fov.origin_x != owner->getPosX() || speculative_fov.origin_y != owner->getPosY()) { return; }
+
+	//A field of view at the current position is at least as recent
+	if (fov.valid && fov.origin_x == speculative_fov.origin_x && fov.origin_y == speculative_fov.origin_y) { return; }
+
+	//An outdated one is computed again by Map::prepareFov(), as it checks the map version
+	std::swap(fov, speculative_fov);
+	TRACE_COUNT(speculative_fov_hits, 1);
+}
+
+bool MeleeAi::prepareSpeculation(Actor* owner, Engine* engine)
+{
+	if (planned_x < 0) { return false; }
+
+	//Staying put needs no new field of view
+	if (fov.valid && fov.origin_x == planned_x && fov.origin_y == planned_y) { return false; }
+
+	return engine->map->prepareFov(&speculative_fov, planned_x, planned_y, FOV_RADIUS);
+}
+
+void MeleeAi::speculate(const Actor* owner, const Engine* engine, TCODMap** fov_map)
+{
+	TRACE_ZONE("MeleeAi::speculate");
+	Map::computeFov(&speculative_fov, fov_map);
+}
+
 void MeleeAi::scheduleIdle(Actor* owner, Engine* engine)
 {
 	engine->scheduler->scheduleAction(new IdleAction(owner));
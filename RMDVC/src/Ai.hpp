@@ -2,15 +2,40 @@
 #define AI_HPP
 
 #include "libtcod.hpp"
+#include "Map.hpp"
+#include "Action.hpp"
 
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/base_object.hpp>
+#include <boost/serialization/nvp.hpp>
 
 class Actor;
 class Engine;
 class Map;
 
-/** @brief Base class for all Ai modules.
+/** @brief The action an Ai has decided on in Ai::decide(), to be scheduled by Ai::commit().
+*/
+struct ActionIntent {
+	ActionType type;
+
+	/** The direction of an ACTION_MOVE.
+	*/
+	int d_x;
+	int d_y;
+
+	ActionIntent() : type(ACTION_NULL), d_x(0), d_y(0) {};
+};
+
+/** An Ai either schedules the next action of its Actor directly in update(), or it takes part
+* in the decision phase of the Engine, which lets all Ais whose Actors have acted decide at once:
+* prepare() is called for every Ai on the main thread, decide() for all of them in parallel and
+* commit() for every Ai on the main thread again, in the order the Actors have acted.
+*
+* While the game waits for the player, the Engine lets the Ais speculate on their next decision the
+* same way: prepareSpeculation() on the main thread, speculate() in parallel. Whatever they precompute
+* must be checked before it is used, as the action of the player may have made it worthless.
+*
+* @brief Base class for all Ai modules.
 */
 class Ai
 {
@@ -22,6 +47,38 @@ private:
 
 public:
 	virtual void update(Actor* owner, Engine* engine, TCOD_key_t key) = 0;
+
+	/** Brings everything decide() reads, but which is not safe to update concurrently, up to date
+	* (e.g. copies the map around the owner).
+	*
+	* @return false if this Ai does not take part in the decision phase, it is then updated by update().
+	*/
+	virtual bool prepare(Actor* owner, Engine* engine) { return false; }
+
+	/** Decides the next action of the owner. This runs concurrently with the decide() of other Ais,
+	* so it must only read the world and change nothing but the Ai itself.
+	*
+	* @param fov_map The TCODMap for field of view computations of the calling thread, see Map::computeFov().
+	*/
+	virtual void decide(const Actor* owner, const Engine* engine, TCODMap** fov_map, ActionIntent* intent) {}
+
+	/** Schedules the action decided by decide().
+	*/
+	virtual void commit(Actor* owner, Engine* engine, const ActionIntent& intent) {}
+
+	/** Brings everything speculate() reads up to date, like prepare(). It must not change the game
+	* state, but only what the Ai keeps for itself.
+	*
+	* @return false if there is nothing to speculate on.
+	*/
+	virtual bool prepareSpeculation(Actor* owner, Engine* engine) { return false; }
+
+	/** Precomputes what the next decision of the Ai is expected to need. Like decide(), it runs
+	* concurrently with the speculate() of other Ais and must change nothing but the Ai itself.
+	*/
+	virtual void speculate(const Actor* owner, const Engine* engine, TCODMap** fov_map) {}
+
+	virtual ~Ai() {};
 };
 
 /** @brief A class that enables parsing of keyboard inputs into actions of the player Actor.
@@ -39,7 +96,15 @@ public:
 	void update(Actor* owner, Engine* engine, TCOD_key_t key);
 };
 
-/** @brief A class representing a basic melee monster Ai.
+/** Every MeleeAi belongs to one Actor and keeps the field of view of that Actor between updates:
+* it is only recomputed when the Actor has moved or the transparency of the map has changed. It is
+* not serialized, but rebuilt on the first update after loading.
+* When the player is in view, the Actor steps toward the player along the chase map of the Engine,
+* which is shared by all MeleeAis, so no Ai searches a path of its own.
+* While the game waits for the player, the field of view at the cell the Actor is about to move to is
+* computed in advance; it is taken over if the Actor gets there and the map has not changed meanwhile.
+*
+* @brief A class representing a basic melee monster Ai.
 */
 class MeleeAi : public Ai
 {
@@ -51,11 +116,42 @@ private:
 		ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(Ai);
 	}
 
+	/** The field of view of the owner.
+	*/
+	FovCache fov;
+
+	/** The field of view at the cell the owner will be at after its scheduled action (-1 if unknown),
+	* computed by speculate().
+	*/
+	FovCache speculative_fov;
+	int planned_x = -1;
+	int planned_y = -1;
+
+	/** Decides on the action from the (up to date) field of view.
+	*/
+	void choose(const Actor* owner, const Engine* engine, ActionIntent* intent) const;
+
+	/** Replaces the field of view by the speculative one if that was computed at the position of the owner.
+	*/
+	void adoptSpeculation(const Actor* owner);
+
 protected:
 	void scheduleMove(Actor* owner, Engine* engine, int d_x, int d_y);
 	void scheduleIdle(Actor* owner, Engine* engine);
 public:
+	/** The radius in which the Actor can see the player.
+	*/
+	static const int FOV_RADIUS = 10;
+
 	void update(Actor* owner, Engine* engine, TCOD_key_t key);
+
+	bool prepare(Actor* owner, Engine* engine);
+	void decide(const Actor* owner, const Engine* engine, TCODMap** fov_map, ActionIntent* intent);
+	void commit(Actor* owner, Engine* engine, const ActionIntent& intent);
+
+	bool prepareSpeculation(Actor* owner, Engine* engine);
+	void speculate(const Actor* owner, const Engine* engine, TCODMap** fov_map);
+
 };
 
 #endif
\ No newline at end of file
@@ -6,189 +6,278 @@
  */
 
 #include "Body.hpp"
+#include "HitLocationSampler.hpp"
 
 const char* part_type_strings[] = { "BodyPart", "Organ" };
 
-bdef_parse_error::bdef_parse_error(const std::string& msg, rapidxml::xml_node<>* node):
-	std::runtime_error("\aError while parsing body definition XML:\n" + msg + " on node " + node->name() + " with value " + node->value() + "\n")
+/** Lookups of UUIDs that are not (or no longer) part of the Body.
+*/
+static TraceCounter uuid_miss_counter("body uuid misses");
+
+//The ids that are referenced from code
+static const Symbol ID_ROOT = Symbol::intern("ROOT");
+static const Symbol ID_UPPER_TORSO = Symbol::intern("UPPER_TORSO");
+
+//The connector of the root Organ(s)
+static const Symbol ID_CONNECTOR_ROOT = Symbol::intern("_ROOT");
+
+/** With rapidxml::parse_non_destructive, names and values point into the buffer of the file
+* and are not null-terminated, so they are compared and copied by their size.
+*/
+static bool isNamed(const rapidxml::xml_base<>* item, const char* name)
+{
+	size_t length = strlen(name);
+	return item->name_size() == length && strncmp(item->name(), name, length) == 0;
+}
+
+static string nameOf(const rapidxml::xml_base<>* item)
+{
+	return string(item->name(), item->name_size());
+}
+
+static string valueOf(const rapidxml::xml_base<>* item)
+{
+	return string(item->value(), item->value_size());
+}
+
+static float floatValueOf(const rapidxml::xml_base<>* item)
+{
+	return (float)atof(valueOf(item).c_str());
+}
+
+/** Returns the line (starting at 1) of the given position within the text.
+*/
+static int lineOf(const char* text, const char* where)
+{
+	if (text == nullptr || where == nullptr || where < text) { return 0; }
+	return 1 + (int)std::count(text, where, '\n');
+}
+
+bdef_parse_error::bdef_parse_error(const std::string& msg, int line) :
+	std::runtime_error("Error while parsing body definition XML (line " + std::to_string(line) + "):\n" + msg + "\n"),
+	line(line)
 {
 };
 
-Tissue::Tissue(string id, string name, float pain,
+bdef_parse_error::bdef_parse_error(const std::string& msg, rapidxml::xml_node<>* node, const char* text) :
+	std::runtime_error("Error while parsing body definition XML (line " + std::to_string(lineOf(text, node->name())) + "):\n"
+		+ msg + " on node " + nameOf(node) + " with value " + valueOf(node) + "\n"),
+	line(lineOf(text, node->name()))
+{
+};
+
+Tissue::Tissue(Symbol id, Symbol name, float pain,
 		float blood_flow, float resistance, float impairment) :
+		id(id),name(name),
 		pain(pain),blood_flow(blood_flow),resistance(resistance),
 		impairment(impairment){
 
-	/* The XML parsing function works with pointers to strings only.
-	 * Every "id", "name" and any other string is only copied into memory ONCE, and that
-	 * is during the initial call of rapidxml.parse. All subsequent references to the variables
-	 * are pointers to this initial memory location. The rapidxml memory buffer is wiped
-	 * at the end of the loadBody function, however. Therefore all new instances of the Part
-	 * or Tissue class, which hold the strings for later use in the program, must ACTUALLY COPY
-	 * THE MEMORY to which the "parsing pointer" points and maintain a reference to it via their
-	 * own id and name (etc.) variables, which are pointers to the new, copied memory slot.
+	/* The XML parsing function works with pointers into the file buffer, which is freed
+	 * at the end of the loadBody function. The id and name have been interned by then,
+	 * which copies their text into the symbol table (once for all Bodies).
 	 */
-
-	this->id = string(id);
-	this->name = string(name);
-
 }
 
 Tissue::~Tissue()
 {
 }
 
-Part::Part(string id, string name, float surface, PartType type, Body* b) : Object()
+Part::Part(PartType type, Body* b) : Object()
 {
-
-	/* The XML parsing function works with pointers to strings only.
-	 * Every "id", "name" and any other string is only copied into memory ONCE, and that
-	 * is during the initial call of rapidxml.parse. All subsequent references to the variables
-	 * are pointers to this initial memory location. The rapidxml memory buffer is wiped
-	 * at the end of the loadBody function, however. Therefore all new instances of the Part
-	 * or Tissue class, which hold the strings for later use in the program, must ACTUALLY COPY
-	 * THE MEMORY to which the "parsing pointer" points and maintain a reference to it via their
-	 * own id and name (etc.) variables, which are pointers to the new, copied memory slot.
-	 */
-	this->name = string(name);
-	this->id = string(id);
-
-	this->surface = surface;
 	this->type = type;
 
 	this->body = b;
-
-	super = "";
 }
 
 Part::~Part()
 {
 }
 
-BodyPart::BodyPart(string id, string name, float surface, Body* b) :
-		Part(id, name, surface, TYPE_BODYPART, b){
-
-	children = new std::vector<string>();
+const string& Part::getName() const
+{
+	return body->getLayout()->getName(handle.index).str();
 }
 
-BodyPart::~BodyPart()
+Symbol Part::getId() const
 {
-	debug_print("BodyPart %s is kill.\n", this->id.c_str());
+	return body->getLayout()->getId(handle.index);
+}
 
-	delete children;
+float Part::getSurface() const
+{
+	return body->getLayout()->getSurface(handle.index);
 }
 
-void BodyPart::addChild(string child_uuid){
-	body->getPartByUUID(child_uuid)->setSuperPart(getUUID());
-	children->push_back(child_uuid);
+PartHandle Part::getSuperPart() const
+{
+	return body->getHandleAt(body->getLayout()->getParent(handle.index));
 }
 
-void BodyPart::addChildren(std::vector<string>* child_uuid_vector){
-	for (std::vector<string>::iterator it = child_uuid_vector->begin();
-		it != child_uuid_vector->end(); it++){
-		children->push_back(*it);
-		body->getPartByUUID(*it)->setSuperPart(getUUID());
-	}
+BodyPart::BodyPart(Body* b) :
+		Part(TYPE_BODYPART, b){
 }
 
-std::vector<string>* BodyPart::getChildList()
+BodyPart::~BodyPart()
 {
-	return new std::vector<string>(children->begin(), children->end());
+	debug_print("BodyPart %u is kill.\n", handle.index);
 }
 
-bool BodyPart::removeChild(string uuid){
-	
-	//Iterate though the list of children and remove the child with the matching UUID
-	for (std::vector<string>::iterator it = children->begin(); it != children->end(); it++)
+std::vector<PartHandle>* BodyPart::getChildList() const
+{
+	const BodyLayout* layout = body->getLayout();
+	std::vector<PartHandle>* children = new std::vector<PartHandle>();
+
+	for (int c = layout->getFirstChild(handle.index); c != BodyLayout::NO_PART; c = layout->getNextSibling(c))
 	{
-		
-		if (uuid.compare(*it) == 0){
-			children->erase(it);
+		if (body->isRemovedAt(c)) { continue; }
+		children->push_back(body->getHandleAt(c));
+	}
 
-			//If the BodyPart is now empty, it removes itself
-			if (children->size() == 0)
-			{
-				return true;
-				//body->removePart(getUUID(), false);
-			}
+	return children;
+}
 
-			//Dont continue iterating, vector has been changed!
-			break;
-		}
-	}
+Organ::Organ(Body* b):
+		Part(TYPE_ORGAN, b){
+}
 
-	return false;
+Organ::~Organ(){
+	debug_print("Organ %u is kill.\n", handle.index);
 }
 
-Organ::Organ(string id, string name, float surface, Body* b,
-		tissue_def *tissues, int tissue_count, const char *connector_id, bool is_root):
-		Part(id, name, surface, TYPE_ORGAN, b), tissues(tissues), tissue_count(tissue_count),
-		root(is_root){
+PartHandle Organ::getConnector() const
+{
+	return body->getHandleAt(body->getLayout()->getConnector(handle.index));
+}
 
-	/* The XML parsing function works with pointers to strings only.
-	 * Every "id", "name" and any other string is only copied into memory ONCE, and that
-	 * is during the initial call of rapidxml.parse. All subsequent references to the variables
-	 * are pointers to this initial memory location. The rapidxml memory buffer is wiped
-	 * at the end of the loadBody function, however. Therefore all new instances of the Part
-	 * or Tissue class, which hold the strings for later use in the program, must ACTUALLY COPY
-	 * THE MEMORY to which the "parsing pointer" points and maintain a reference to it via their
-	 * own id and name (etc.) variables, which are pointers to the new, copied memory slot.
-	 */
-	if (connector_id == "_ROOT")
+std::vector<PartHandle>* Organ::getConnectedOrgans() const
+{
+	const BodyLayout* layout = body->getLayout();
+	std::vector<PartHandle>* connectees = new std::vector<PartHandle>();
+
+	for (int c = layout->getFirstConnectee(handle.index); c != BodyLayout::NO_PART; c = layout->getNextConnectee(c))
 	{
-		this->connector_id = "_ROOT";
-		root = true;
-	}
-	else {
-		this->connector_id = string(connector_id);
+		if (body->isRemovedAt(c)) { continue; }
+		connectees->push_back(body->getHandleAt(c));
 	}
-	
-	connected_organs = new std::vector<string>();
+
+	return connectees;
 }
 
-Organ::~Organ(){
-	debug_print("Organ %s is kill.\n", this->id.c_str());
+Symbol Organ::getConnectorId() const
+{
+	const BodyLayout* layout = body->getLayout();
+	int connector = layout->getConnector(handle.index);
+	return connector == BodyLayout::NO_PART ? ID_CONNECTOR_ROOT : layout->getId(connector);
+}
+
+bool Organ::isRoot() const
+{
+	return body->getLayout()->getConnector(handle.index) == BodyLayout::NO_PART;
+}
 
-	delete connected_organs;
+bool Organ::isStump() const
+{
+	return body->isStumpAt(handle.index);
 }
 
-void Organ::linkToConnector(string connector_uuid){
-	this->connector_uuid = connector_uuid;
-	debug_print("LINKED %s to connector %s\n", getUUID().c_str(), connector_uuid.c_str());
+int Organ::getTissueCount() const
+{
+	const BodyLayout* layout = body->getLayout();
+	return layout->getTissueEnd(handle.index) - layout->getTissueBegin(handle.index);
 }
 
-std::vector<string>* Organ::getConnectedOrgans()
+const tissue_def& Organ::getTissue(int i) const
 {
-	return new std::vector<string>(connected_organs->begin(), connected_organs->end());
+	const BodyLayout* layout = body->getLayout();
+	assert(i >= 0 && i < getTissueCount());
+	return layout->getTissue(layout->getTissueBegin(handle.index) + i);
 }
 
-void Organ::addConnectedOrgan(string connectee_uuid){
-	connected_organs->push_back(connectee_uuid);
-	boost::dynamic_pointer_cast<Organ>(body->getPartByUUID(connectee_uuid))->linkToConnector(getUUID());
+int BodyLayout::addPart(PartType type, float surface, int parent, Symbol id, Symbol name)
+{
+	int index = (int)this->parent.size();
+
+	this->parent.push_back(parent);
+	this->depth.push_back(parent == NO_PART ? 0 : depth[parent] + 1);
+	this->type.push_back(type);
+	this->surface.push_back(surface);
+	this->id.push_back(id);
+	this->name.push_back(name);
+
+	tissue_begin.push_back((int)tissues.size());
+	tissue_end.push_back((int)tissues.size());
+	connector.push_back(NO_PART);
+
+	return index;
 }
 
-void Organ::removeConnectedOrgan(string uuid) {
-	//This function just removes the UUID! It doesn't deregister the Organ from the Body!!!
-	for (std::vector<string>::iterator it = connected_organs->begin(); it != connected_organs->end(); it++)
+void BodyLayout::setTissues(int index, const std::vector<tissue_def>& tdefs)
+{
+	//The tissues of an organ must directly follow those of the previous organ
+	assert(index == getPartCount() - 1);
+
+	tissue_begin[index] = (int)tissues.size();
+	tissues.insert(tissues.end(), tdefs.begin(), tdefs.end());
+	tissue_end[index] = (int)tissues.size();
+}
+
+void BodyLayout::setConnector(int index, int connector_index)
+{
+	connector[index] = connector_index;
+}
+
+void BodyLayout::compile()
+{
+	int count = getPartCount();
+
+	first_child.assign(count, NO_PART);
+	next_sibling.assign(count, NO_PART);
+	first_connectee.assign(count, NO_PART);
+	next_connectee.assign(count, NO_PART);
+	subtree_end.resize(count);
+
+	for (int i = 0; i < count; i++) { subtree_end[i] = i + 1; }
+
+	//Children always come after their parent in depth-first order, so iterating backwards
+	// completes every subtree before it is merged into its parent's and
+	// prepends the siblings in their original order
+	for (int i = count - 1; i >= 0; i--)
 	{
-		if (uuid.compare(*it) == 0)
+		int p = parent[i];
+		if (p != NO_PART)
+		{
+			next_sibling[i] = first_child[p];
+			first_child[p] = i;
+
+			if (subtree_end[i] > subtree_end[p]) { subtree_end[p] = subtree_end[i]; }
+		}
+
+		int c = connector[i];
+		if (c != NO_PART)
 		{
-			connected_organs->erase(it);
-			is_stump = true;
-			//Dont continue iterating, vector has been changed!
-			break;
+			next_connectee[i] = first_connectee[c];
+			first_connectee[c] = i;
 		}
 	}
 }
 
 Body::Body(const char *filename){
-	tissue_map = new std::map<std::string, boost::shared_ptr<Tissue>>();
-	part_map = new std::map<std::string, boost::shared_ptr<Part>>();
-	iid_uuid_map = new std::map<std::string, std::string>();
+	tissue_map = boost::make_shared<TissueMap>();
+	parts = new SlotMap<Part, boost::shared_ptr<Part>>();
+	layout = boost::make_shared<BodyLayout>();
+	part_removed = new std::vector<bool>();
+	part_stump = new std::vector<bool>();
+	live_child_count = new std::vector<int>();
+	uuid_handle_map = new std::map<std::string, PartHandle>();
+	iid_handle_map = new std::map<Symbol, PartHandle>();
 	part_gui_list = new std::vector<GuiObjectLink*>();
+	part_list_changes = new std::vector<GuiListRange>();
+	part_list_source = new BodyPartListSource(this);
+	hit_sampler = nullptr;
 	
-	string root_uuid = loadBody(filename);
-	root = boost::dynamic_pointer_cast<BodyPart>(getPartByUUID(root_uuid));
+	PartHandle root_handle = loadBody(filename);
+	root = boost::dynamic_pointer_cast<BodyPart>(getPartByHandle(root_handle));
+	resetPartState();
 	refreshLists();
 	
 #ifdef _DEBUG
@@ -197,54 +286,110 @@ Body::Body(const char *filename){
 #endif
 }
 
+Body::Body(const Body& prototype){
+	//Tissues and the layout are immutable and shared with the prototype
+	tissue_map = prototype.tissue_map;
+	layout = prototype.layout;
+
+	part_removed = new std::vector<bool>(*prototype.part_removed);
+	part_stump = new std::vector<bool>(*prototype.part_stump);
+	live_child_count = new std::vector<int>(*prototype.live_child_count);
+
+	iid_handle_map = new std::map<Symbol, PartHandle>(*prototype.iid_handle_map);
+	uuid_handle_map = new std::map<std::string, PartHandle>();
+	part_gui_list = new std::vector<GuiObjectLink*>();
+	part_list_changes = new std::vector<GuiListRange>();
+	part_list_source = new BodyPartListSource(this);
+	hit_sampler = nullptr;
+
+	//Copying the registry keeps all handles (slot index and generation) intact,
+	// the shared pointers are then replaced by pointers to copies of the Parts.
+	parts = new SlotMap<Part, boost::shared_ptr<Part>>(*prototype.parts);
+
+	for (size_t i = 0; i < parts->getSlotCount(); i++) {
+		if (!parts->isSlotOccupied(i)) { continue; }
+
+		boost::shared_ptr<Part>& part = parts->getAt(i);
+		if (part->getType() == TYPE_ORGAN) {
+			part = boost::make_shared<Organ>(*static_cast<Organ*>(part.get()));
+		}
+		else {
+			part = boost::make_shared<BodyPart>(*static_cast<BodyPart*>(part.get()));
+		}
+		part->rebind(this);
+	}
+
+	makeUUIDMap();
+
+	root = boost::static_pointer_cast<BodyPart>(getPartByHandle(prototype.root->getHandle()));
+
+	buildPartList(part_gui_list);
+}
+
 Body::~Body(){
-	delete tissue_map;
-	delete part_map;
-	delete iid_uuid_map;
+	delete parts;
+	delete part_removed;
+	delete part_stump;
+	delete live_child_count;
+	delete uuid_handle_map;
+	delete iid_handle_map;
+
+	for (auto it = part_gui_list->begin(); it != part_gui_list->end(); it++) { delete *it; }
 	delete part_gui_list;
+	delete part_list_changes;
+	delete part_list_source;
+	delete hit_sampler;
 }
 
-string Body::loadBody(const char *filename){
+PartHandle Body::loadBody(const char *filename){
+	TRACE_ZONE("Body::loadBody");
 	
 	//###XML FILE HANDLING###
 	using namespace rapidxml;
-	char *buffer;
 
-	//Load XML file
-	try{
-	std::ifstream is (filename);
-
-	if (is) {
-		//Get file length
-		is.seekg(0, is.end);
+	//Read the whole file into one null-terminated buffer. It is parsed non-destructively, i.e.
+	// the names and values of the nodes point into the buffer, which is kept until the end of the function.
+	std::ifstream is(filename, std::ios::binary);
+	if (!is)
+	{
+		debug_error("ERROR: Body definition %s could not be opened!\n", filename);
+		return PartHandle();
+	}
 
-		int length = is.tellg();
-		is.seekg(0, is.beg);
+	is.seekg(0, is.end);
+	std::streamoff length = is.tellg();
+	is.seekg(0, is.beg);
 
-		buffer = new char[length];
+	std::vector<char> buffer((size_t)length + 1, '\0');
+	is.read(&buffer[0], length);
+	buffer.resize((size_t)is.gcount() + 1, '\0');
+	buffer.back() = '\0';
 
-		is.read(buffer, length);
-		//buffer now holds entire XML file
-	} else { return false; }
+	const char* text = &buffer[0];
 
-	//Parse XML file
-	// WARNING: FILE MUST BE NULL-TERMINATED!
+	try{
 
 	xml_document<> doc;
-	doc.parse<0>(buffer);
+	try {
+		doc.parse<parse_non_destructive>(&buffer[0]);
+	}
+	catch (parse_error& e) {
+		throw bdef_parse_error(e.what(), lineOf(text, e.where<char>()));
+	}
 
+	xml_node<> *body_def = doc.first_node();
+	if (body_def == nullptr) { throw bdef_parse_error("The file contains no body definition!", 1); }
 
 	//###TISSUE DATA###
 
 	//Temporary variables
-	char *id = nullptr, *name = nullptr;
+	string id, name;
 	float pain = -1.0f, blood_flow = -1.0f, resistance = -1.0f, impairment = -1.0f; //Initialize with illegal values
 
 	//Load the tissue data (First first_node() is "body_def",
 	// data starts with second level "tissues")
-	xml_node<> *tissues = doc.first_node()->first_node("tissues");
-
-	char *_name;
+	xml_node<> *tissues = body_def->first_node("tissues");
+	if (tissues == nullptr) { throw bdef_parse_error("No tissues defined!", body_def, text); }
 
 	//Iterate through all tissue definitions
 	for (xml_node<> *tissue = tissues->first_node();
@@ -256,120 +401,94 @@ string Body::loadBody(const char *filename){
 				attr;
 				attr = attr->next_sibling())
 		{
+			if (isNamed(attr, "id")){ id = valueOf(attr); }
+			else if (isNamed(attr, "name")){ name = valueOf(attr); }
+			else if (isNamed(attr, "pain")){ pain = floatValueOf(attr); }
+			else if (isNamed(attr, "blood_flow")){ blood_flow = floatValueOf(attr); }
+			else if (isNamed(attr, "resistance")){ resistance = floatValueOf(attr); }
+			else if (isNamed(attr, "impairment")){ impairment = floatValueOf(attr); }
+		}
 
-			_name = attr->name();
-			if (!strcmp(_name,"id")){ id = attr->value(); }
-			else if (!strcmp(_name,"name")){ name = attr->value(); }
-			else if (!strcmp(_name,"pain")){ pain = atof(attr->value()); }
-			else if (!strcmp(_name,"blood_flow")){ blood_flow = atof(attr->value()); }
-			else if (!strcmp(_name,"resistance")){ resistance = atof(attr->value()); }
-			else if (!strcmp(_name,"impairment")){ impairment = atof(attr->value()); }
+		if (id.empty() || name.empty()){
+			throw bdef_parse_error("Not all mandatory Tissue variables defined!", tissue, text);
 		}
 
 		debug_print("Read Tissue:\n\tID: %s \n\tName: %s \n\tBlood Flow: %f \n\tResistance: %f \n\tImpairment: %f\n",
-				id, name, blood_flow, resistance, impairment);
+				id.c_str(), name.c_str(), blood_flow, resistance, impairment);
 
 		//Create a new Tissue and store the shared pointer to it in the tissue map
-		boost::shared_ptr<Tissue> t_tissue(new Tissue(id, name, pain, blood_flow, resistance, impairment));
-		tissue_map->insert(std::pair<std::string, boost::shared_ptr<Tissue>>(std::string(id), t_tissue));
+		Symbol tissue_id = Symbol::intern(id);
+		boost::shared_ptr<Tissue> t_tissue(new Tissue(tissue_id, Symbol::intern(name), pain, blood_flow, resistance, impairment));
+		tissue_map->insert(std::pair<Symbol, boost::shared_ptr<Tissue>>(tissue_id, t_tissue));
 	}
 
 	//###BODYPART DATA###
 
-	//maps for child linking and organ linking
-	//K: UUID of the child, V: UUID of the parent
-	std::map<string, string>* child_map = new std::map<string, string>();
-	//K: UUID of the organ, V: IID(!) of its connector
-	std::map<string, string>* organ_link_map = new std::map<string, string>();
+	//map for organ linking (children are linked to their parent in the layout while parsing)
+	//K: handle of the organ, V: IID(!) of its connector
+	std::map<PartHandle, Symbol> organ_link_map;
 
 	//Load the bodypart data (First first_node() is "body_def", 
 	// data starts with the second level "body" 
-	xml_node<> *body = doc.first_node()->first_node("body");
-	string root_uuid = enter(body->first_node(), child_map, organ_link_map);
+	xml_node<> *body = body_def->first_node("body");
+	if (body == nullptr || body->first_node() == nullptr) { throw bdef_parse_error("No body defined!", body_def, text); }
 
-	//Destroy the XML data in memory
-	delete[] buffer;
+	PartHandle root_handle = enter(body->first_node(), BodyLayout::NO_PART, &organ_link_map, text);
 
-	//Build IID<->UUID map, which is required for linking 
+	//Build IID<->handle map, which is required for linking 
 	makeIdMap();
 
-	//Link children and organs
-	for (std::map<string, string>::iterator ch_it = child_map->begin();
-		ch_it != child_map->end(); ch_it++) 
+	//Link organs to their connectors
+	for (std::map<PartHandle, Symbol>::iterator or_it = organ_link_map.begin();
+		or_it != organ_link_map.end(); or_it++)
 	{
-		if (getPartByUUID(ch_it->first) == nullptr)
+		if (getPartByHandle(or_it->first) == nullptr)
 		{
-			debug_error("ERROR during body part linking: Part UUID %s was requested, but is not in part map!\n",
-				ch_it->first.c_str());
-			return nullptr;
+			debug_error("ERROR during body part linking: Part %u was requested, but is not in part registry!\n",
+				or_it->first.index);
+			return PartHandle();
 		}
-		if (getPartByUUID(ch_it->second) == nullptr)
+		boost::shared_ptr<Part> connector = getPartByIID(or_it->second);
+		if (connector == nullptr)
 		{
-			debug_error("ERROR during body part linking: Part UUID %s was requested, but is not in part map!\n",
-				ch_it->second.c_str());
-			return nullptr;
-		}
-		
-		BodyPart* parent = dynamic_cast<BodyPart*>(getPartByUUID(ch_it->second).get());
-		if (parent == nullptr) 
-		{
-			debug_error("ERROR during body part linking: Casting from Part* to BodyPart* on Part %s failed!\n",
-				ch_it->second.c_str());
-			return nullptr;
-		}
-
-		parent->addChild(ch_it->first);
-	}
-
-	for (std::map<string, string>::iterator or_it = organ_link_map->begin();
-		or_it != organ_link_map->end(); or_it++)
-	{
-		if (getPartByUUID(or_it->first) == nullptr)
-		{
-			debug_error("ERROR during body part linking: Part UUID %s was requested, but is not in part map!\n",
-				or_it->first.c_str());
-			return nullptr;
-		}
-		if (getPartByIID(or_it->second) == nullptr)
-		{
-			debug_error("ERROR during body part linking: Part IID %s was requested, but is not in part map!\n",
+			debug_error("ERROR during body part linking: Part IID %s was requested, but is not in part registry!\n",
 				or_it->second.c_str());
-			return nullptr;
+			return PartHandle();
 		}
-		Part* temp = getPartByIID(or_it->second).get();
-		Organ* connector = dynamic_cast<Organ*>(temp);
-		if (connector == nullptr){
-			debug_error("ERROR during body part linking: Casting from Part* to Organ* on Part %s failed!\n",
+		if (connector->getType() != TYPE_ORGAN){
+			debug_error("ERROR during body part linking: Connector %s is not an Organ!\n",
 				or_it->second.c_str());
-			return nullptr;
+			return PartHandle();
 		}
-		connector->addConnectedOrgan(or_it->first);
+		layout->setConnector(or_it->first.index, connector->getHandle().index);
+		debug_print("LINKED %s to connector %s\n", getPartByHandle(or_it->first)->getId().c_str(), connector->getId().c_str());
 	}
 
+	//Build the child/sibling/connectee chains and subtree ranges
+	layout->compile();
+
 	//Successfully parsed the body definition file!
-	//Return the address of the newly created body part.
-	return root_uuid;
+	//Return the handle of the newly created body part.
+	return root_handle;
 
-	} catch (std::exception& e) {
-		debug_error("ERROR: %s \n", e.what());
-		return NULL;
+	} catch (bdef_parse_error& pe) {
+		debug_error("ERROR in %s: %s \n", filename, pe.what());
+		return PartHandle();
 	}
-	catch (bdef_parse_error& pe) {
-		debug_error("ERROR: %s \n", pe.what());
-		return NULL;
+	catch (std::exception& e) {
+		debug_error("ERROR in %s: %s \n", filename, e.what());
+		return PartHandle();
 	}
-
-	return NULL;
 }
 
-string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_map, std::map<string, string>* organ_link_map) {
+PartHandle Body::enter(rapidxml::xml_node<> *node, int parent, std::map<PartHandle, Symbol>* organ_link_map, const char* text) {
 	using namespace rapidxml;
 
 	int organ_count, bodyparts, it;
 	xml_node<> *temp;
 	xml_node<> **organ_node_list;
 
-	char *id = nullptr, *name = nullptr, *_name = nullptr;
+	string id, name;
 	float surface = 0.0f;
 
 	//Make a count of the body_part nodes in this node and parse all standard
@@ -377,34 +496,30 @@ string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_m
 	temp = node->first_node();
 	bodyparts = 0;
 	while (temp != nullptr){
-		_name = temp->name();
-
-		if (!strcmp(_name, "body_part")) { bodyparts++; }
+		if (isNamed(temp, "body_part")) { bodyparts++; }
 
-		if (!strcmp(_name, "id")) { id = temp->value(); }
-		if (!strcmp(_name, "name")) { name = temp->value(); }
-		if (!strcmp(_name, "surface")) { surface = atof(temp->value()); }
+		if (isNamed(temp, "id")) { id = valueOf(temp); }
+		if (isNamed(temp, "name")) { name = valueOf(temp); }
+		if (isNamed(temp, "surface")) { surface = floatValueOf(temp); }
 
 
 		temp = temp->next_sibling();
 	}
 
-	//if any of the mandatory vars for bodyparts are NULL, ERROR!
-	if (id == nullptr || name == nullptr){
-		throw new bdef_parse_error("Not all mandatory BodyPart variables defined!", node);
+	//if any of the mandatory vars for bodyparts are missing, ERROR!
+	if (id.empty() || name.empty()){
+		throw bdef_parse_error("Not all mandatory BodyPart variables defined!", node, text);
 	}
 
-	//make the bodypart, make the pointer to it shared and store it in the part_map
-	BodyPart* bp = new BodyPart((string)id, (string)name, surface, this);
+	//make the bodypart, make the pointer to it shared and register it
+	BodyPart* bp = new BodyPart(this);
 
 	boost::shared_ptr<BodyPart> p (bp);
 
-	part_map->insert(
-		std::pair<std::string, boost::shared_ptr<Part>>(
-		bp->getUUID(), boost::static_pointer_cast<Part>(p)));
+	registerPart(boost::static_pointer_cast<Part>(p), surface, parent, Symbol::intern(id), Symbol::intern(name));
 
 	//reset temporary variables for reuse with the organs
-	id = nullptr; name = nullptr;
+	id.clear(); name.clear();
 
 	//DEBUG: Print new BodyPart
 	debug_print("New BodyPart created: \n\tID: %s \n\tName: %s \n\tSurface: %f\n",
@@ -415,20 +530,21 @@ string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_m
 		//...there must be organs instead!
 		// variables
 		Organ **organs;
+		float *organ_surfaces;
+		Symbol *organ_ids, *organ_names, *organ_connectors;
+		std::vector<tissue_def> *organ_tissues;
 		xml_attribute<> *attr;
 		xml_node<> *tdef_node;
 
-		char *connector = nullptr;
+		string connector;
 		bool symmetrical = false;
 
 		it = 0;
 
 		//  temp vars for tissue definitions
-		char *tdef_id, *tdef_custom_id, *tdef_name;
-		float tdef_hit_prob;
+		string tdef_id;
 
-		tissue_def *tdefs = nullptr;
-		int tdef_count = 0, tdef_it = 0;
+		tissue_def tdef;
 
 
 		//Reset back to the first node in the given node
@@ -437,13 +553,13 @@ string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_m
 		//scan for organ nodes in the given node
 		organ_count = 0;
 		while (temp != nullptr){
-			if (!strcmp(temp->name(),"organ")) { organ_count++; }
+			if (isNamed(temp, "organ")) { organ_count++; }
 			temp = temp->next_sibling();
 		}
 
 		//If there are no organs AND no bodyparts, ERROR!
 		if (organ_count == 0){
-			throw bdef_parse_error("No body part and no organ definition!", node);
+			throw bdef_parse_error("No body part and no organ definition!", node, text);
 		}
 
 		//compile a list of nodes holding the organ definitions
@@ -452,9 +568,7 @@ string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_m
 		temp = node->first_node();
 
 		while (temp != nullptr){
-			_name = temp->name();
-
-			if (!strcmp(_name,"organ")) {
+			if (isNamed(temp, "organ")) {
 				organ_node_list[it] = temp;
 				it++;
 			}
@@ -462,107 +576,74 @@ string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_m
 			temp = temp->next_sibling();
 		}
 
-		//create temporary organ array
+		//create temporary organ, surface and tissue arrays
 		organs = new Organ*[organ_count];
+		organ_surfaces = new float[organ_count];
+		organ_ids = new Symbol[organ_count];
+		organ_names = new Symbol[organ_count];
+		organ_connectors = new Symbol[organ_count];
+		organ_tissues = new std::vector<tissue_def>[organ_count];
 
 		//parse each organ definition in the list
 		for (int i=0; i < organ_count; i++){
 			//Enter into organ node
 			temp = organ_node_list[i]->first_node();
+			symmetrical = false;
+			id.clear(); name.clear(); connector.clear();
 
 			//Iterate through all nodes within the organ node
 			while (temp != nullptr){
-				_name = temp->name();
-
 				//Parse standard tags
-				if (!strcmp(_name,"id")) { id = temp->value(); }
-				if (!strcmp(_name,"name")) { name = temp->value(); }
-				if (!strcmp(_name,"surface")) { surface = atof(temp->value()); }
-				if (!strcmp(_name,"connector")) { connector = temp->value(); }
+				if (isNamed(temp, "id")) { id = valueOf(temp); }
+				if (isNamed(temp, "name")) { name = valueOf(temp); }
+				if (isNamed(temp, "surface")) { surface = floatValueOf(temp); }
+				if (isNamed(temp, "connector")) { connector = valueOf(temp); }
 
 				//Parse the organ tissue definitions, create (or rather link) them
 				// and add to the organs
-				if (!strcmp(_name,"organ_tissue")) {
+				if (isNamed(temp, "organ_tissue")) {
 					attr = temp->first_attribute();
-					if (attr != nullptr && !strcmp(attr->name(), "symmetrical")){
+					if (attr != nullptr && isNamed(attr, "symmetrical")){
 						symmetrical = true;
 					}
 
 					attr = nullptr;
 
-					//Get the count of tissue defs
-					tdef_count = 0;
+					//Enter the organ_tissue node, create the tissue_def for
+					// each tissue_def child and store it in the organ's tissue vector
 					tdef_node = temp->first_node();
-
-					while (tdef_node != nullptr)
-					{
+					while (tdef_node != nullptr){
 						//If any other node than tissue_def, ERROR!
-						if (strcmp(tdef_node->name(), "tissue_def")) {
-							throw bdef_parse_error("Invalid node for organ tissue (only tissue_def allowed)!", temp);
+						if (!isNamed(tdef_node, "tissue_def")) {
+							throw bdef_parse_error("Invalid node for organ tissue (only tissue_def allowed)!", tdef_node, text);
 						}
 
-						tdef_count++;
-
-						tdef_node = tdef_node->next_sibling();
-					}
-
-					//Create organ tissue array, double size if organ is symmetrical
-					tdefs = new tissue_def[tdef_count * (symmetrical+1)];
-
-					//Enter the organ_tissue node, create the tissue_def for
-					// each tissue_def child and store it in tdefs[] array
-					tdef_it = 0;
-					tdef_node = temp->first_node();
-					while (tdef_node != nullptr){
 						//The value of a tissue_def node is the id of the tissue (e.g. M_ARTERY)
-						tdef_id = tdef_node->value();
+						tdef_id = valueOf(tdef_node);
 
-						tdef_hit_prob = 0;
-						tdef_name = nullptr;
-						tdef_custom_id = nullptr;
+						tdef.hit_prob = 0;
+						tdef.name = Symbol();
+						tdef.custom_id = Symbol();
 
-						//Get the other parameters
+						//Get the other parameters and store them in the tissue definition
 						attr = tdef_node->first_attribute();
 						while (attr != nullptr){
 
-							if (!strcmp(attr->name(), "hit_prob")){ tdef_hit_prob = atof(attr->value()); }
-							if (!strcmp(attr->name(), "name")) { tdef_name = attr->value(); }
-							if (!strcmp(attr->name(), "custom_id")) {
-								tdef_custom_id = attr->value();
-							}
+							if (isNamed(attr, "hit_prob")){ tdef.hit_prob = floatValueOf(attr); }
+							if (isNamed(attr, "name")) { tdef.name = Symbol::intern(valueOf(attr)); }
+							if (isNamed(attr, "custom_id")) { tdef.custom_id = Symbol::intern(valueOf(attr)); }
 
 							attr = attr->next_attribute();
 						}
 
-
-						//Store the parameters in the tissue definition
-						if (tdef_custom_id != nullptr) {
-							tdefs[tdef_it].custom_id = string(tdef_custom_id);
-						}
-						else { tdefs[tdef_it].custom_id = ""; }
-
-						if (tdef_name != nullptr) {
-							tdefs[tdef_it].name = string(tdef_name);
-						}
-						else { tdefs[tdef_it].name = ""; }
-						
-						tdefs[tdef_it].hit_prob = tdef_hit_prob;
-
 						//Link the tissue definition to it's base tissue
-						// NOTE: the tissue_map variable is a POINTER to the
-						//  actual tissue map which is defined in the loadBody (super)
-						//  function, therefore it must be dereferenced before use.
 						//If the base tissue cannot be linked, ERROR!
+						TissueMap::const_iterator pos = tissue_map->find(Symbol::find(tdef_id));
 
-						std::string key = tdef_id;
-
-						std::map<std::string, boost::shared_ptr<Tissue>>::const_iterator pos
-							= tissue_map->find(key);
+						if (pos == tissue_map->end()){ throw bdef_parse_error("Tissue not found!", tdef_node, text); }
+						tdef.tissue = pos->second;
 
-						if (pos == tissue_map->end()){ throw bdef_parse_error("Tissue not found!", tdef_node); }
-						tdefs[tdef_it].tissue = pos->second;
-
-						tdef_it++;
+						organ_tissues[i].push_back(tdef);
 						tdef_node = tdef_node->next_sibling();
 					}
 				}
@@ -571,391 +652,419 @@ string Body::enter(rapidxml::xml_node<> *node, std::map<string, string>* child_m
 
 			//Check whether all necessary data for organ creation has been read
 			// if not, ERROR!
-			if (id == nullptr || name == nullptr || connector == nullptr || tdefs == nullptr){
-				throw bdef_parse_error("Not all necessary data for organ creation found.", organ_node_list[i]);
+			if (id.empty() || name.empty() || connector.empty() || organ_tissues[i].empty()){
+				throw bdef_parse_error("Not all necessary data for organ creation found.", organ_node_list[i], text);
 			}
 
 			//if organ is symmetrical, create the symmetry by duplicating all entries but the last
 			// and appending them in reverse order
-			int d;
-			for (int j=tdef_count-2; j >= 0; j--)
+			if (symmetrical)
 			{
-				d = (j - (tdef_count - 1))*-1;
-				tdefs[(tdef_count-1)+d] = tdefs[j];
+				for (int j = (int)organ_tissues[i].size() - 2; j >= 0; j--)
+				{
+					organ_tissues[i].push_back(organ_tissues[i][j]);
+				}
 			}
 
 			//Create the organ
-			organs[i] = new Organ(string(id), string(name), surface, this, tdefs, tdef_count, connector, !strcmp(connector, "_ROOT"));
+			organs[i] = new Organ(this);
+			organ_surfaces[i] = surface;
+			organ_ids[i] = Symbol::intern(id);
+			organ_names[i] = Symbol::intern(name);
+			organ_connectors[i] = Symbol::intern(connector);
 
 			//DEBUG: Print Organ
 #ifdef _DEBUG
 			debug_print("\tNew Organ created:\n\t\tID: %s \n\t\tName: %s \n\t\tSurface: %f \n\t\tRoot: %s \n\t\tTissues:",
-				organs[i]->getId().c_str(), organs[i]->getName().c_str(), organs[i]->getSurface(), connector);
+				id.c_str(), name.c_str(), surface, connector.c_str());
 
-			for (int di = 0; di < (tdef_count * (symmetrical+1))-1; di++){
+			for (size_t di = 0; di < organ_tissues[i].size(); di++){
 				debug_print("\n\t\t\tBase Tissue Name: %s \n\t\t\t\tHit Prob.: %f",
-					tdefs[di].tissue->getName().c_str(), tdefs[di].hit_prob);
+					organ_tissues[i][di].tissue->getName().c_str(), organ_tissues[i][di].hit_prob);
 
-				if (!tdefs[di].name.empty()){ debug_print("\n\t\t\t\tCustom Name: %s", tdefs[di].name.c_str()); }
-				if (!tdefs[di].custom_id.empty()){ debug_print("\n\t\t\t\tCustom ID: %s", tdefs[di].custom_id.c_str()); }
+				if (!organ_tissues[i][di].name.empty()){ debug_print("\n\t\t\t\tCustom Name: %s", organ_tissues[i][di].name.c_str()); }
+				if (!organ_tissues[i][di].custom_id.empty()){ debug_print("\n\t\t\t\tCustom ID: %s", organ_tissues[i][di].custom_id.c_str()); }
 			}
 
 			debug_print("\n\tEND Organ.\n");
 #endif
 		}
 
-		//...and add all organs to the part map. Add the "child note"
-		// between the organs and the new bodypart to the child_map.
-		// Add the "connector note" between the organs and their connectors to 
-		// the organ_link_map.
+		//...and register all organs as children of the new bodypart and store
+		// their tissues in the layout. Add the "connector note" between the organs 
+		// and their connectors to the organ_link_map.
 		for (int i = 0; i < organ_count; i++){
-			part_map->insert(
-				std::pair<string, boost::shared_ptr<Part>>(
-				organs[i]->getUUID(),
-				boost::static_pointer_cast<Part>(boost::make_shared<Organ>(*(organs[i])))
-				));
-
-			child_map->insert(
-				std::pair<string, string>(
-				organs[i]->getUUID(),
-				bp->getUUID()
-				));
-
-			if (organs[i]->getConnectorId() != "_ROOT"){
+			PartHandle organ = registerPart(boost::shared_ptr<Part>(organs[i]), organ_surfaces[i], bp->getHandle().index,
+				organ_ids[i], organ_names[i]);
+			layout->setTissues(organ.index, organ_tissues[i]);
+
+			if (organ_connectors[i] != ID_CONNECTOR_ROOT){
 				organ_link_map->insert(
-					std::pair<string, string>(
-					organs[i]->getUUID(),
-					dynamic_cast<Organ*>(organs[i])->getConnectorId()
+					std::pair<PartHandle, Symbol>(
+					organ,
+					organ_connectors[i]
 					));
 			}
 		}
+
+		delete[] organs;
+		delete[] organ_surfaces;
+		delete[] organ_ids;
+		delete[] organ_names;
+		delete[] organ_connectors;
+		delete[] organ_tissues;
+		delete[] organ_node_list;
 		
 
 	} else {
 		//...its another BodyPart
 
 		//Go through all nodes and call this function on every
-		// node containing a part definition, add the returned BodyPart/Organ
-		// to this ones' children (per child_map)
+		// node containing a part definition, which appends the
+		// BodyPart/Organ to the layout as child of this one
 		temp = node->first_node();
 
 		it = 0;
 		while (temp != nullptr){
-			_name = temp->name();
-
-			if (!strcmp(_name, "body_part")) {
-				string child_uuid = enter(temp, child_map, organ_link_map);
-				child_map->insert(
-					std::pair<string, string>(
-					child_uuid,
-					bp->getUUID()
-					));
-				//bp->addChild(enter(temp));
+			if (isNamed(temp, "body_part")) {
+				enter(temp, bp->getHandle().index, organ_link_map, text);
 			}
 
 			temp = temp->next_sibling();
 		}
 	}
 
-	//return this bodyparts uuid
-	return bp->getUUID();
+	//return this bodyparts handle
+	return bp->getHandle();
+}
+
+PartHandle Body::registerPart(boost::shared_ptr<Part> part, float surface, int parent, Symbol id, Symbol name)
+{
+	PartHandle handle = parts->insert(part);
+	part->setHandle(handle);
+
+	//The layout index of a Part is the slot index of its handle
+	int index = layout->addPart(part->getType(), surface, parent, id, name);
+	assert(index == (int)handle.index);
+
+	uuid_handle_map->insert(std::pair<std::string, PartHandle>(part->getUUID(), handle));
+
+	return handle;
+}
+
+void Body::resetPartState()
+{
+	int count = layout->getPartCount();
+
+	part_removed->assign(count, false);
+	part_stump->assign(count, false);
+	live_child_count->assign(count, 0);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (layout->getParent(i) != BodyLayout::NO_PART) { (*live_child_count)[layout->getParent(i)]++; }
+	}
 }
 
 void Body::makeIdMap()
 {
-	iid_uuid_map->clear();
+	iid_handle_map->clear();
 
-	for (std::map<string, boost::shared_ptr<Part>>::iterator iterator = part_map->begin(); iterator != part_map->end(); iterator++) {
-		iid_uuid_map->insert(std::pair<std::string, std::string>(iterator->second->getId(), iterator->first));
+	for (size_t i = 0; i < parts->getSlotCount(); i++) {
+		if (!parts->isSlotOccupied(i)) { continue; }
+		iid_handle_map->insert(std::pair<Symbol, PartHandle>(parts->getAt(i)->getId(), parts->getHandleAt(i)));
 	}
 }
 
+void Body::makeUUIDMap()
+{
+	uuid_handle_map->clear();
 
-void Body::buildPartList(std::vector<GuiObjectLink*>* list, Part* p, int depth)
+	for (size_t i = 0; i < parts->getSlotCount(); i++) {
+		if (!parts->isSlotOccupied(i)) { continue; }
+		uuid_handle_map->insert(std::pair<std::string, PartHandle>(parts->getAt(i)->getUUID(), parts->getHandleAt(i)));
+	}
+}
+
+int BodyPartListSource::getRowCount() const
 {
-	//debug_print("Depth: %i, Part: %s \n", depth, p->getId());
-	if (p->getType() == PartType::TYPE_ORGAN)
-	{
-		//Append to end of list "gui_list_indent_char [times depth] ORGAN_NAME"
-		std::string str = "";
+	return (int)body->getPartGUIList()->size();
+}
 
-		for (int i = 0; i <= depth; i++)
-		{
-			str.append(gui_list_indent_char);
-		}
+const GuiObjectLink* BodyPartListSource::getRow(int index) const
+{
+	return (*body->getPartGUIList())[index];
+}
 
-		str.append(p->getName());
+void BodyPartListSource::takeChanges(std::vector<GuiListRange>* changes)
+{
+	body->takePartListChanges(changes);
+}
 
-		list->push_back(
-			new GuiObjectLink(
-			p->getUUID(),
-			new ColoredText(str, part_gui_list_color_organ)
-			)
-			);
+void Body::buildPartList(std::vector<GuiObjectLink*>* list)
+{
+	int count = layout->getPartCount();
 
-		return;
-	}
-	if (p->getType() == PartType::TYPE_BODYPART)
+	//The layout is in depth-first order, so a linear scan yields the parts in tree order.
+	// Removed parts are always removed with their whole subtree, which is skipped at once.
+	for (int i = 0; i < count; )
 	{
-		//Append to end of list "gui_list_indent_char [times depth] BODYPART_NAME"
-		BodyPart *bp = (BodyPart*)p;
+		if ((*part_removed)[i])
+		{
+			i = layout->getSubtreeEnd(i);
+			continue;
+		}
+
+		//Append to end of list "gui_list_indent_char [times depth] PART_NAME"
 		std::string str = "";
 
-		for (int i = 0; i <= depth; i++)
+		for (int d = 0; d <= layout->getDepth(i); d++)
 		{
 			str.append(gui_list_indent_char);
 		}
 
-		str.append(bp->getName());
+		str.append(layout->getName(i).str());
 
 		list->push_back(
 			new GuiObjectLink(
-			bp->getUUID(),
-			new ColoredText(str, part_gui_list_color_bodypart)
+			parts->getHandleAt(i).toRaw(),
+			new ColoredText(str, layout->getType(i) == TYPE_ORGAN ? part_gui_list_color_organ : part_gui_list_color_bodypart)
 			)
 			);
 
-		//Call this function on all children of the BodyPart
-		for (auto it = bp->getChildListRW()->begin(); it != bp->getChildListRW()->end(); it++)
-		{
-			boost::shared_ptr<Part> part = getPartByUUID(*it);
-			if (part == nullptr) { continue; }
-			buildPartList(list, part.get(), depth + 1);
-		}
-
-		bp = nullptr;
-
-		return;
+		i++;
 	}
-
-	debug_error("ERROR: Tried to call recursive part list building function on invalid Part* (neither TYPE_BODYPART nor TYPE_ORGAN)!\n");
-	return;
 }
 
 void Body::refreshLists()
 {
 	makeIdMap();
+
+	for (auto it = part_gui_list->begin(); it != part_gui_list->end(); it++) { delete *it; }
 	part_gui_list->clear();
-	buildPartList(part_gui_list, root.get());
+	part_list_changes->clear();
+
+	buildPartList(part_gui_list);
 }
 
-void Body::removePart(std::string part_uuid) {
-	//Get shared pointer of the Part to be removed
-	boost::shared_ptr<Part> part = getPartByUUID(part_uuid);
-	
-	//TODO: Handle removal of root BP or root Organ
-	if (part == nullptr || part->getId() == "ROOT" || part->getId() == "UPPER_TORSO")
+void Body::removeFromLists(std::vector<int>* indices)
+{
+	std::sort(indices->begin(), indices->end());
+
+	for (auto it = indices->begin(); it != indices->end(); it++)
 	{
-		return;
+		//Only erase the IID if it maps to this Part
+		auto iid = iid_handle_map->find(layout->getId(*it));
+		if (iid != iid_handle_map->end() && (int)iid->second.index == *it) { iid_handle_map->erase(iid); }
 	}
 
-	debug_print("Removing Part %s...\n", part->getId().c_str());
-
-	//Create a list of all parts to be removed 
-	std::vector<string>* rem_list = new std::vector<string>();
+	//The list is in layout order as well, so every run of consecutive removed entries 
+	// is found by a binary search for its first index and erased at once
+	size_t r = 0;
+	while (r < indices->size())
+	{
+		auto first = std::lower_bound(part_gui_list->begin(), part_gui_list->end(), (*indices)[r],
+			[](GuiObjectLink* link, int index) { return (int)PartHandle::fromRaw(link->object_handle).index < index; });
 
-	//Add the part given to the function...
-	rem_list->push_back(part_uuid);
-	//...and everything that lies downstream of it (Organs and Bodyparts)
-	makeDownstreamPartList(part_uuid, rem_list);
+		auto last = first;
+		while (last != part_gui_list->end() && r < indices->size()
+			&& (int)PartHandle::fromRaw((*last)->object_handle).index == (*indices)[r])
+		{
+			delete *last;
+			last++;
+			r++;
+		}
 
-	//Remove duplicates from the list
-	std::sort(rem_list->begin(), rem_list->end());
-	rem_list->erase(std::unique(rem_list->begin(), rem_list->end()), rem_list->end());
+		//The Part was not listed
+		if (last == first)
+		{
+			r++;
+			continue;
+		}
 
-#ifdef _DEBUG
-	for (auto it = rem_list->begin(); it != rem_list->end(); it++)
-	{
-		debug_print("UUID %s is Part %s \n", getPartByUUID(*it)->getUUID().c_str(), getPartByUUID(*it)->getId().c_str());
+		part_list_changes->push_back(GuiListRange((int)(first - part_gui_list->begin()), (int)(last - first)));
+		part_gui_list->erase(first, last);
 	}
-#endif
+}
 
-	//Make a temporary list, in which UUIDs of empty bodyparts are stored.
-	// Its contents are later added to the rem_list
-	std::vector<string>* bp_rem = new std::vector<string>();
+void Body::removePart(PartHandle part_handle, PartRemovalResult* result) {
+	std::vector<PartHandle> part_handles(1, part_handle);
+	removeParts(&part_handles, result);
+}
 
-	//Iterate over all parts to be removed...
-	for (auto it_rl = rem_list->begin(); it_rl != rem_list->end(); it_rl++)
+void Body::makeDownstreamPartList(const std::vector<int>& starts, std::vector<int>* index_list)
+{
+	std::vector<bool> listed(layout->getPartCount(), false);
+
+	//Subtrees still to be listed, given by their first index
+	std::vector<int> open(starts.rbegin(), starts.rend());
+
+	while (!open.empty())
 	{
-		//...if the part is an Organ, remove it from its connectors connected_organs list
-		if (getPartByUUID(*it_rl)->getType() == TYPE_ORGAN)
-		{
-			Organ *o = static_cast<Organ*>(getPartByUUID(*it_rl).get());
-			Organ *con = static_cast<Organ*>(getPartByUUID(o->getConnectorUUID()).get());
+		int start = open.back();
+		open.pop_back();
 
-			con->removeConnectedOrgan(*it_rl);
-		}
+		if (listed[start] || (*part_removed)[start]) { continue; }
 
-		//..for all parts: remove from super part child list.
-		// If the super part is found to be empty (removeChild() returns true), add it
-		// to the temporary bp_rem list. 
-		BodyPart* super = static_cast<BodyPart*>(getPartByUUID(getPartByUUID(*it_rl)->getSuperPartUUID()).get());
-		BodyPart* old_super;
-		if (super->removeChild(*it_rl))
+		//The subtree of a part is a contiguous index range
+		for (int i = start; i < layout->getSubtreeEnd(start); i++)
 		{
-			debug_print("BodyPart %s is empty, add to unregister\n", super->getId().c_str());
-			bp_rem->push_back(super->getUUID());
-			bool done = false;
+			if (listed[i] || (*part_removed)[i]) { continue; }
+
+			listed[i] = true;
+			index_list->push_back(i);
 
-			//For every BodyPart that is to be deleted as empty, remove it from its own
-			// super BodyPart and check wheter it needs to be removed as well!
-			while (!done)
+			//Organs connected to an Organ are downstream of it, wherever they are in the tree
+			for (int c = layout->getFirstConnectee(i); c != BodyLayout::NO_PART; c = layout->getNextConnectee(c))
 			{
-				old_super = super;
-				super = static_cast<BodyPart*>(getPartByUUID(super->getSuperPartUUID()).get());
-				if (super->removeChild(old_super->getUUID()))
-				{
-					debug_print("BodyPart %s is empty, add to unregister\n", super->getId().c_str());
-					bp_rem->push_back(super->getUUID());
-				}
-				else {
-					done = true;
-				}
+				open.push_back(c);
 			}
 		}
 	}
+}
 
-	//Merge the temporary removal list into the rem_list
-	rem_list->insert(rem_list->end(), bp_rem->begin(), bp_rem->end());
+void Body::removeParts(std::vector<PartHandle>* part_handles, PartRemovalResult* result)
+{
+	TRACE_ZONE("Body::removeParts");
+	//Collect the layout indices of the Parts to start from
+	std::vector<int> starts;
 
-	//Remove duplicates again
-	std::sort(rem_list->begin(), rem_list->end());
-	rem_list->erase(std::unique(rem_list->begin(), rem_list->end()), rem_list->end());
+	for (auto it = part_handles->begin(); it != part_handles->end(); it++)
+	{
+		//Parts removed before have stale handles and are skipped
+		boost::shared_ptr<Part> part = getPartByHandle(*it);
 
-	//Unregister the Parts, causing the shared pointers to destroy their references and themselves.
-	unregisterParts(rem_list);
+		//TODO: Handle removal of root BP or root Organ
+		if (part == nullptr || part->getId() == ID_ROOT || part->getId() == ID_UPPER_TORSO) { continue; }
 
-	//Clear the part variable. This should cause the last use of the shared pointer
-	// to the part to be freed, therefore destroying the part.
-	part.reset();
-	
-	//Refresh all lists and maps
-	refreshLists();
+		debug_print("Removing Part %s...\n", part->getId().c_str());
+		starts.push_back(it->index);
+	}
 
-#ifdef _DEBUG
-	printBodyMap("body_mt.gv", root.get());
-#endif
+	if (starts.empty()) { return; }
 
-	debug_print("done.\n");
-	
-}
+	//Create a list of the layout indices of all parts to be removed:
+	// the parts given to the function and everything that lies downstream of them (Organs and Bodyparts)
+	std::vector<int>* rem_list = new std::vector<int>();
+	makeDownstreamPartList(starts, rem_list);
 
-void Body::makeDownstreamPartList(string part_uuid, std::vector<string>* child_list)
-{
-	boost::shared_ptr<Part> part = getPartByUUID(part_uuid);
-	if (part == nullptr)
+	for (auto it = rem_list->begin(); it != rem_list->end(); it++)
 	{
-		return;
+		(*part_removed)[*it] = true;
+		debug_print("UUID %s is Part %s \n", parts->getAt(*it)->getUUID().c_str(), parts->getAt(*it)->getId().c_str());
 	}
 
-	//Part is an Organ: Add all connected organs to the list
-	if (part->getType() == TYPE_ORGAN){
-		Organ* o = static_cast<Organ*>(part.get());
-		for (auto it = o->getConnectedOrgansRW()->begin(); it != o->getConnectedOrgansRW()->end(); it++)
+	size_t marked = rem_list->size();
+
+	//All downstream Parts are marked before any upstream Part is looked at, so every
+	// connector and super part is only checked against the final state of the batch
+	for (size_t r = 0; r < marked; r++)
+	{
+		int index = (*rem_list)[r];
+
+		//If the part is an Organ whose connector remains, the connector becomes a stump
+		int con = layout->getConnector(index);
+		if (con != BodyLayout::NO_PART && !(*part_removed)[con] && !(*part_stump)[con])
 		{
-			child_list->push_back(*it);
-			makeDownstreamPartList(*it, child_list);
+			(*part_stump)[con] = true;
+			if (result != nullptr) { result->stumps.push_back(con); }
 		}
-	}
 
-	//Part is a BodyPart: Add all children to the list and call this function on them
-	if (part->getType() == TYPE_BODYPART)
-	{
-		BodyPart* bp = static_cast<BodyPart*>(part.get());
-		for (auto it = bp->getChildListRW()->begin(); it != bp->getChildListRW()->end(); it++)
+		//If the super part remains, it loses a child. If it is found to be empty, 
+		// it is removed as well and the same applies to its own super part.
+		int super = layout->getParent(index);
+		while (super != BodyLayout::NO_PART && !(*part_removed)[super])
 		{
-			child_list->push_back(*it);
-			makeDownstreamPartList(*it, child_list);
+			if (--(*live_child_count)[super] > 0) { break; }
+
+			debug_print("BodyPart %s is empty, add to unregister\n", parts->getAt(super)->getId().c_str());
+			(*part_removed)[super] = true;
+			rem_list->push_back(super);
+			if (result != nullptr) { result->emptied.push_back(super); }
+
+			super = layout->getParent(super);
 		}
 	}
-}
 
-void Body::removeParts(std::vector<string>* part_uuids)
-{
-	//Copy into new vector, because given vector gets changed by removePart function
-	std::vector<string>* rem_list = new std::vector<string>(part_uuids->begin(), part_uuids->end());
-
-	for (std::vector<string>::iterator it = rem_list->begin(); it != rem_list->end(); it++)
+	//Unregister the Parts, causing the shared pointers to destroy their references and themselves.
+	for (auto it = rem_list->begin(); it != rem_list->end(); it++)
 	{
-		removePart(*it);
+		unregisterPart(parts->getHandleAt(*it));
 	}
 
+	//Erase the removed Parts from the lists and maps (this sorts the list)
+	removeFromLists(rem_list);
+
+	//The super parts of the removed Parts have lost children
+	if (hit_sampler != nullptr) { hit_sampler->partsRemoved(*rem_list); }
+
+	if (result != nullptr) { result->removed.insert(result->removed.end(), rem_list->begin(), rem_list->end()); }
+
 	delete rem_list;
-}
 
-void Body::removeRandomPart() {
-	/*
-	debug_print("Remove Random Part from Body:\n");
+#ifdef _DEBUG
+	printBodyMap("body_mt.gv", root.get());
+#endif
 
-	//choose one randomly from the list
-	Part* random_part = NULL;
-	srand(time(NULL));
-	int stopid = rand() % part_map->size();
-	debug_print("Random element chosen: Nr. %i\n", stopid);
-	int it_count = 0;
+	debug_print("done.\n");
+}
 
-	for (part_map_iterator iterator = part_map->begin(); iterator != part_map->end(); iterator++) {
-		if (it_count == stopid)
-		{
-			random_part = iterator->second;
-			break;
-		}
-		it_count++;
-	}
+HitLocationSampler* Body::getHitSampler()
+{
+	if (hit_sampler == nullptr) { hit_sampler = new HitLocationSampler(this); }
+	return hit_sampler;
+}
+
+void Body::removeRandomPart(PartRemovalResult* result) {
+	debug_print("Remove Random Part from Body:\n");
 
-	if (random_part == NULL)
+	//The Organ hit by a random blow is removed
+	HitLocation hit;
+	if (!getHitSampler()->sample(RandomService::getInstance()->getStream(RANDOM_BODY), &hit))
 	{
-		debug_error("No element %i.\n", stopid);
 		debug_print("Remove Random Part from Body failed.\n");
 		return;
 	}
 
-	debug_print("Chose %s.\n", random_part->getId().c_str());
-	if (random_part->getId() == "ROOT") { return; }
-	removePart(random_part->getUUID());
-	return;
-	*/
+	debug_print("Chose %s.\n", layout->getId(hit.organ).c_str());
+	removePart(parts->getHandleAt(hit.organ), result);
 }
 
-void Body::unregisterPart(string uuid)
+void Body::unregisterPart(PartHandle part)
 {
-	auto it = part_map->find(uuid);
+	boost::shared_ptr<Part> p = getPartByHandle(part);
 
-	if (it == part_map->end())
+	if (p == nullptr)
 	{
-		debug_error("ERROR: No Part with UUID %s could be found for unregister!\n", uuid.c_str());
+		debug_error("ERROR: No Part with handle %u could be found for unregister!\n", part.index);
 		return;
 	}
 	
-	part_map->erase(it);
-}
-
-void Body::unregisterParts(std::vector<string>* uuids)
-{
-	for (auto it = uuids->begin(); it != uuids->end(); it++)
-	{
-		unregisterPart(*it);
-	}
+	uuid_handle_map->erase(p->getUUID());
+	parts->remove(part);
 }
 
 boost::shared_ptr<Part> Body::getPartByUUID(std::string uuid)
 {
-	if (part_map->count(uuid) == 0) 
+	auto it = uuid_handle_map->find(uuid);
+	if (it == uuid_handle_map->end()) 
 	{ 
+		TRACE_COUNT(uuid_miss_counter, 1);
 		debug_error("ERROR: No Part with UUID %s found!\n", uuid.c_str());
 		return nullptr; 
 	}
-	return part_map->at(uuid);
+	return getPartByHandle(it->second);
 }
 
-boost::shared_ptr<Part> Body::getPartByIID(std::string iid)
+boost::shared_ptr<Part> Body::getPartByIID(Symbol iid)
 {
-	if (iid_uuid_map->count(iid) == 0)
+	auto it = iid_handle_map->find(iid);
+	if (it == iid_handle_map->end())
 	{ 
 		debug_error("ERROR: No Part with IID %s found!", iid.c_str());
 		return nullptr;
 	}
-	return getPartByUUID(iid_uuid_map->at(iid));
+	return getPartByHandle(it->second);
 }
 
 
@@ -966,13 +1075,13 @@ void Body::printBodyMap(const char* filename, BodyPart* mroot) {
 	file << "digraph G {" << "\n";
 
 	std::cout << "\nCreating Subgraphs...";
-	createSubgraphs(&file, mroot);
+	createSubgraphs(&file, mroot->getHandle().index);
 	std::cout << "done.\n";
 
 	file << "\n";
 
 	std::cout << "Creating Links...";
-	createLinks(&file, mroot);
+	createLinks(&file, mroot->getHandle().index);
 	std::cout << "done.\n";
 
 	file << "}" << "\n";
@@ -981,21 +1090,20 @@ void Body::printBodyMap(const char* filename, BodyPart* mroot) {
 }
 
 
-void Body::createSubgraphs(std::ofstream* stream, BodyPart* bp) {
+void Body::createSubgraphs(std::ofstream* stream, int index) {
 
-	*stream << "\t" << "subgraph cluster_" << bp->getId() << " {" << "\n";
+	*stream << "\t" << "subgraph cluster_" << parts->getAt(index)->getId() << " {" << "\n";
 
-	*stream << "\t\t" << "label = \"" << bp->getName() << "\";\n";
+	*stream << "\t\t" << "label = \"" << parts->getAt(index)->getName() << "\";\n";
 
-	for (std::vector<string>::iterator iterator = bp->getChildListRW()->begin(); iterator != bp->getChildListRW()->end(); iterator++){
-		boost::shared_ptr<Part> part = getPartByUUID(*iterator);
-		if (part == nullptr) { continue; }
+	for (int c = layout->getFirstChild(index); c != BodyLayout::NO_PART; c = layout->getNextSibling(c)){
+		if ((*part_removed)[c]) { continue; }
 
-		if(part->getType() == TYPE_BODYPART){
-			createSubgraphs(stream, static_cast<BodyPart*>(part.get()));
+		if (layout->getType(c) == TYPE_BODYPART){
+			createSubgraphs(stream, c);
 
-		} else if (part->getType() == TYPE_ORGAN) {
-			Organ* o = static_cast<Organ*>(part.get());
+		} else if (layout->getType(c) == TYPE_ORGAN) {
+			Part* o = parts->getAt(c).get();
 			*stream << "\t\t" << o->getId() << " [label=\"" << o->getName() << "\"];" << "\n";
 
 		}
@@ -1004,18 +1112,14 @@ void Body::createSubgraphs(std::ofstream* stream, BodyPart* bp) {
 	*stream << "\t } \n";
 }
 
-void Body::createLinks(std::ofstream* stream, BodyPart* bp) {
-	for (std::vector<string>::iterator iterator = bp->getChildListRW()->begin(); iterator != bp->getChildListRW()->end(); iterator++){
-		boost::shared_ptr<Part> part = getPartByUUID(*iterator);
-		if (part == nullptr) { continue; }
+void Body::createLinks(std::ofstream* stream, int index) {
+	//All organs downstream of the given BodyPart are in its subtree range
+	for (int i = index; i < layout->getSubtreeEnd(index); i++){
+		if ((*part_removed)[i] || layout->getType(i) != TYPE_ORGAN) { continue; }
 
-		if(part->getType() == TYPE_BODYPART){
-			createLinks(stream, static_cast<BodyPart*>(part.get()));
-		} else if (part->getType() == TYPE_ORGAN) {
-			Organ* o = static_cast<Organ*>(part.get());
-			if (!o->getConnectorId().empty()) {
-				*stream << o->getConnectorId() << " -> " << o->getId() << ";\n";
-			}
+		Organ* o = static_cast<Organ*>(parts->getAt(i).get());
+		if (!o->getConnectorId().empty()) {
+			*stream << o->getConnectorId() << " -> " << o->getId() << ";\n";
 		}
 	}
-}
\ No newline at end of file
+}
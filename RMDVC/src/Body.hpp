@@ -12,8 +12,11 @@
 #include "libtcod.hpp"
 #include "Diagnostics.hpp"
 #include "GUI_structs.hpp"
+#include "Handle.hpp"
+#include "Symbol.hpp"
 
 #include <iostream>
+#include <algorithm>
 #include <string>
 #include <sstream>
 #include <fstream>
@@ -29,6 +32,7 @@
 #include <boost/serialization/shared_ptr.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/map.hpp>
+#include <boost/serialization/split_member.hpp>
 
 using std::string;
 
@@ -41,8 +45,8 @@ using std::string;
  */
 class Tissue{
 private:
-	string id;
-	string name;
+	Symbol id;
+	Symbol name;
 	float pain;
 	float blood_flow;
 	float resistance;
@@ -77,21 +81,22 @@ public:
 	 *
 	 * @return The 'given name' of the tissue.
 	 */
-	string getName() const {
-		return name;
+	const string& getName() const {
+		return name.str();
 	}
 
 	/**Returns the internal id of the tissue (distinct from its name) so special functions
 	 * may be assigned to certain tissues and so that they may be referenced from code.
 	 *
-	 *     if (tissue_hit.getId() == "NERVE"){
+	 *     static const Symbol NERVE = Symbol::intern("NERVE");
+	 *     if (tissue_hit.getId() == NERVE){
 	 *      print("You are wracked with pain!");
 	 *     }
 	 *
 	 * The internal id is also used in the XML file itself, for the organ definitions.
 	 * @return Internal tissue identifier.
 	 */
-	string getId() const {
+	Symbol getId() const {
 		return id;
 	}
 
@@ -134,7 +139,7 @@ public:
 	 * @param resistance How much this tissue absorbs energy.
 	 * @param impairment How much damage to this tissue impairs the Actor.
 	 */
-	Tissue(string id, string name, float pain,
+	Tissue(Symbol id, Symbol name, float pain,
 			float blood_flow, float resistance, float impairment);
 	Tissue(){};
 	~Tissue();
@@ -177,8 +182,8 @@ private:
 public:
 	boost::shared_ptr<Tissue> tissue;
 	float hit_prob;
-	string name;
-	string custom_id;
+	Symbol name;
+	Symbol custom_id;
 };
 
 enum PartType{
@@ -188,11 +193,158 @@ enum PartType{
 
 extern const char* part_type_strings[];
 
+/**The Tissue definitions of a [body-definition XML](xml_help.html), the key being the internal id of the Tissue.
+ */
+typedef std::map<Symbol, boost::shared_ptr<Tissue>> TissueMap;
+
 class Body;
+class HitLocationSampler;
+
+/**The Parts are given by their layout index, as their handles are stale after the removal.
+ * Their ids and names can still be looked up in the layout (see Body::getLayout()).
+ *
+ * @brief A struct reporting what a call of Body::removeParts() has removed.
+ */
+struct PartRemovalResult {
+	/**All removed Parts, in layout order.
+	 */
+	std::vector<int> removed;
+
+	/**The BodyParts (also listed in removed) that were removed because all their children were.
+	 */
+	std::vector<int> emptied;
+
+	/**The remaining Organs that have become stumps.
+	 */
+	std::vector<int> stumps;
+};
+
+/**The structure of a Body (which Part is the child of which BodyPart, which Organ is connected
+ * to which) is fixed once the [body-definition XML](xml_help.html) has been parsed. This class holds
+ * that structure in a "compiled" form: every Part is identified by its index in depth-first order
+ * (which is also the slot index of its handle in the part registry of the Body) and its attributes
+ * are stored in one contiguous array per attribute.
+ *
+ * Because of the depth-first order, the Parts downstream of a BodyPart are exactly the indices
+ * [index, getSubtreeEnd(index)), so subtree traversal is a linear scan and never resolves a handle.
+ * Removing parts does not change the layout; the Body keeps per-instance flags for that.
+ *
+ * @brief The contiguous, structure-of-arrays representation of the part tree of a Body.
+ */
+class BodyLayout{
+private:
+	std::vector<int> parent;
+	std::vector<int> first_child;
+	std::vector<int> next_sibling;
+
+	/**The index one past the last Part downstream of the Part at the same index.
+	 */
+	std::vector<int> subtree_end;
+	std::vector<int> depth;
+
+	std::vector<PartType> type;
+	std::vector<float> surface;
+
+	/**The internal ids and names of the Parts. They belong to the body definition, not to
+	 * an instance, so they are stored (and saved) once per layout instead of once per Part.
+	 */
+	std::vector<Symbol> id;
+	std::vector<Symbol> name;
+
+	/**The tissues of an Organ are the elements [tissue_begin, tissue_end) of the tissues vector.
+	 */
+	std::vector<int> tissue_begin;
+	std::vector<int> tissue_end;
+	std::vector<tissue_def> tissues;
+
+	/**The connector (upstream root) of an Organ and the list of Organs connected
+	 * to it (downstream branches), stored as first_connectee/next_connectee chain.
+	 */
+	std::vector<int> connector;
+	std::vector<int> first_connectee;
+	std::vector<int> next_connectee;
+
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version)
+	{
+		ar & BOOST_SERIALIZATION_NVP(parent);
+		ar & BOOST_SERIALIZATION_NVP(first_child);
+		ar & BOOST_SERIALIZATION_NVP(next_sibling);
+		ar & BOOST_SERIALIZATION_NVP(subtree_end);
+		ar & BOOST_SERIALIZATION_NVP(depth);
+
+		ar & BOOST_SERIALIZATION_NVP(type);
+		ar & BOOST_SERIALIZATION_NVP(surface);
+		ar & BOOST_SERIALIZATION_NVP(id);
+		ar & BOOST_SERIALIZATION_NVP(name);
+
+		ar & BOOST_SERIALIZATION_NVP(tissue_begin);
+		ar & BOOST_SERIALIZATION_NVP(tissue_end);
+		ar & BOOST_SERIALIZATION_NVP(tissues);
+
+		ar & BOOST_SERIALIZATION_NVP(connector);
+		ar & BOOST_SERIALIZATION_NVP(first_connectee);
+		ar & BOOST_SERIALIZATION_NVP(next_connectee);
+	}
+
+public:
+	/**The index used for "no part", e.g. as parent of the root BodyPart.
+	 */
+	static const int NO_PART = -1;
+
+	/**Appends a Part to the layout. Parts must be added in depth-first order, i.e. a
+	 * BodyPart before all of its children.
+	 *
+	 * @param type The type of the Part.
+	 * @param surface The relative surface area of the Part, see Part::getSurface().
+	 * @param parent The index of the BodyPart this Part is a child of, or NO_PART for the root.
+	 * @param id The internal identifier of the Part.
+	 * @param name The name of the Part.
+	 * @return The index of the new Part.
+	 */
+	int addPart(PartType type, float surface, int parent, Symbol id, Symbol name);
+
+	/**Appends the tissue definitions of the Organ at the given index. This must be called
+	 * (at most) once per Organ, directly after addPart().
+	 */
+	void setTissues(int index, const std::vector<tissue_def>& tdefs);
+
+	/**Links the Organ at the given index to its connector (upstream root).
+	 */
+	void setConnector(int index, int connector_index);
+
+	/**Builds the child, sibling and connectee chains and the subtree ranges. This is
+	 * called once after all Parts have been added.
+	 */
+	void compile();
+
+	int getPartCount() const { return (int)parent.size(); }
+
+	int getParent(int index) const { return parent[index]; }
+	int getFirstChild(int index) const { return first_child[index]; }
+	int getNextSibling(int index) const { return next_sibling[index]; }
+	int getSubtreeEnd(int index) const { return subtree_end[index]; }
+	int getDepth(int index) const { return depth[index]; }
+
+	PartType getType(int index) const { return type[index]; }
+	float getSurface(int index) const { return surface[index]; }
+
+	Symbol getId(int index) const { return id[index]; }
+	Symbol getName(int index) const { return name[index]; }
+
+	int getTissueBegin(int index) const { return tissue_begin[index]; }
+	int getTissueEnd(int index) const { return tissue_end[index]; }
+	const tissue_def& getTissue(int tissue_index) const { return tissues[tissue_index]; }
+
+	int getConnector(int index) const { return connector[index]; }
+	int getFirstConnectee(int index) const { return first_connectee[index]; }
+	int getNextConnectee(int index) const { return next_connectee[index]; }
+};
 
 /**BodyPart and Organ are derived from this class. In itself it holds
- * the Name, the internal ID and the relative surface of a part as well as a pointer
- * to the node of the organ tree that it is a child of.
+ * the handle of the part and the Body it belongs to; the name, the internal ID, the relative
+ * surface and the position in the part tree are read from the BodyLayout of the Body.
  *
  * @brief Base class for all parts that make up a body.
  */
@@ -204,61 +356,38 @@ private:
 	{
 		ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(Object);
 
-		ar & BOOST_SERIALIZATION_NVP(id);
-		ar & BOOST_SERIALIZATION_NVP(name);
+		ar & BOOST_SERIALIZATION_NVP(handle);
 
 		ar & BOOST_SERIALIZATION_NVP(body);
 
-		ar & BOOST_SERIALIZATION_NVP(surface);
-
 		ar & BOOST_SERIALIZATION_NVP(type);
-		ar & BOOST_SERIALIZATION_NVP(super);
 	}
 
 protected:
 
-	/** This _internal ID_ is different from the UUID that this and every other instance of
-	* a class that derives from Object posesses. It is used to refer to _specific parts_ of the
-	* Body object that is created during runtime by parsing the body-definition XML.
-	*
-	* Example (internal ID is "LEFT_HAND"):
-	*     if (part_hit.getId() == "LEFT_HAND"){
-	*      print("Your hand is hit and you drop your weapon!");
-	*     }
-	*
-	* The same sort of reference can neither be made by name, because several parts may share a name;
-	* nor by UUID, because it is generated during runtime and different every time the body-definition XML
-	* is parsed into a Body object.
-	*/
-	string id;
-
 	/** A pointer to the Body instance this Part is... well, a part of.
 	*
 	*/
 	Body* body;
+
+	/** The handle under which this Part is registered in its Body. It is assigned
+	* by Body::registerPart(). Its index is also the index of the Part in the BodyLayout
+	* of the Body, which holds the structural data (surface, parent, children, ...) of the Part.
+	*/
+	PartHandle handle;
 	
-	string name;
-	float surface;
 	PartType type;
 
-	/**This is the UUID of the node of the organ tree that this Part is a child of.
-	 * It is NULL for the root element.
-	 */
-	string super;
-
 	/**This function is only called by Part's child classes BodyPart and Organ to
 	 * assign the base variables.
 	 *
-	 * @param id The internal part identifier.
-	 * @param name The name of the part.
-	 * @param surface The surface area of the part. See getSurface().
 	 * @param type The type of part, i.e. Organ or BodyPart. See PartType enum.
 	 * @param b The body this Part is part of.
 	 */
-	Part(string id, string name, float surface, PartType type, Body* b);
+	Part(PartType type, Body* b);
 
 public:
-	string toString() { return name; }
+	string toString() { return getName(); }
 
 	/**Surface Area in RMD's body definition XML is not absolute.
 	 * It represents the percentage of the total surface of the BodyPart _one level
@@ -284,31 +413,29 @@ public:
 	 * @brief Returns the relative surface area.
 	 * @return The relative surface area, as defined in the [body-definition XML](xml_help.html).
 	 */
-	float getSurface() const {
-		return surface;
-	}
+	float getSurface() const;
 
 	/**The name of the Part is what is reported to the player when he inspects a body.
 	 * It is distinct from its internal id returned by getId().
 	 *
 	 * @return The 'given name' of the part.
 	 */
-	string getName() const {
-		return name;
-	}
+	const string& getName() const;
 
 	/**Returns the internal id of the part (distinct from its name) so special functions
 	 * may be assigned to certain parts and so that they may be referenced from code.
 	 *
-	 *     if (part_hit.getId() == "LEFT_HAND"){
+	 *     static const Symbol LEFT_HAND = Symbol::intern("LEFT_HAND");
+	 *     if (part_hit.getId() == LEFT_HAND){
 	 *      print("Your hand is hit and you drop your weapon!");
 	 *     }
 	 *
+	 * The internal id is different from the UUID that every instance of a class deriving from Object
+	 * posesses: it is the same for the same part of every Body parsed from the same body-definition XML.
+	 *
 	 * @return Internal part identifier.
 	 */
-	string getId() const {
-		return id;
-	}
+	Symbol getId() const;
 
 	/**Returns the type of this part. This is necessary to distinguish Organs from BodyParts
 	 * when only a Part* is given.
@@ -319,21 +446,32 @@ public:
 		return type;
 	}
 
-	/**Sets the given Part (BodyPart) as the node that this Part is a child of.
-	 *
+	/**Returns the handle under which this Part is registered in its Body.
 	 */
-	void setSuperPart(string bp_uuid) {
-		super = bp_uuid;
+	PartHandle getHandle() const {
+		return handle;
 	}
 
-	/**Returns the UUID of the node that this Part is a child of.
+	void setHandle(PartHandle handle) {
+		this->handle = handle;
+	}
+
+	/**Binds a copy of a Part to the given Body and gives it a UUID of its own.
+	 * This is used by the copy constructor of Body when a Body is instantiated from a prototype.
 	 *
-	 * @return The UUID of a BodyPart.
+	 * @param b The body the copied Part is now part of.
 	 */
-	std::string getSuperPartUUID() const {
-		return super;
+	void rebind(Body* b) {
+		body = b;
+		renewUUID();
 	}
 
+	/**Returns the handle of the node that this Part is a child of.
+	 *
+	 * @return The handle of a BodyPart, or an invalid handle for the root BodyPart.
+	 */
+	PartHandle getSuperPart() const;
+
 	virtual void testFunction() {
 		return;
 	};
@@ -346,116 +484,67 @@ public:
  * and "below" the BodyPart objects.
  * _This definition of 'Organ' is very much different from the common meaning of 'Organ', as in
  * internal organs such as the stomach or liver._
- * Instances of this class contain an array of tissue definitions, a reference to the
- * organ to which this one is connected (upstream root) and a list of references to the organs
- * which are connected to this one (downstream branches).
+ * The tissue definitions of an organ, the organ to which it is connected (upstream root) and
+ * the organs which are connected to it (downstream branches) are stored in the BodyLayout
+ * of the Body; an instance of this class is a view onto that data.
  *
  * @brief A class that represents the 'leaves' of the Body tree.
  */
 class Organ: public Part{
 private:
-	tissue_def *tissues;
-	int tissue_count;
-
-	string connector_id;
-	string connector_uuid; //The upstream root
-
-	bool root; //Is it root?
-
-	std::vector<string>* connected_organs; //The downstream branches
-
-	bool is_stump = false; //When Organs downstream are removed, the Organ is marked as stump
-
-	/**
-	* @brief Links this organ to its local root.
-	* @param connector_uuid The UUID of the connector.
-	*/
-	void linkToConnector(string connector_uuid);
-
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive & ar, const unsigned int version)
 	{
 		ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(Part);
-
-		ar & BOOST_SERIALIZATION_NVP(tissues);
-		ar & BOOST_SERIALIZATION_NVP(tissue_count);
-
-		ar & BOOST_SERIALIZATION_NVP(connector_id);
-		ar & BOOST_SERIALIZATION_NVP(connector_uuid);
-
-		ar & BOOST_SERIALIZATION_NVP(root);
-
-		ar & BOOST_SERIALIZATION_NVP(connected_organs);
-		ar & BOOST_SERIALIZATION_NVP(is_stump);
 	}
 
 public:
-	/**Creates a new instance of the organ class.
+	/**Creates a new instance of the organ class. Its id, name and connector are
+	 * set in the BodyLayout when the organ is registered and linked by the Body.
 	 *
-	 * @param id The organ's unique internal identifier.
-	 * @param name The name of the organ.
-	 * @param surface The relative surface area of the organ, see Part.
 	 * @param b The body this Organ is part of.
-	 * @param tissues A pointer to the first element of the tissue_def array.
-	 * @param tissue_count The number of elements in the array pointed at by tissues.
-	 * @param connector_id The internal id of the connector organ, later used when the organ map
-	 * is available. See linkToConnector(std::map<std::string, Organ*> *organ_map).
-	 * @param is_root Whether or not this is the root element, which is the only organ
-	 * without a connector.
 	 */
-	Organ(string id, string name, float surface, Body* b,
-			tissue_def *tissues, int tissue_count, const char *connector_id,
-			bool is_root=false);
+	Organ(Body* b);
 	Organ(){};
 
-	/**The destructor handles deregistering with the BodyPart that this Organ is a child of,
-	 * as well as the destruction of all downstream organs connected to this one.
-	 */
 	~Organ();
 
 	/**
-	* @brief Returns the UUID of the upstream root organ.
+	* @brief Returns the handle of the upstream root organ, or an invalid handle for the root organ.
 	*/
-	string getConnectorUUID(){
-		return connector_uuid;
-	};
+	PartHandle getConnector() const;
 
 	/**
-	* @brief Returns the internal ID of the upstream root organ.
+	* @brief Returns the internal ID of the upstream root organ, or "_ROOT" for the root organ.
 	*/
-	string getConnectorId(){
-		return connector_id;
-	};
+	Symbol getConnectorId() const;
 
 	/**
-	* @brief Returns a new vector containing all connected organs.
+	* @brief Returns a new vector containing the handles of all (remaining) connected organs.
 	*/
-	std::vector<string>* getConnectedOrgans();
+	std::vector<PartHandle>* getConnectedOrgans() const;
+
+	/**When Organs downstream of this one are removed, the Organ is marked as stump.
+	 */
+	bool isStump() const;
 
 	/**
-	* @brief Returns the pointer to the connected_organs vector;
+	* @brief Returns the number of tissue definitions of this organ.
 	*/
-	std::vector<string>* getConnectedOrgansRW() { return connected_organs; }
+	int getTissueCount() const;
 
-	/**If this organ is removed/destroyed, all branches are also removed.
-	 *
-	 * @brief Called by the branch organs to register with their root.
-	 * @param connectee The branch connecting to this organ.
-	 */
-	void addConnectedOrgan(string connectee_uuid);
-	void removeConnectedOrgan(string uuid);
-
-	bool isStump() { return is_stump; }
+	/**
+	* @brief Returns the tissue definition with the given index (0 to getTissueCount()-1).
+	*/
+	const tissue_def& getTissue(int i) const;
 
 	/**Whether or not this is the root element, which is the only organ
 	 * without a connector.
 	 *
 	 * @return true, if the Organ is the root; false otherwise.
 	 */
-	bool isRoot() const {
-		return root;
-	}
+	bool isRoot() const;
 };
 
 /**This class represents the upper level of the body definition. Every BodyPart connects upstream
@@ -463,72 +552,59 @@ public:
  * or more Organ objects. _It cannot hold both BodyPart and Organ children, because Organs represent the
  * 'leaves' of the body tree. (No branches grow from leaves, right?)_
  *
- * Instances of this class contain a vector of the UUIDs of Part objects, which are the Organs or BodyParts
- * connected to this one.
+ * The children of a BodyPart are stored in the BodyLayout of the Body.
  *
  *@brief A class representing a part of a body (such as 'Left Arm').
  */
 class BodyPart: public Part{
 private:
-	std::vector<string>* children;
-
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive & ar, const unsigned int version)
 	{
 		ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(Part);
-
-		ar & BOOST_SERIALIZATION_NVP(children);
 	}
 
 public:
-	/**@brief Adds a Part to the BodyPart's list of children.
-	 * @param child A shared pointer to the Part object to add.
-	 * @param body The body this BodyPart and the child are part of. This reference
-	 *  is necessary to ensure the childs super reference is set to a shared_ptr of this bodypart.
+	/**@brief Returns a pointer to a new vector containing all the handles 
+	 * of the (remaining) children of this BodyPart.
 	 */
-	void addChild(string child_uuid);
-
-	/**@brief Adds several Parts to the BodyPart's list of children.
-	 * @param child_array A pointer to the pointer pointing to the first of the Part objects to add.
-	 * @param count The count of objects to add.
-	 */
-	void addChildren(std::vector<string>* child_uuid_vector);
-
-	/**@brief Returns a pointer to a new vector containing all the UUIDs 
-	 * of the children of this BodyPart.
-	 */
-	std::vector<string>* getChildList();
-
-	/**@brief Returns the pointer to the children vector.
-	*/
-	std::vector<string>* getChildListRW() { return children; }
-
-	/**@brief Removes a child object from the body part. If the child to be
-	 * destroyed is the last one, this function will destroy the BodyPart itself.
-	 *
-	 * @param uuid The UUID of the object to remove.
-	 * @return Whether the removal has succeeded.
-	 */
-	bool removeChild(string uuid);
+	std::vector<PartHandle>* getChildList() const;
 
 	/**Creates a new instance of the BodyPart class. See Part() constructor.
 	 *
-	 * @param id The internal part identifier.
-	 * @param name The name of the part.
-	 * @param surface The surface area of the part. See getSurface().
 	 * @param b The body this BodyPart is part of.
 	 */
-	BodyPart(string id, string name, float surface, Body* b);
+	BodyPart(Body* b);
 	BodyPart(){};
 	~BodyPart();
 };
 
+/**The rows are the entries of the part_gui_list of the Body, which are not copied; the changes
+ * are the ranges the Body has erased from it (see Body::takePartListChanges()).
+ *
+ * @brief The part list of a Body as a GuiListDataSource, see GuiBodyViewer.
+ */
+class BodyPartListSource : public GuiListDataSource
+{
+private:
+	Body* body;
+
+public:
+	int getRowCount() const;
+	const GuiObjectLink* getRow(int index) const;
+	void takeChanges(std::vector<GuiListRange>* changes);
+
+	BodyPartListSource(Body* body) : body(body) {};
+};
+
 /**This class represents the uppermost level of the body definition. It holds several maps that
  * are necessary for code handling of Actor bodies, the two most important being the
- * part_map and the tissue_map, which hold shared pointers to every Part and Tissue element that
- * the Body is "composed" of. The shared pointers are shared with the Parts themselves (e.g., the 
- * child vector of the BodyParts holds some of the shared pointers (namely those pointing to it's children)).
+ * part registry and the tissue_map, which hold shared pointers to every Part and Tissue element that
+ * the Body is "composed" of. Parts refer to each other by their PartHandle, which the registry
+ * resolves in O(1); the UUIDs of the Parts are only used for persistence and debugging. The structure
+ * of the part tree is held in a BodyLayout, which is indexed by the slot index of the handles, and
+ * per-part flags of this instance (removed, stump), so traversals never go through the registry.
  * This means that the Body instance is effectively "managing" the Parts and Tissues that it is
  * composed of. It also contains functions related to damage handling, loading and
  * saving of body definitions.
@@ -546,60 +622,129 @@ private:
 	const TCODColor part_gui_list_color_organ = TCODColor::darkRed;
 
 	/**This map holds a list of all Tissue elements that are defined in the [body-definition XML](xml_help.html)
-	* that was used to create this Body instance. The key is the UUID, the value a shared pointer
-	* to the Tissue instance. This shared pointer is shared, for example, by the Organs in the part_map,
-	* who hold a list of shared pointers to the Tissue elements that they are "composed" of.
+	* that was used to create this Body instance. The key is the internal id, the value a shared pointer
+	* to the Tissue instance. This shared pointer is shared, for example, by the tissue definitions in the layout,
+	* which link the Organs to the Tissue elements that they are "composed" of.
+	*
+	* The map itself is shared by all Bodies instantiated from the same prototype, so it is
+	* saved only once per archive, like the layout.
 	*/
-	std::map<std::string, boost::shared_ptr<Tissue>>* tissue_map;
+	boost::shared_ptr<TissueMap> tissue_map;
+
+	/**This registry holds all Parts (BodyParts and Organs) of a body, resolving the
+	 * handle of a Part to a shared pointer to it. Parts are registered in the order in which
+	 * they are parsed, which is the depth-first order of the body tree.
+	 */
+	SlotMap<Part, boost::shared_ptr<Part>>* parts;
 
-	/**This map holds a list of all Parts (BodyParts and Organs) of a body, the key
-	 * being the UUID, and the value a shared pointer to the Part.
+	/**The compiled structure of the part tree. The layout is not changed by removing
+	 * parts, which is tracked by the per-part vectors below instead.
 	 */
-	std::map<std::string, boost::shared_ptr<Part>>* part_map;
+	boost::shared_ptr<BodyLayout> layout;
+
+	/**Per-part state of this Body, indexed like the layout.
+	 * part_removed: Whether the Part has been removed.
+	 * part_stump: Whether an Organ has lost some of its connected organs.
+	 * live_child_count: The number of children of a BodyPart that have not been removed.
+	 */
+	std::vector<bool>* part_removed;
+	std::vector<bool>* part_stump;
+	std::vector<int>* live_child_count;
+
+	/**This map holds the UUIDs of all Parts of a body and their handles. It is only used
+	* to resolve UUIDs (e.g. from debug output or saved data), never on a hot path.
+	*/
+	std::map<std::string, PartHandle>* uuid_handle_map;
 
-	/**This map holds a list of all UUID's and all internal id's of all Parts (BodyParts and Organs)
-	* of a body. The key is the internal id, the value the UUID. 
+	/**This map holds a list of all internal id's of all Parts (BodyParts and Organs)
+	* of a body and their handles. The key is the internal id, the value the handle. 
 	*
-	* Because the parts are internally stored in the part_map map, whose values are pointers to
-	* the part objects and whose keys are the UUIDs of the parts, this map is needed to access
-	* parts by their internal id as defined the body-definition XML.
+	* This map is needed to access parts by their internal id as defined the body-definition XML.
 	*/
-	std::map<std::string, std::string>* iid_uuid_map;
+	std::map<Symbol, PartHandle>* iid_handle_map;
 
 	/**This list holds all Parts (BodyParts and Organs) of a body in a GuiObjectLink format.
-	* The UUID stored is that of the part, the ColoredText is formatted to represent the "depth"
+	* The handle stored is that of the part, the ColoredText is formatted to represent the "depth"
 	* of the part within the body structure. (See GuiBodyViewer class for "usage")
+	*
+	* The entries are in layout order. When Parts are removed, their entries are erased from the
+	* list (which owns them) and the erased ranges are logged in part_list_changes.
 	*/
 	std::vector<GuiObjectLink*>* part_gui_list;
 
+	/**The ranges erased from the part_gui_list since the changes were last taken by takePartListChanges().
+	*/
+	std::vector<GuiListRange>* part_list_changes;
+
+	/**The part_gui_list as a data source for GUI lists, which read it without copying it.
+	*/
+	BodyPartListSource* part_list_source;
+
+	/**The sampler drawing hit locations on this Body, created on first use by getHitSampler().
+	* Its tables are derived from the layout and the removed parts, so it is neither copied nor saved.
+	*/
+	HitLocationSampler* hit_sampler;
+
 	friend class boost::serialization::access;
 	template<class Archive>
-	void serialize(Archive & ar, const unsigned int version)
+	void save(Archive & ar, const unsigned int version) const
 	{
-		ar & BOOST_SERIALIZATION_NVP(root);
+		ar << BOOST_SERIALIZATION_NVP(root);
+
+		//The tissue map and the layout are shared by all Bodies of the same
+		// template, the archive stores them once and links the other Bodies to them
+		ar << BOOST_SERIALIZATION_NVP(tissue_map);
+		ar << BOOST_SERIALIZATION_NVP(parts);
+		ar << BOOST_SERIALIZATION_NVP(layout);
+		ar << BOOST_SERIALIZATION_NVP(part_removed);
+		ar << BOOST_SERIALIZATION_NVP(part_stump);
+		ar << BOOST_SERIALIZATION_NVP(live_child_count);
+	}
 
-		ar & BOOST_SERIALIZATION_NVP(tissue_map);
-		ar & BOOST_SERIALIZATION_NVP(part_map);
-		ar & BOOST_SERIALIZATION_NVP(iid_uuid_map);
-		ar & BOOST_SERIALIZATION_NVP(part_gui_list);
+	template<class Archive>
+	void load(Archive & ar, const unsigned int version)
+	{
+		ar >> BOOST_SERIALIZATION_NVP(root);
+
+		ar >> BOOST_SERIALIZATION_NVP(tissue_map);
+		ar >> BOOST_SERIALIZATION_NVP(parts);
+		ar >> BOOST_SERIALIZATION_NVP(layout);
+		ar >> BOOST_SERIALIZATION_NVP(part_removed);
+		ar >> BOOST_SERIALIZATION_NVP(part_stump);
+		ar >> BOOST_SERIALIZATION_NVP(live_child_count);
+
+		//The id maps and the GUI list are not stored, they are derived from the parts
+		uuid_handle_map = new std::map<std::string, PartHandle>();
+		iid_handle_map = new std::map<Symbol, PartHandle>();
+		part_gui_list = new std::vector<GuiObjectLink*>();
+		part_list_changes = new std::vector<GuiListRange>();
+		part_list_source = new BodyPartListSource(this);
+		hit_sampler = nullptr;
+
+		makeUUIDMap();
+		refreshLists();
 	}
 
+	BOOST_SERIALIZATION_SPLIT_MEMBER();
+
 	/**This function loads and parses a [body-definition XML](xml_help.html).
-	 * The library used for this is RapidXML.
-	 * __The file must be null-terminated!__
+	 * The library used for this is RapidXML. The file is read into one null-terminated buffer and
+	 * parsed non-destructively, so the parser never rewrites it. Errors are reported (with their
+	 * line in the file) as bdef_parse_error and logged.
 	 *
-	 * @param filename The _null-terminated_ file to load.
-	 * @return Returns the UUID of the root bodypart.
+	 * @param filename The file to load.
+	 * @return Returns the handle of the root bodypart, or an invalid handle if the file could not be parsed.
 	 */
-	string loadBody(const char *filename);
+	PartHandle loadBody(const char *filename);
 
 	/**This is the function that is recursively called on all nodes of the body
 	 * definition XML. The node it is pointed at _must_ be a '<body_part>' node.
-	 * The function will create the BodyPart that is defined in that node and return its UUID.
+	 * The function will create the BodyPart that is defined in that node, append it
+	 * to the layout and return its handle.
 	 *
 	 * If the node contains organ definitions, the function creates the Organ objects,
 	 * and adds an "link note" into a temporary map, which is used in the loadBody() function to
-	 * link the newly created Parts together.
+	 * link the Organs to their connectors.
 	 *
 	 * If the node contains further '<body_part>' nodes, the function calls itself on all
 	 * of them.
@@ -607,59 +752,84 @@ private:
 	 * Please refer to the [body-definition XML help](xml_help.html)
 	 * or the source code for more information on the Body XML Parsing.
 	 * @param node The '<body_part>' XML node to parse.
-	 * @param child_map A map of Parts to be linked as parent <-> child, the child UUID being the key
-	 *  and the parent UUID being the value.
-	 * @param organ_map A map of Organs to be linked as connector <-> connectee, the connectee UUID being the key
-	 *  and the connector UUID being the value.
-	 * @return The UUID of the BodyPart that is defined by node.
+	 * @param parent The layout index of the BodyPart the new BodyPart is a child of (BodyLayout::NO_PART for the root).
+	 * @param organ_map A map of Organs to be linked as connector <-> connectee, the connectee handle being the key
+	 *  and the connector IID being the value.
+	 * @param text The text of the whole file, to find the line of a node that causes an error.
+	 * @return The handle of the BodyPart that is defined by node.
 	 */
-	string enter(rapidxml::xml_node<> *node, std::map<string, string>* child_map, std::map<string, string>* organ_link_map);
+	PartHandle enter(rapidxml::xml_node<> *node, int parent, std::map<PartHandle, Symbol>* organ_link_map, const char* text);
+
+	/**This function registers the given Part in the part registry and the UUID map,
+	* appends it to the layout and assigns its handle.
+	*
+	* @param part A shared pointer to the Part to register.
+	* @param surface The relative surface area of the Part.
+	* @param parent The layout index of the BodyPart the Part is a child of.
+	* @param id The internal identifier of the Part.
+	* @param name The name of the Part.
+	* @return The handle of the Part.
+	*/
+	PartHandle registerPart(boost::shared_ptr<Part> part, float surface, int parent, Symbol id, Symbol name);
+
+	/**This function (re)initializes the per-part state vectors from the layout, i.e.
+	* marks all parts as present and no organ as stump.
+	*/
+	void resetPartState();
 
-	/**This function iterates through the given Part map and creates a map whose keys are the internal
-	* id's and whose values are the UUID (the iid_uuid_map !) and refreshes iid_uuid_map.
+	/**This function iterates through the part registry and creates a map whose keys are the internal
+	* id's and whose values are the handles (the iid_handle_map !) and refreshes iid_handle_map.
 	*/
 	void makeIdMap();
 
-	/**This function recursively builds a list of GuiObjectLink for all Parts of the Body - 
-	* it links the UUID of the Part to a ColoredText containing the name of the Part. 
+	/**This function iterates through the part registry and fills the uuid_handle_map.
+	*/
+	void makeUUIDMap();
+
+	/**This function builds a list of GuiObjectLink for all remaining Parts of the Body in
+	* depth-first order - it links the handle of the Part to a ColoredText containing the name of the Part,
+	* indented according to its depth in the layout.
 	* The text is colored corresponding to part_gui_list_color_bodypart or part_gui_list_color_organ.
 	* 
 	* @param list The vector to modify.
-	* @param p The Part to start from.
-	* @param depth This should be 0 on first call and is increased by the recursive calling of this function
-	*  to correcly indent the texts.
 	*/
-	void buildPartList(std::vector<GuiObjectLink*>* list, Part* p, int depth=0);
+	void buildPartList(std::vector<GuiObjectLink*>* list);
 
-	/**This function calls makeIdMap() and buildPartList(...) to refresh the iid_uuid_map and
-	* the part_gui_list to match the part_map.
+	/**This function calls makeIdMap() and buildPartList(...) to rebuild the iid_handle_map and
+	* the part_gui_list from the part registry. The old entries of the list are deleted and the
+	* logged changes are dropped, as the whole list is new.
 	*/
 	void refreshLists();
 
-	/**This function removes an element from the part_map, identified by the given UUID.
-	* Due to the nature of the part_map (storing shared_pointers accessible by the UUID of the
+	/**This function erases the given (just removed) Parts from the iid_handle_map and their entries
+	* from the part_gui_list, logging every run of consecutive erased entries in part_list_changes.
+	* The rest of the list is not rebuilt.
+	*
+	* @param indices The layout indices of the removed Parts. The vector is sorted by this function.
+	*/
+	void removeFromLists(std::vector<int>* indices);
+
+	/**This function removes an element from the part registry, identified by the given handle.
+	* Due to the nature of the registry (storing shared_pointers accessible by the handle of the
 	* Part they point at), removal of the element will cause the destruction of the shared_pointer
 	* (because it should not be referenced anywhere else) and therefore, the Part it points at.
 	*
-	* @param uuid The UUID of the Part to unregister.
+	* @param part The handle of the Part to unregister.
 	*/
-	void unregisterPart(string uuid);
-	void unregisterParts(std::vector<string>* uuids);
+	void unregisterPart(PartHandle part);
 
-	/**This function iterates recursively through all Parts downstream of the given Part
-	* and adds - for Organs - all connected_organs, - for BodyParts - all children to the
-	* given vector. The first call to this function should therefore modify the vector to 
-	* contain all children of all parts downstream of the given Part, identified by the given UUID.
-	* Note that this function will not check for duplicates.
+	/**This function lists the given Parts and all remaining Parts downstream of them: the
+	* subtree range of every listed Part and, for Organs, the organs connected to it (and everything
+	* downstream of those). Every Part is listed only once, even if it is downstream of several of the given Parts.
 	* 
-	* @param part_uuid The UUID of the Part to list the children and children's children of.
-	* @param child_list A vector, which will be modified by this function to contain all children
-	*  and children's children (...) of the given Part.
+	* @param starts The layout indices of the Parts to start from.
+	* @param index_list A vector, which will be modified by this function to contain the layout indices
+	*  of the Parts and all Parts downstream of them.
 	*/
-	void makeDownstreamPartList(std::string part_uuid, std::vector<string>* child_list);
+	void makeDownstreamPartList(const std::vector<int>& starts, std::vector<int>* index_list);
 	
-	void createSubgraphs(std::ofstream* stream, BodyPart* bp);
-	void createLinks(std::ofstream* stream, BodyPart* bp);
+	void createSubgraphs(std::ofstream* stream, int index);
+	void createLinks(std::ofstream* stream, int index);
 
 public:
 	/**This function creates a new instance of the Body class and loads and parses the body definition
@@ -667,6 +837,14 @@ public:
 	 * @param filename The path to the [body-definition XML](xml_help.html).
 	 */
 	Body(const char *filename);
+
+	/**This function creates a new instance of the Body class as a copy of the given (prototype) Body.
+	 * The layout and the Tissue definitions are shared with the prototype, the Parts and the per-part
+	 * state are copied, with new UUIDs for the Parts. This is much cheaper than parsing the
+	 * [body-definition XML](xml_help.html) again; see BodyTemplateRegistry.
+	 * @param prototype The Body to copy.
+	 */
+	Body(const Body& prototype);
 	Body(){};
 	~Body();
 
@@ -675,34 +853,91 @@ public:
 	*/
 	boost::shared_ptr<BodyPart> getRootBP()
 	{
-		if (root != nullptr) { return root; }
+		return root;
 	};
 
-	/**This function removes the a Part of the Body, identified by the given UUID.
+	/**This function removes the a Part of the Body, identified by the given handle.
 	 * It also handles removal of all Parts downstream of that Part and removal of 
-	 * now-empty Parts upstream of it.
+	 * now-empty Parts upstream of it. See removeParts().
 	 *
-	 * @param part_uuid The UUID of the Part to remove.
+	 * @param part The handle of the Part to remove.
+	 * @param result If not the nullptr, the removed Parts are added to it.
 	 */
-	void removePart(std::string part_uuid);
+	void removePart(PartHandle part, PartRemovalResult* result = nullptr);
 
-	/**This function removes several parts one after another. For that purpose, it
-	 * calls removePart() on all elements of the given vector of UUIDs.
+	/**This function removes several Parts (and everything downstream of them) at once. The union of
+	 * the affected subtrees and the now-empty Parts upstream of them is determined in one pass, so
+	 * Parts shared by several subtrees are only handled once, and the lists and maps are updated once.
+	 * Stale handles (e.g. of Parts removed before) are skipped.
 	 *
-	 * @param part_uuids A vector of UUIDs to remove.
+	 * @param part_handles A vector of handles to remove.
+	 * @param result If not the nullptr, the removed Parts are added to it.
+	 */
+	void removeParts(std::vector<PartHandle>* part_handles, PartRemovalResult* result = nullptr);
+
+	/**This function returns the sampler drawing hit locations on this Body, creating it on first use.
 	 */
-	void removeParts(std::vector<string>* part_uuids);
+	HitLocationSampler* getHitSampler();
 
-	/**This function removes a random Part of the Body.
+	/**This function removes a random Organ of the Body, drawn like the location of a hit
+	 * (see HitLocationSampler), with all Parts downstream of it.
+	 *
+	 * @param result If not the nullptr, receives what has been removed (see removeParts()).
 	 */
-	void removeRandomPart();
+	void removeRandomPart(PartRemovalResult* result = nullptr);
+
+	/**This function returns the compiled layout of the part tree.
+	*/
+	const BodyLayout* getLayout() const { return layout.get(); }
+
+	/**This function returns the handle of the Part at the given layout index, or an
+	* invalid handle if the index is BodyLayout::NO_PART or the Part has been removed.
+	*/
+	PartHandle getHandleAt(int index) const
+	{
+		if (index == BodyLayout::NO_PART || (*part_removed)[index]) { return PartHandle(); }
+		return parts->getHandleAt(index);
+	}
+
+	/**Returns whether the Part at the given layout index has been removed.
+	*/
+	bool isRemovedAt(int index) const { return (*part_removed)[index]; }
+
+	/**Returns whether the Organ at the given layout index is a stump.
+	*/
+	bool isStumpAt(int index) const { return (*part_stump)[index]; }
 
 	/**This function returns the part_gui_list.
 	*/
 	std::vector<GuiObjectLink*>* getPartGUIList() { return part_gui_list; }
 
+	/**This function returns the part_gui_list as a data source for GUI lists (see GuiListChooser::setDataSource()).
+	*/
+	GuiListDataSource* getPartListSource() { return part_list_source; }
+
+	/**This function moves the ranges erased from the part_gui_list since the last call into the given
+	* vector (which is cleared beforehand), so a copy of the list can be updated by erasing the same ranges in order.
+	*/
+	void takePartListChanges(std::vector<GuiListRange>* changes)
+	{
+		changes->clear();
+		changes->swap(*part_list_changes);
+	}
+
+	/**This function returns a shared pointer to the Part identified by the given handle,
+	* or a nullptr if the handle is stale (i.e. the Part has been removed).
+	*
+	* @param part The handle of the Part to get.
+	* @return A shared pointer to the Part, or a nullptr.
+	*/
+	boost::shared_ptr<Part> getPartByHandle(PartHandle part) const
+	{
+		return parts->lookup(part);
+	}
+
 	/**This function returns a shared pointer to the Part identified by the given UUID,
-	* or a nullptr if the Part could not be found.
+	* or a nullptr if the Part could not be found. It is meant for persistence and debugging,
+	* code handling Parts should use getPartByHandle().
 	*
 	* @param uuid The UUID of the Part to get.
 	* @return A shared pointer to the Part, or a nullptr.
@@ -711,21 +946,40 @@ public:
 	/**This function returns a shared pointer to the Part identified by the given IID,
 	* or a nullptr if the Part could not be found.
 	*
-	* @param uuid The IID of the Part to get.
+	* @param iid The IID of the Part to get.
 	* @return A shared pointer to the Part, or a nullptr.
 	*/
-	boost::shared_ptr<Part> getPartByIID(std::string iid);
+	boost::shared_ptr<Part> getPartByIID(Symbol iid);
+
+	/**Looks up the Part by the text of its IID, e.g. as typed by the player or read from a file.
+	*/
+	boost::shared_ptr<Part> getPartByIID(const std::string& iid) { return getPartByIID(Symbol::find(iid)); }
 
 	void printBodyMap(const char* filename, BodyPart* mroot);
 
 };
 
 /**An exception that is thrown by the functions loading and parsing the [body-definition XML](xml_help.html).
+ * The message contains the line of the file the error was found in.
  */
 class bdef_parse_error:public std::runtime_error
 {
+private:
+	int line;
+
 public:
-	bdef_parse_error(const std::string& msg, rapidxml::xml_node<>* node);
+	/**@param msg The description of the error.
+	 * @param line The line of the file (starting at 1).
+	 */
+	bdef_parse_error(const std::string& msg, int line);
+
+	/**@param msg The description of the error.
+	 * @param node The node the error was found in, whose name and value are added to the message.
+	 * @param text The text of the whole file, which the node points into (the file is parsed non-destructively).
+	 */
+	bdef_parse_error(const std::string& msg, rapidxml::xml_node<>* node, const char* text);
+
+	int getLine() const { return line; }
 };
 
 
@@ -0,0 +1,70 @@
+#include "BodyTemplateRegistry.hpp"
+#include "Trace.hpp"
+
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock template_clock;
+
+/** The time parsing a body definition and instantiating a Body take, in nanoseconds.
+*/
+static TraceHistogram parse_histogram("body template parse ns");
+static TraceHistogram instantiate_histogram("body instantiate ns");
+
+BodyTemplateRegistry::BodyTemplateRegistry()
+{
+	prototypes = new std::map<std::string, Body*>();
+}
+
+BodyTemplateRegistry::~BodyTemplateRegistry()
+{
+	for (auto it = prototypes->begin(); it != prototypes->end(); it++)
+	{
+		delete it->second;
+	}
+
+	delete prototypes;
+}
+
+const Body* BodyTemplateRegistry::getPrototype(const std::string& filename)
+{
+	auto it = prototypes->find(filename);
+	if (it != prototypes->end()) { return it->second; }
+
+	template_clock::time_point start = template_clock::now();
+	Body* prototype = new Body(filename.c_str());
+	std::chrono::duration<double> elapsed = template_clock::now() - start;
+
+	stats.parse_count++;
+	stats.parse_seconds += elapsed.count();
+	parse_histogram.record((unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+	if (prototype->getRootBP() == nullptr)
+	{
+		debug_error("ERROR: Body definition %s could not be parsed, no prototype created!\n", filename.c_str());
+		delete prototype;
+		return nullptr;
+	}
+
+	debug_print("Parsed body definition %s in %f ms.\n", filename.c_str(), elapsed.count() * 1000.0);
+
+	prototypes->insert(std::pair<std::string, Body*>(filename, prototype));
+	return prototype;
+}
+
+Body* BodyTemplateRegistry::instantiate(const std::string& filename)
+{
+	TRACE_ZONE("BodyTemplateRegistry::instantiate");
+
+	const Body* prototype = getPrototype(filename);
+	if (prototype == nullptr) { return nullptr; }
+
+	template_clock::time_point start = template_clock::now();
+	Body* body = new Body(*prototype);
+	std::chrono::duration<double> elapsed = template_clock::now() - start;
+
+	stats.instantiate_count++;
+	stats.instantiate_seconds += elapsed.count();
+	instantiate_histogram.record((unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+	return body;
+}
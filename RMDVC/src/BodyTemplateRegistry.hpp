@@ -0,0 +1,72 @@
+#ifndef BODYTEMPLATEREGISTRY_HPP
+#define BODYTEMPLATEREGISTRY_HPP
+
+#include "Body.hpp"
+
+#include <map>
+#include <string>
+
+/**@brief Timing statistics of a BodyTemplateRegistry.
+*/
+struct BodyTemplateStats
+{
+	/**The number of body-definition XML files parsed and the total time spent parsing them.
+	*/
+	unsigned int parse_count;
+	double parse_seconds;
+
+	/**The number of Bodies instantiated from prototypes and the total time spent doing so.
+	*/
+	unsigned int instantiate_count;
+	double instantiate_seconds;
+
+	BodyTemplateStats() : parse_count(0), parse_seconds(0.0), instantiate_count(0), instantiate_seconds(0.0) {};
+};
+
+/**Parsing a [body-definition XML](xml_help.html) reads the file, runs the XML parser and builds
+* the Tissue definitions and the layout of the part tree. The registry does this only once per file
+* and keeps the resulting Body as an (unmodified) prototype. New Bodies are copies of the prototype,
+* which share the Tissue definitions and the layout and only copy the per-instance state.
+*
+* @brief A cache of parsed body definitions from which Bodies are instantiated.
+*/
+class BodyTemplateRegistry
+{
+private:
+	/**The prototypes, by the filename of the body-definition XML they were parsed from.
+	*/
+	std::map<std::string, Body*>* prototypes;
+
+	BodyTemplateStats stats;
+
+public:
+	/**Returns the prototype Body for the given body-definition XML, parsing the file if
+	* it has not been parsed yet.
+	*
+	* @param filename The path to the [body-definition XML](xml_help.html).
+	* @return The prototype, or the nullptr if the file could not be parsed.
+	*/
+	const Body* getPrototype(const std::string& filename);
+
+	/**Creates a new Body from the given body-definition XML by copying its prototype.
+	* The caller takes ownership of the Body.
+	*
+	* @param filename The path to the [body-definition XML](xml_help.html).
+	* @return The new Body, or the nullptr if the file could not be parsed.
+	*/
+	Body* instantiate(const std::string& filename);
+
+	/**@brief Returns whether a prototype for the given file has been parsed.
+	*/
+	bool isLoaded(const std::string& filename) const { return prototypes->find(filename) != prototypes->end(); }
+
+	/**The timings are also recorded in the histograms "body template parse ns" and
+	* "body instantiate ns", which are listed by Trace::writeMetrics().
+	*/
+	const BodyTemplateStats& getStats() const { return stats; }
+
+	BodyTemplateRegistry();
+	~BodyTemplateRegistry();
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "ChaseMap.hpp"
+#include "Map.hpp"
+#include "Trace.hpp"
+
+ChaseMap::ChaseMap(int max_distance) : max_distance(max_distance), side(2 * max_distance + 1), origin_x(0), origin_y(0),
+	target_x(-1), target_y(-1), map_version(0), map(nullptr), current_stamp(0), compute_count(0)
+{
+	distance.assign(side * side, UNREACHED);
+	stamp.assign(side * side, 0);
+}
+
+bool ChaseMap::isCurrent(const Map* map, int target_x, int target_y) const
+{
+	return this->map == map && this->target_x == target_x && this->target_y == target_y
+		&& map_version == map->getWalkableVersion();
+}
+
+bool ChaseMap::update(const Map* map, int target_x, int target_y)
+{
+	if (isCurrent(map, target_x, target_y)) { return false; }
+
+	this->map = map;
+	this->target_x = target_x;
+	this->target_y = target_y;
+	map_version = map->getWalkableVersion();
+
+	compute();
+	return true;
+}
+
+void ChaseMap::compute()
+{
+	TRACE_ZONE("ChaseMap::compute");
+
+	static const int dir_x[] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+	static const int dir_y[] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+	compute_count++;
+
+	//A new stamp invalidates all distances of the last computation at once
+	current_stamp++;
+	if (current_stamp == 0)
+	{
+		stamp.assign(side * side, 0);
+		current_stamp = 1;
+	}
+
+	origin_x = target_x - max_distance;
+	origin_y = target_y - max_distance;
+
+	if (target_x < 0 || target_y < 0 || target_x >= map->width || target_y >= map->height) { return; }
+
+	queue.clear();
+
+	//Cells are indexed within the square, which the search never leaves
+	int start = max_distance + max_distance * side;
+	distance[start] = 0;
+	stamp[start] = current_stamp;
+	queue.push_back(start);
+
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		int cell = queue[head];
+		int d = distance[cell];
+		if (d >= max_distance) { continue; }
+
+		int x = cell % side;
+		int y = cell / side;
+
+		for (int dir = 0; dir < 8; dir++)
+		{
+			int nx = x + dir_x[dir];
+			int ny = y + dir_y[dir];
+			if (map->isWall(origin_x + nx, origin_y + ny)) { continue; } //Also true outside of the map
+
+			int n = nx + ny * side;
+			if (stamp[n] == current_stamp) { continue; }
+
+			distance[n] = d + 1;
+			stamp[n] = current_stamp;
+			queue.push_back(n);
+		}
+	}
+}
+
+bool ChaseMap::getStepToward(int x, int y, const ActorMap* actors, int* d_x, int* d_y) const
+{
+	int best = getDistance(x, y);
+	bool found = false;
+
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			if (dx == 0 && dy == 0) { continue; }
+
+			int d = getDistance(x + dx, y + dy);
+			if (d >= best) { continue; }
+
+			//Don't step into other actors (which would only fail), unless it is the target
+			if (actors != nullptr && d > 0 && actors->getActorAt(x + dx, y + dy) != nullptr) { continue; }
+
+			best = d;
+			*d_x = dx;
+			*d_y = dy;
+			found = true;
+		}
+	}
+
+	return found;
+}
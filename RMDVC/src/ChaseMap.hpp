@@ -0,0 +1,97 @@
+#ifndef CHASEMAP_HPP
+#define CHASEMAP_HPP
+
+#include <vector>
+
+class Map;
+class ActorMap;
+
+/** The chase map holds, for every cell of the Map, the number of steps (in 8 directions, walls
+* blocking) to a target cell, so every Actor chasing that target only has to step to the neighbouring
+* cell with the lowest distance instead of searching a path of its own.
+*
+* The field is only recomputed by update() when the target has moved or the walls of the Map have
+* changed, and the breadth-first search stops at max_distance, so a recomputation only touches the cells
+* around the target. Only the square of cells within max_distance of the target is stored, so the
+* field does not grow with the Map. Cells are stamped with the number of the computation that reached
+* them, so the field never has to be cleared as a whole.
+*
+* @brief A distance field toward a target cell (the player), shared by all Actors chasing it.
+*/
+class ChaseMap
+{
+private:
+	int max_distance;
+
+	/** The side length of the stored square and the map position of its top left cell.
+	*/
+	int side;
+	int origin_x, origin_y;
+
+	int target_x, target_y;
+
+	/** The walkability version of the Map the field was computed for, see Map::getWalkableVersion().
+	*/
+	unsigned int map_version;
+	const Map* map;
+
+	/** The distance of every cell of the square, only valid where stamp equals current_stamp.
+	*/
+	std::vector<int> distance;
+	std::vector<unsigned int> stamp;
+	unsigned int current_stamp;
+
+	/** The queue of the breadth-first search, kept to avoid reallocation.
+	*/
+	std::vector<int> queue;
+
+	unsigned long long compute_count;
+
+	void compute();
+
+public:
+	/** The distance of cells that are not reachable within max_distance.
+	*/
+	static const int UNREACHED = 0x7FFFFFFF;
+
+	/** Recomputes the field if the target has moved, the Map is another one or the walls
+	* of the Map have changed since the last computation.
+	*
+	* @return true if the field was recomputed.
+	*/
+	bool update(const Map* map, int target_x, int target_y);
+
+	/** @brief Returns whether the field is the one update() would compute for the given Map and target.
+	*/
+	bool isCurrent(const Map* map, int target_x, int target_y) const;
+
+	/** @brief Returns the number of steps from the given cell to the target, or UNREACHED.
+	*/
+	int getDistance(int x, int y) const
+	{
+		x -= origin_x;
+		y -= origin_y;
+		if (x < 0 || y < 0 || x >= side || y >= side) { return UNREACHED; }
+
+		int i = x + y * side;
+		return stamp[i] == current_stamp ? distance[i] : UNREACHED;
+	}
+
+	/** Finds the neighbouring cell of the given cell that is closest to the target.
+	*
+	* @param actors If given, cells occupied by an Actor are skipped (except for the target itself).
+	* @param d_x, d_y Set to the direction of the step.
+	* @return false if no (free) neighbour is closer to the target than the given cell.
+	*/
+	bool getStepToward(int x, int y, const ActorMap* actors, int* d_x, int* d_y) const;
+
+	int getMaxDistance() const { return max_distance; }
+
+	unsigned long long getComputeCount() const { return compute_count; }
+
+	/** @param max_distance The distance at which the search stops.
+	*/
+	ChaseMap(int max_distance = 32);
+};
+
+#endif
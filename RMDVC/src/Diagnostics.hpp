@@ -8,17 +8,20 @@
 #ifndef DIAGNOSTICS_HPP_
 #define DIAGNOSTICS_HPP_
 
+#include "Trace.hpp"
+
 #ifdef _DEBUG
 #define DEBUG_FLAG 1
 #else
 #define DEBUG_FLAG 0
 #endif
 
-#define debug_error(fmt, ...) \
-	do { if (DEBUG_FLAG) fprintf(stderr, "%s:%d:%s(): " fmt, __FILE__, \
-			__LINE__, __FUNCTION__, ##__VA_ARGS__); } while (0)
+/* Diagnostics are recorded in the trace (see Trace) instead of being printed: debug_print() at
+ * TRACE_LEVEL_DEBUG, debug_error() at TRACE_LEVEL_ERROR, with the function and line they come from.
+ * Only errors are printed right away, unless Trace::setEchoLevel() says otherwise.
+ */
+#define debug_error(fmt, ...) TRACE_MESSAGE(TRACE_LEVEL_ERROR, fmt, ##__VA_ARGS__)
 
-#define debug_print(fmt, ...) \
-            do { if (DEBUG_FLAG) fprintf(stdout, fmt, ##__VA_ARGS__); } while (0)
+#define debug_print(fmt, ...) TRACE_MESSAGE(TRACE_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
 
 #endif /* DIAGNOSTICS_HPP_ */
@@ -4,63 +4,132 @@
 #include "Action.hpp"
 #include "GUI.hpp"
 #include "Body.hpp"
+#include "BodyTemplateRegistry.hpp"
 #include "Destructible.hpp"
 #include "Ai.hpp"
+#include "Input.hpp"
+#include "ChaseMap.hpp"
+#include "SaveGame.hpp"
+#include "WorkerPool.hpp"
+#include "Journal.hpp"
+#include "Trace.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <thread>
+
+/** The time every frame takes to render, in nanoseconds.
+*/
+static TraceHistogram render_histogram("render frame ns");
+
+static TraceCounter speculative_chase_hits("speculative chase map hits");
+
+/** The number of Actors whose Ais speculate in one step of speculate(), which keeps every step short
+* enough for idle() to notice a key soon.
+*/
+static const int SPECULATION_BATCH = 64;
+
+/** The steps of the player (see PlayerAi) the speculative chase maps are computed for.
+*/
+static const int player_step_x[] = { 0, 0, -1, 1 };
+static const int player_step_y[] = { -1, 1, 0, 0 };
+static const int PLAYER_STEP_COUNT = 4;
+
+Engine::Engine() : Engine(EngineConfig()) {
+}
 
-#include <boost/serialization/export.hpp>
-
-BOOST_CLASS_EXPORT_GUID(BodyPart, "BodyPart")
-BOOST_CLASS_EXPORT_GUID(Organ, "Organ")
-BOOST_CLASS_EXPORT_GUID(PlayerAi, "PlayerAi")
-BOOST_CLASS_EXPORT_GUID(MeleeAi, "MeleeAi")
-BOOST_CLASS_EXPORT_GUID(MoveAction, "MoveAction")
-BOOST_CLASS_EXPORT_GUID(IdleAction, "IdleAction")
+Engine::Engine(const EngineConfig& config) {
+	Trace::setThreadName("main");
+	trace_path = config.trace_path;
+	if (!trace_path.empty()) { Trace::setEnabled(true); }
 
-Engine::Engine() {
-    TCODConsole::initRoot(120,80,"libtcod C++ tutorial",false);
-	gameConsole = new TCODConsole(120, 70);
+	//Everything random is drawn from streams derived from the seed, which is logged so the game can be repeated
+	RandomService::getInstance()->setSeed(config.seed);
+	debug_print("Random seed: %u\n", RandomService::getInstance()->getSeed());
 
-	TCODConsole::root->print(1, 1, "Press 'n' for new game, Press 'l' to load...");
-	TCODConsole::root->flush();
-
-	TCOD_key_t key;
-	TCODSystem::waitForEvent(TCOD_EVENT_KEY_PRESS, &key, nullptr, true);
+	headless = config.headless;
+	input = config.input != nullptr ? config.input : new KeyboardInput();
 
 	gui = new Gui();
+	body_templates = new BodyTemplateRegistry();
+	chase_map = new ChaseMap();
+	speculative_chase_maps = new std::vector<ChaseMap*>();
+	for (int i = 0; i < PLAYER_STEP_COUNT; i++) { speculative_chase_maps->push_back(new ChaseMap()); }
+	speculation_actors = new std::vector<Actor*>();
+	resetSpeculation();
+	has_pending_key = false;
+	frame_duration = config.frame_rate > 0 ?
+		std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::seconds(1)) / config.frame_rate :
+		std::chrono::high_resolution_clock::duration::zero();
+	next_frame = std::chrono::high_resolution_clock::now();
+	ai_pool = new WorkerPool(config.ai_threads);
+	ai_fov_maps.assign(ai_pool->getWorkerCount(), nullptr);
+	acted = new std::vector<ActorHandle>();
+	deciding = new std::vector<Actor*>();
+	intents = new std::vector<ActionIntent>();
+	view_x = 0;
+	view_y = 0;
+	autosave = nullptr;
+	actors = nullptr;
 
+	TCOD_key_t key;
 
-	if (key.c == 'n')
+	if (headless)
 	{
-		actors = new ActorMap();
-		map = new Map(120, 70);
-		scheduler = new ActionScheduler();
+		//There is no window to ask, start a new game on a map of the configured size
+		gameConsole = new TCODConsole(std::min(config.view_width, config.map_width), std::min(config.view_height, config.map_height));
+		newGame(config.map_width, config.map_height, config.map_width / 2, config.map_height / 2);
+	}
+	else
+	{
+		TCODConsole::initRoot(120,80,"libtcod C++ tutorial",false);
+		gameConsole = new TCODConsole(config.view_width, config.view_height);
 
-		player = new Actor(40, 25, '@', TCODColor::white, 200);
+		TCODConsole::root->print(1, 1, "Press 'n' for new game, Press 'l' to load, Press 'c' to continue the autosave...");
+		TCODConsole::root->flush();
 
-		player->destructible = new Destructible(100);
-		player->destructible->body = new Body("Body.xml");
-		player->ai = new PlayerAi();
+		key = input->nextKey();
+
+		if (key.c == 'n')
+		{
+			newGame(120, 70, 40, 25);
 
-		actors->addActor(player);
+			player->destructible = new Destructible(100);
+			player->destructible->body = body_templates->instantiate("Body.xml");
+			if (player->destructible->body == nullptr)
+			{
+				debug_error("ERROR: The player has no body, as Body.xml could not be parsed.\n");
+			}
 
-		Actor* mob = new Actor(60, 13, '@', TCODColor::yellow, 100);
-		mob->ai = new MeleeAi();
-		mob->ai->update(mob, this, TCODConsole::checkForKeypress());
+			spawnMeleeActor(60, 13);
+		}
 
-		actors->addActor(mob);
+		if (key.c == 'l' || key.c == 'c')
+		{
+			//The game saved with 's' and the autosave are loaded separately, as either may be the one
+			// the player wants to go back to. save.xml is a save in the XML format of the current version,
+			// e.g. converted by hand, and is only read if there is no binary save
+			SaveGameData data;
+			bool loaded = key.c == 'c' ? Autosave::load(config.autosave_path, &data) :
+				loadGame("save.bin", SaveFormat::BINARY, &data) || loadGame("save.xml", SaveFormat::XML, &data);
+
+			if (loaded)
+			{
+				actors = data.actors;
+				map = data.map;
+				scheduler = data.scheduler;
+				player = data.player;
+				RandomService::getInstance()->setState(data.random);
+			}
+		}
 	}
 
-	if (key.c == 'l')
+	//From here on, every change to the game state is journaled; the first turn takes a full snapshot
+	if (config.autosave_interval > 0 && actors != nullptr)
 	{
-		std::ifstream ifs("save.xml");
-		boost::archive::xml_iarchive ia(ifs);
-		ia & BOOST_SERIALIZATION_NVP(actors);
-		ia & BOOST_SERIALIZATION_NVP(map);
-		ia & BOOST_SERIALIZATION_NVP(scheduler);
-		ia & BOOST_SERIALIZATION_NVP(player);
-		ifs.close();
-
-		actors->addActor(player);
+		autosave = new Autosave(config.autosave_path, config.autosave_interval);
+		actors->setJournal(autosave->getJournal());
+		scheduler->setJournal(autosave->getJournal());
 	}
 
 	guiBodyViewer = new GuiBodyViewer("BodyViewer", 3, 3, 80, 40,
@@ -74,23 +143,130 @@ Engine::Engine() {
 
 }
 
+void Engine::newGame(int width, int height, int player_x, int player_y)
+{
+	map = new Map(width, height);
+	actors = new ActorMap(map->width, map->height);
+	actors->setDirtyMap(map);
+	scheduler = new ActionScheduler();
+
+	player = new Actor(player_x, player_y, '@', TCODColor::white, 200);
+	player->ai = new PlayerAi();
+
+	actors->addActor(player);
+}
+
+Actor* Engine::spawnMeleeActor(int x, int y)
+{
+	if (map->isWall(x, y) || actors->getActorAt(x, y) != nullptr) { return nullptr; }
+
+	Actor* mob = new Actor(x, y, '@', TCODColor::yellow, 100);
+	mob->ai = new MeleeAi();
+
+	actors->addActor(mob);
+	mob->ai->update(mob, this, makeKey(TCODK_NONE));
+
+	//New Actors are not journaled
+	if (autosave != nullptr) { autosave->requestSnapshot(); }
+
+	return mob;
+}
+
 void createBasicUI(Gui gui)
 {
 
 }
 
 Engine::~Engine() {
+	//Writes the turns still queued before the state goes away
+	delete autosave;
 	delete actors;
     delete map;
+	delete body_templates;
+	delete input;
+	delete chase_map;
+	for (auto it = speculative_chase_maps->begin(); it != speculative_chase_maps->end(); it++) { delete *it; }
+	delete speculative_chase_maps;
+	delete speculation_actors;
+	delete ai_pool;
+	for (auto it = ai_fov_maps.begin(); it != ai_fov_maps.end(); it++) { delete *it; }
+	delete acted;
+	delete deciding;
+	delete intents;
+
+	//All other threads have ended, so the trace is complete
+	if (!trace_path.empty() && !Trace::write(trace_path.c_str()))
+	{
+		debug_error("ERROR while writing the trace to %s\n", trace_path.c_str());
+	}
+}
+
+Body* Engine::getPlayerBody() const
+{
+	if (player->destructible == nullptr) { return nullptr; }
+	return player->destructible->body;
+}
+
+void Engine::getSaveData(SaveGameData* data) const
+{
+	data->actors = actors;
+	data->map = map;
+	data->scheduler = scheduler;
+	data->player = player;
+	data->random = RandomService::getInstance()->getState();
+}
+
+const ChaseMap* Engine::getPlayerChaseMap()
+{
+	int x = player->getPosX();
+	int y = player->getPosY();
+
+	//If the player went to a cell a chase map has been speculatively computed for, that one is used
+	if (!chase_map->isCurrent(map, x, y))
+	{
+		for (auto it = speculative_chase_maps->begin(); it != speculative_chase_maps->end(); it++)
+		{
+			if (!(*it)->isCurrent(map, x, y)) { continue; }
+
+			std::swap(chase_map, *it);
+			TRACE_COUNT(speculative_chase_hits, 1);
+			break;
+		}
+	}
+
+	chase_map->update(map, x, y);
+	return chase_map;
+}
+
+unsigned long long Engine::getChaseMapComputeCount() const
+{
+	unsigned long long count = chase_map->getComputeCount();
+	for (auto it = speculative_chase_maps->begin(); it != speculative_chase_maps->end(); it++)
+	{
+		count += (*it)->getComputeCount();
+	}
+	return count;
 }
 
 void Engine::update() {
 	TCOD_key_t key;
-	TCODSystem::waitForEvent(TCOD_EVENT_KEY_PRESS, &key,NULL, NULL);
+	if (has_pending_key)
+	{
+		key = pending_key;
+		has_pending_key = false;
+	}
+	else if (!input->pollKey(&key)) { return; }
 
 	//No key pressed = nothing to do!
 	if (key.vk == TCODK_NONE) { return; }
 
+	TRACE_ZONE("Engine::update");
+
+	stats.turns++;
+
+	//Whatever has been speculated on is checked against the state after this turn when it is used
+	resetSpeculation();
+
 	if (state == GameState::GUI) {
 		//On Escape, exit the GUI state
 		// tell the Gui object to inactivate all ActiveGuiElements
@@ -109,26 +285,32 @@ void Engine::update() {
 			case TCODK_CHAR:
         		switch (key.c) {
         			case 'k':
-        				player->destructible->body->removeRandomPart();
+					{
+						Body* body = getPlayerBody();
+						if (body == nullptr) { break; }
+
+						PartRemovalResult removal;
+						body->removeRandomPart(&removal);
+						if (autosave != nullptr) { autosave->getJournal()->recordPartRemoval(player, removal); }
 						//sampleTextBox->setText("OH GOD, WHY!?");
+					}
         			break;
 					case 'l':
+						if (getPlayerBody() == nullptr) { break; }
+
 						state = GameState::GUI;
-						guiBodyViewer->activate(player->destructible->body);
-						gui->makeActive(guiBodyViewer->getUUID());
+						guiBodyViewer->activate(getPlayerBody());
+						gui->makeActive(guiBodyViewer->getHandle());
 					break;
 					case 's':
-
+					{
 						debug_print("Saving...");
-						std::ofstream ofs("save.xml");
-						boost::archive::xml_oarchive oa(ofs);
-						oa << BOOST_SERIALIZATION_NVP(actors);
-						oa << BOOST_SERIALIZATION_NVP(map);
-						oa << BOOST_SERIALIZATION_NVP(scheduler);
-						oa << BOOST_SERIALIZATION_NVP(player);
-						
-						ofs.close();
-						debug_print("done.\n");
+						SaveGameData data;
+						getSaveData(&data);
+
+						if (saveGame("save.bin", SaveFormat::BINARY, data)) { debug_print("done.\n"); }
+					}
+					break;
         		}
         		break;
 			default: //Any key that has not been overridden by the above
@@ -136,55 +318,282 @@ void Engine::update() {
 				break;
 		}
 		
+		typedef std::chrono::high_resolution_clock phase_clock;
+		phase_clock::time_point t0, t1, t2;
+
 		//Try to update player (if no applicable key is pressed, no action will be scheduled,
 		// and action loop is not entered.
-		actors->updateActor(player->getUUID(), this, key);
+		t0 = phase_clock::now();
+		actors->updateActor(player->getHandle(), this, key);
+		stats.ai_seconds += std::chrono::duration<double>(phase_clock::now() - t0).count();
 
-		//Perform actions until players turn
+		//Perform actions until players turn. The actions due at the same time form a time slice:
+		// all of them are executed, then the Ais of the Actors who acted decide together.
+		// Every Actor has one action queued, so it acts at most once per slice.
 
 		Action* nextAction = nullptr;
 		while (scheduler->isPlayerActionScheduled())
 		{
-			nextAction = scheduler->nextAction();
-			assert(nextAction != nullptr); //If queue is empty, fail (queue must not be empty while state == GAME)
+			double slice_time = scheduler->getNextActionTime();
+			acted->clear();
+			Trace::counter("scheduler queue", (long long)scheduler->getQueueSize());
+
+			//The slice ends with the action of the player, so the player sees its outcome first
+			while (scheduler->isPlayerActionScheduled() && scheduler->getNextActionTime() == slice_time)
+			{
+				t0 = phase_clock::now();
+				nextAction = scheduler->nextAction();
+				assert(nextAction != nullptr); //If queue is empty, fail (queue must not be empty while state == GAME)
+
+				//TODO: Add alternative action handling
+				t1 = phase_clock::now();
+				ActionResult res = nextAction->execute();
+				t2 = phase_clock::now();
+
+				//The player is updated in the main update loop instead
+				if (res.getActor() != player->getHandle())
+					acted->push_back(res.getActor());
+
+				stats.actions++;
+				stats.scheduling_seconds += std::chrono::duration<double>(t1 - t0).count();
+				stats.execute_seconds += std::chrono::duration<double>(t2 - t1).count();
+
+				debug_print("Performed %s for Actor UUID %s, result: %s \n",
+					ActionTypeNames[nextAction->getActionType()],
+					actors->getActor(res.getActor())->getUUID().c_str(),
+					res.wasSuccessful() ? "true" : "false");
+
+				delete nextAction;
+			}
+
+			//Let the Ais of the actors who just acted schedule their new actions.
+			//key variable is ignored unless used for debug purposes.
+			t0 = phase_clock::now();
+			decideActions(key);
+			stats.ai_seconds += std::chrono::duration<double>(phase_clock::now() - t0).count();
+		};
 
-			//TODO: Add alternative action handling
-			const ActionResult* res = nextAction->execute();
+		if (autosave != nullptr)
+		{
+			t0 = phase_clock::now();
+			SaveGameData data;
+			getSaveData(&data);
+			autosave->endTurn(data);
+			stats.autosave_seconds += std::chrono::duration<double>(phase_clock::now() - t0).count();
+		}
+	}
 
-			//Call the Ai of the actor who just acted (and let it schedule a new action),
-			// unless it is the player, whose update is handled in the main update loop.
-			//key variable is ignored unless used for debug purposes.
-			if (res->getActorUUID() != player->getUUID())
-				actors->updateActor(res->getActorUUID(), this, key);
+}
+
+void Engine::decideActions(TCOD_key_t key)
+{
+	if (acted->empty()) { return; }
 
-			debug_print("Performed %s for Actor UUID %s, result: %s \n",
-				ActionTypeNames[nextAction->getActionType()],
-				res->getActorUUID().c_str(),
-				res->wasSuccessful() ? "true" : "false");
+	TRACE_ZONE("Engine::decideActions");
 
-			delete nextAction;
-		};
+	//Everything the Ais read but do not own is brought up to date on the main thread
+	deciding->clear();
+	for (auto it = acted->begin(); it != acted->end(); it++)
+	{
+		Actor* actor = actors->getActor(*it);
+		bool decides = actor != nullptr && actor->ai != nullptr && actor->ai->prepare(actor, this);
+		deciding->push_back(decides ? actor : nullptr);
+	}
+
+	intents->assign(deciding->size(), ActionIntent());
+
+	//Every Ai writes its own intent (and field of view) only, so the order in which
+	// the workers take them does not matter
+	ai_pool->run((int)deciding->size(), [this](int item, int worker) {
+		Actor* actor = (*deciding)[item];
+		if (actor != nullptr) { actor->ai->decide(actor, this, &ai_fov_maps[worker], &(*intents)[item]); }
+	});
+
+	//The actions are scheduled in the order the Actors have acted in, which is also where
+	// the Ais that do not take part in the decision phase are updated
+	for (size_t i = 0; i < acted->size(); i++)
+	{
+		Actor* actor = (*deciding)[i];
+		if (actor != nullptr)
+		{
+			actor->ai->commit(actor, this, (*intents)[i]);
+			stats.decisions++;
+		}
+		else
+		{
+			actors->updateActor((*acted)[i], this, key);
+		}
+	}
+
+	stats.decision_phases++;
+}
+
+void Engine::resetSpeculation()
+{
+	speculated_chase_maps = 0;
+	speculation_actors->clear();
+	speculated_actors = 0;
+	speculation_done = false;
+}
+
+bool Engine::speculate()
+{
+	if (speculation_done || state != GameState::GAME || actors == nullptr) { return false; }
+
+	TRACE_ZONE("Engine::speculate");
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	if (speculated_chase_maps < PLAYER_STEP_COUNT)
+	{
+		//The chase maps read the map, which may page in chunks, so they are computed on this thread
+		int x = player->getPosX() + player_step_x[speculated_chase_maps];
+		int y = player->getPosY() + player_step_y[speculated_chase_maps];
+		if (!map->isWall(x, y)) { (*speculative_chase_maps)[speculated_chase_maps]->update(map, x, y); }
+
+		speculated_chase_maps++;
+	}
+	else
+	{
+		//Nothing can add or remove Actors until the next update(), which starts the speculation over
+		if (speculated_actors == 0 && speculation_actors->empty()) { actors->getActors(speculation_actors); }
+
+		size_t end = std::min(speculation_actors->size(), speculated_actors + SPECULATION_BATCH);
+		deciding->clear();
+		for (; speculated_actors < end; speculated_actors++)
+		{
+			Actor* actor = (*speculation_actors)[speculated_actors];
+			if (actor->ai != nullptr && actor->ai->prepareSpeculation(actor, this)) { deciding->push_back(actor); }
+		}
+
+		ai_pool->run((int)deciding->size(), [this](int item, int worker) {
+			Actor* actor = (*deciding)[item];
+			actor->ai->speculate(actor, this, &ai_fov_maps[worker]);
+		});
+
+		speculation_done = speculated_actors >= speculation_actors->size();
+	}
+
+	stats.speculations++;
+	stats.speculation_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+void Engine::idle()
+{
+	typedef std::chrono::high_resolution_clock idle_clock;
+	if (frame_duration == idle_clock::duration::zero()) { return; }
+
+	TRACE_ZONE("Engine::idle");
+
+	//Frames follow each other at a steady cadence; a late frame does not make the next ones hurry
+	idle_clock::time_point now = idle_clock::now();
+	next_frame = std::max(next_frame + frame_duration, now);
+
+	while (now < next_frame)
+	{
+		//A key is processed right away, the cadence starts over from its frame
+		if (input->pollKey(&pending_key) && pending_key.vk != TCODK_NONE)
+		{
+			has_pending_key = true;
+			next_frame = now;
+			return;
+		}
+
+		if (!speculate())
+		{
+			std::this_thread::sleep_for(std::min<idle_clock::duration>(next_frame - now, std::chrono::milliseconds(1)));
+		}
+
+		now = idle_clock::now();
 	}
+}
+
+void Engine::updateView()
+{
+	int x = std::max(0, std::min(player->getPosX() - gameConsole->getWidth() / 2, map->width - gameConsole->getWidth()));
+	int y = std::max(0, std::min(player->getPosY() - gameConsole->getHeight() / 2, map->height - gameConsole->getHeight()));
 
+	if (x == view_x && y == view_y) { return; }
+
+	view_x = x;
+	view_y = y;
+	map->markAllDirty();
 }
 
 /** This function performs the rendering.
   * Actors and the map are rendered on gameConsole, UI is rendered on uiConsole,
   * and then both are blitted onto the root console.
   *
+  * Only the cells the map has marked dirty (tile changes, actors entering or leaving
+  * a cell) are redrawn and blitted, unless a full redraw has been requested. The Gui is told
+  * which cells have been painted over, so it only blits the containers on top of them again;
+  * once it hides a container, everything is redrawn.
+  *
   * @brief Rendering function.
   */
 void Engine::render() {
-	
-	TCODConsole::root->clear();
-	gameConsole->clear();
+	TRACE_ZONE_HISTOGRAM("Engine::render", render_histogram);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	updateView();
+	if (gui->takeExposed()) { map->markAllDirty(); }
+
+	int redrawn;
+
+	if (map->needsFullRedraw())
+	{
+		gameConsole->clear();
+
+		// draw the map
+		map->render(gameConsole, view_x, view_y);
+		// draw the actors
+		actors->render(gameConsole, view_x, view_y);
+
+		//Without a root console, rendering stops at the offscreen gameConsole
+		if (!headless)
+		{
+			TCODConsole::root->clear();
+			TCODConsole::blit(gameConsole, 0, 0, 0, 0, TCODConsole::root, 0, 0);
+			gui->invalidateAll();
+		}
+
+		redrawn = gameConsole->getWidth() * gameConsole->getHeight();
+	}
+	else
+	{
+		const std::vector<int>& cells = map->getDirtyCells();
+		redrawn = 0;
+
+		for (auto it = cells.begin(); it != cells.end(); it++)
+		{
+			int x = *it % map->width;
+			int y = *it / map->width;
+
+			//Cells outside of the view are not drawn
+			int con_x = x - view_x;
+			int con_y = y - view_y;
+			if (con_x < 0 || con_y < 0 || con_x >= gameConsole->getWidth() || con_y >= gameConsole->getHeight()) { continue; }
+
+			map->renderCell(gameConsole, x, y, view_x, view_y);
+
+			Actor* actor = actors->getActorAt(x, y);
+			if (actor != nullptr) { actor->render(gameConsole, view_x, view_y); }
+
+			if (!headless)
+			{
+				TCODConsole::blit(gameConsole, con_x, con_y, 1, 1, TCODConsole::root, con_x, con_y);
+				gui->invalidateRegion(con_x, con_y, 1, 1);
+			}
+			redrawn++;
+		}
+	}
 
-	// draw the map
-	map->render(gameConsole);
-	// draw the actors
-	actors->render(gameConsole);
+	map->clearDirty();
 
-	TCODConsole::blit(gameConsole, 0, 0, 0, 0, TCODConsole::root, 0, 0);
+	if (!headless) { gui->render(TCODConsole::root); }
 
-	gui->render(TCODConsole::root);
+	stats.frames++;
+	stats.redrawn_cells += redrawn;
+	stats.last_frame_redrawn_cells = redrawn;
+	stats.render_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
 }
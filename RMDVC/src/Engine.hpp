@@ -4,6 +4,7 @@
 #define ENGINE_HPP
 
 #include "libtcod.hpp"
+#include "Handle.hpp"
 
 class Actor;
 class ActorMap;
@@ -13,15 +14,138 @@ class Gui;
 class GuiBodyViewer;
 class GuiTextBox;
 class GuiListChooser;
+class BodyTemplateRegistry;
+class InputSource;
+class ChaseMap;
+class WorkerPool;
+class Autosave;
+class Body;
+struct ActionIntent;
+struct SaveGameData;
 
+#include <chrono>
 #include <fstream>
 #include <stdio.h>
-#include <boost/archive/xml_oarchive.hpp> // saving
-#include <boost/archive/xml_iarchive.hpp> // loading
+#include <string>
 #include <map>
+#include <vector>
 
 enum class GameState { GUI, GAME, INIT };
 
+/** @brief The settings the Engine is created with.
+*/
+struct EngineConfig {
+	/** In headless mode, no root console (window) is created: a new game is started right away,
+	* rendering only happens on the offscreen gameConsole and no GUI is drawn.
+	*/
+	bool headless;
+
+	/** The size of the map of a new game.
+	*/
+	int map_width;
+	int map_height;
+
+	/** The size of the part of the map shown on screen. The map may be much larger, the view
+	* follows the player.
+	*/
+	int view_width;
+	int view_height;
+
+	/** The source of all key input. The Engine takes ownership; if it is the nullptr,
+	* a KeyboardInput is created.
+	*/
+	InputSource* input;
+
+	/** The number of threads the Ais decide on, see WorkerPool. With 0, one per hardware thread is used.
+	* The game plays out the same for any number.
+	*/
+	int ai_threads;
+
+	/** The master seed of the RandomService. With 0, a seed is picked from the clock.
+	*/
+	unsigned int seed;
+
+	/** The number of turns after which the autosave takes a new snapshot (see Autosave).
+	* With 0, the game is not autosaved.
+	*/
+	int autosave_interval;
+
+	/** The path of the autosave files, without extension.
+	*/
+	std::string autosave_path;
+
+	/** The file the trace (see Trace) is written to when the Engine is destroyed, as Chrome trace JSON
+	* if it ends with ".json", in the binary format otherwise. If it is empty, zones are not recorded.
+	*/
+	std::string trace_path;
+
+	/** The number of frames per second rendered while waiting for the player, see Engine::idle().
+	* With 0, idle() returns right away.
+	*/
+	int frame_rate;
+
+	EngineConfig() : headless(false), map_width(120), map_height(70), view_width(120), view_height(70), input(nullptr),
+		ai_threads(0), seed(0), autosave_interval(100), autosave_path("autosave"), frame_rate(60) {};
+};
+
+/** @brief Counters and accumulated per-phase timings of the game loop.
+*/
+struct EngineStats {
+	/** The number of calls to update() that processed a key, and the number of actions executed.
+	*/
+	unsigned long long turns;
+	unsigned long long actions;
+
+	/** The time spent taking actions from the scheduler, updating the Ai of actors (including
+	* the scheduling of their new actions), executing actions and rendering, in seconds.
+	*/
+	double scheduling_seconds;
+	double ai_seconds;
+	double execute_seconds;
+	double render_seconds;
+
+	/** The time spent handing the turns to the autosave (journaling and snapshots), in seconds.
+	*/
+	double autosave_seconds;
+
+	/** The number of frames rendered, the number of map cells redrawn in all of them
+	* and in the last one.
+	*/
+	unsigned long long frames;
+	unsigned long long redrawn_cells;
+	int last_frame_redrawn_cells;
+
+	/** The number of decision phases and the number of Ais that decided in them.
+	*/
+	unsigned long long decision_phases;
+	unsigned long long decisions;
+
+	/** The number of speculation steps taken while waiting for the player and the time they took,
+	* in seconds (see Engine::speculate()).
+	*/
+	unsigned long long speculations;
+	double speculation_seconds;
+
+	void reset() {
+		turns = 0;
+		actions = 0;
+		scheduling_seconds = 0.0;
+		ai_seconds = 0.0;
+		execute_seconds = 0.0;
+		render_seconds = 0.0;
+		autosave_seconds = 0.0;
+		frames = 0;
+		redrawn_cells = 0;
+		last_frame_redrawn_cells = 0;
+		decision_phases = 0;
+		decisions = 0;
+		speculations = 0;
+		speculation_seconds = 0.0;
+	}
+
+	EngineStats() { reset(); };
+};
+
 /** This class provides the render() and update() methods for the game loop,
 * as well as holding the loaded Actors, Map and providing
 * functions for GUI handling.
@@ -35,8 +159,92 @@ private:
 	*/
 	TCODConsole* gameConsole;
 
+	/** The map cell shown in the top left corner of the gameConsole.
+	*/
+	int view_x, view_y;
+
+	/** Centers the view on the player (as far as the map allows), requesting a full redraw if it moves.
+	*/
+	void updateView();
+
 	GameState state;
 
+	bool headless;
+	InputSource* input;
+
+	EngineStats stats;
+
+	/** The distance field toward the player, shared by all Actors chasing the player.
+	*/
+	ChaseMap* chase_map;
+
+	/** The distance fields toward the cells the player may step to next, computed by speculate().
+	* getPlayerChaseMap() swaps the one matching the player's new position in for chase_map.
+	*/
+	std::vector<ChaseMap*>* speculative_chase_maps;
+
+	/** The progress of the speculation on the current turn: the number of speculative chase maps
+	* computed, the Actors whose Ais speculate and how many of them have done so.
+	*/
+	int speculated_chase_maps;
+	std::vector<Actor*>* speculation_actors;
+	size_t speculated_actors;
+	bool speculation_done;
+
+	/** Starts the speculation over, as the last one was on a turn that has been played.
+	*/
+	void resetSpeculation();
+
+	/** The key idle() has read, to be processed by the next update().
+	*/
+	TCOD_key_t pending_key;
+	bool has_pending_key;
+
+	/** The time between frames while waiting for the player (zero for none) and the time the next frame is due.
+	*/
+	std::chrono::high_resolution_clock::duration frame_duration;
+	std::chrono::high_resolution_clock::time_point next_frame;
+
+	/** The threads the Ais decide on and the TCODMap every worker computes fields of view on.
+	*/
+	WorkerPool* ai_pool;
+	std::vector<TCODMap*> ai_fov_maps;
+
+	/** The Actors that have acted in the current time slice and the Ais taking part in the
+	* decision phase with the actions they decided on, kept to avoid reallocation.
+	*/
+	std::vector<ActorHandle>* acted;
+	std::vector<Actor*>* deciding;
+	std::vector<ActionIntent>* intents;
+
+	/** Lets the Ais of the Actors in acted decide on their next actions and schedules them.
+	* The Ais decide in parallel on a snapshot of the world, which nothing changes until all of
+	* them are done. Their actions are then scheduled in the order the Actors have acted, so the
+	* game plays out the same for any number of threads.
+	*/
+	void decideActions(TCOD_key_t key);
+
+	/** Creates the map, the actor map, the scheduler and the player for a new game.
+	*/
+	void newGame(int width, int height, int player_x, int player_y);
+
+	/** Journals every turn and takes snapshots in the background (may be the nullptr).
+	*/
+	Autosave* autosave;
+
+	/** The file the trace is written to on destruction (empty for none).
+	*/
+	std::string trace_path;
+
+	/** Fills in the parts of the game state that make up a saved game.
+	*/
+	void getSaveData(SaveGameData* data) const;
+
+	/** Returns the Body of the player, or the nullptr if the player has none (e.g. because
+	* Body.xml could not be parsed).
+	*/
+	Body* getPlayerBody() const;
+
 public :
 
 	ActorMap* actors;
@@ -46,17 +254,69 @@ public :
 
 	ActionScheduler* scheduler;
 
+	/** Parsed body definitions, from which the Bodies of new Actors are instantiated.
+	*/
+	BodyTemplateRegistry* body_templates;
+
 	Gui* gui;
 	GuiBodyViewer* guiBodyViewer;
 	GuiTextBox* sampleTextBox;
 	GuiListChooser* sampleList;
  
     Engine();
+	Engine(const EngineConfig& config);
     ~Engine();
 
+	/** Creates an Actor with a MeleeAi at the given position and lets it schedule its first action.
+	*
+	* @return The new Actor, or the nullptr if the position is a wall or occupied.
+	*/
+	Actor* spawnMeleeActor(int x, int y);
+
+	/** Reads a key from the input source, if one is available (update() never waits for one), and,
+	* in the GAME state, performs actions until it is the player's turn again.
+	*/
     void update();
     void render();
 
+	/** Spends the time until the next frame is due speculating on the next turn (see speculate()),
+	* so the game loop renders at a steady cadence while waiting for the player. It returns as soon as
+	* a key is available, so the key is processed and its outcome rendered right away.
+	*/
+	void idle();
+
+	/** Takes one step of the work for the next turn that can be done before the player has acted:
+	* computing the chase maps for the cells the player may step to, then (a batch at a time) letting
+	* the Ais speculate, which precomputes their fields of view. Nothing of the game state is changed;
+	* what the player's action makes worthless is simply not used.
+	*
+	* @return false if there is nothing (left) to do for this turn.
+	*/
+	bool speculate();
+
+	/** Returns the distance field toward the player, which is recomputed here if the
+	* player has moved (or the map has changed) since it was last used.
+	*/
+	const ChaseMap* getPlayerChaseMap();
+
+	/** Returns the distance field toward the player as it was last updated by getPlayerChaseMap().
+	* Unlike that, it does not change anything, so Ais may use it while deciding in parallel.
+	*/
+	const ChaseMap* getChaseMap() const { return chase_map; }
+
+	/** @brief Returns the number of computations of the chase map, including the speculative ones.
+	*/
+	unsigned long long getChaseMapComputeCount() const;
+
+	bool isHeadless() const { return headless; }
+
+	const EngineStats& getStats() const { return stats; }
+
+	/** @brief Returns the autosave, or the nullptr if the game is not autosaved.
+	*/
+	Autosave* getAutosave() { return autosave; }
+	void resetStats() { stats.reset(); }
+
 };
  
 #endif
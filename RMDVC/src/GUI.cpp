@@ -1,33 +1,49 @@
 #include "GUI.hpp"
+#include "Trace.hpp"
 
+#include <algorithm>
+#include <cassert>
+
+static TraceCounter surface_redraws("gui surface redraws");
+static TraceCounter container_blits("gui container blits");
+static TraceCounter skipped_blits("gui skipped blits");
+static TraceCounter occluded_containers("gui occluded containers");
 
 Gui::Gui(){
-	containers = new std::map<string, GuiContainer*>();
+	containers = new SlotMap<GuiContainer>();
+	layers = new std::vector<GuiContainer*>();
+	blitted = new std::vector<GuiContainer*>();
 };
 Gui::~Gui(){
 
-	containers->erase(containers->begin(), containers->end());
+	containers->clear();
 	delete containers;
+	delete layers;
+	delete blitted;
 
 	delete current_active;
 };
 
-GuiContainer* Gui::getContainerFromUUID(string uuid)
+GuiContainer* Gui::getContainer(GuiContainerHandle handle)
 {
-	std::map<string, GuiContainer*>::iterator it = containers->find(uuid);
-	if (it == containers->end()) { return nullptr; }
-	return containers->at(uuid);
+	return containers->lookup(handle);
 }
 
-void Gui::addContainer(GuiContainer* container){
-	containers->insert(std::pair<string, GuiContainer*>(container->getUUID(), container));
+GuiContainerHandle Gui::addContainer(GuiContainer* container){
+	container->setHandle(containers->insert(container));
+	return container->getHandle();
 }
 
-bool Gui::removeContainer(string uuid)
+bool Gui::removeContainer(GuiContainerHandle handle)
 {
-	std::map<string, GuiContainer*>::iterator it = containers->find(uuid);
-	if (it == containers->end()) { return false; }
-	containers->erase(it);
+	GuiContainer* c = getContainer(handle);
+	if (c == nullptr) { return false; }
+
+	if (c == current_active) { current_active = nullptr; }
+	if (c->isShown()) { removed_shown = true; }
+	containers->remove(handle);
+	c->setHandle(GuiContainerHandle());
+	c->setShown(false);
 
 	return true;
 }
@@ -40,9 +56,9 @@ void Gui::makeActive(GuiContainer* container)
 	// it's update() function is only called if it is, so no check is necessary.
 }
 
-bool Gui::makeActive(string uuid)
+bool Gui::makeActive(GuiContainerHandle handle)
 {
-	GuiContainer* c = getContainerFromUUID(uuid);
+	GuiContainer* c = getContainer(handle);
 	if (c == nullptr) { return false; }
 
 	makeActive(c);
@@ -50,9 +66,11 @@ bool Gui::makeActive(string uuid)
 }
 
 void Gui::update(TCOD_key_t key){
-	for (std::map<string, GuiContainer*>::iterator it = containers->begin(); it != containers->end(); it++)
+	for (size_t i = 0; i < containers->getSlotCount(); i++)
 	{
-		GuiContainer *container = it->second;
+		if (!containers->isSlotOccupied(i)) { continue; }
+
+		GuiContainer *container = containers->getAt(i);
 		if (container->isDynamic() || container == current_active)
 		{
 			container->update(key);
@@ -60,19 +78,123 @@ void Gui::update(TCOD_key_t key){
 	}
 }
 
+static bool compareZOrder(const GuiContainer* a, const GuiContainer* b)
+{
+	return a->getZOrder() < b->getZOrder();
+}
+
 void Gui::render(TCODConsole* con){
-	//Iterate through all GuiContainers, call their render function
-	// and blit the result on the given console at the coordinates that 
-	// the GuiContainer is set to.
-	for (std::map<string, GuiContainer*>::iterator it = containers->begin(); it != containers->end(); it++)
+	TRACE_ZONE("Gui::render");
+
+	//Collect the visible GuiContainers, bottom to top
+	layers->clear();
+	for (size_t i = 0; i < containers->getSlotCount(); i++)
+	{
+		if (!containers->isSlotOccupied(i)) { continue; }
+
+		GuiContainer *container = containers->getAt(i);
+		if (!container->isVisible()) { continue; }
+
+		//A container that has just become visible is not on the console yet
+		if (!container->isShown())
+		{
+			container->setShown(true);
+			container->setBlitPending(true);
+		}
+
+		layers->push_back(container);
+	}
+
+	std::stable_sort(layers->begin(), layers->end(), compareZOrder);
+
+	blitted->clear();
+	for (size_t i = 0; i < layers->size(); i++)
 	{
-		GuiContainer *container = it->second;
-		if (container->isVisible()){
-			container->render(con);
+		GuiContainer *container = (*layers)[i];
+
+		//A container hidden beneath another one is left as it is, until it is uncovered
+		bool occluded = false;
+		for (size_t j = i + 1; j < layers->size() && !occluded; j++)
+		{
+			occluded = (*layers)[j]->covers(container);
+		}
+
+		if (occluded)
+		{
+			TRACE_COUNT(occluded_containers, 1);
+			continue;
 		}
+
+		if (container->updateSurface())
+		{
+			container->setBlitPending(true);
+			TRACE_COUNT(surface_redraws, 1);
+		}
+
+		//Blitting a container paints over the containers above it, where they overlap
+		for (auto it = blitted->begin(); it != blitted->end() && !container->isBlitPending(); it++)
+		{
+			GuiContainer* below = *it;
+			if (container->overlaps(below->getPosX(), below->getPosY(), below->getWidth(), below->getHeight()))
+			{
+				container->setBlitPending(true);
+			}
+		}
+
+		if (!container->isBlitPending())
+		{
+			TRACE_COUNT(skipped_blits, 1);
+			continue;
+		}
+
+		container->blit(con);
+		container->setBlitPending(false);
+		blitted->push_back(container);
+		TRACE_COUNT(container_blits, 1);
 	}
 }
 
+void Gui::invalidateRegion(int x, int y, int width, int height)
+{
+	for (size_t i = 0; i < containers->getSlotCount(); i++)
+	{
+		if (!containers->isSlotOccupied(i)) { continue; }
+
+		GuiContainer *container = containers->getAt(i);
+		if (container->overlaps(x, y, width, height)) { container->setBlitPending(true); }
+	}
+}
+
+void Gui::invalidateAll()
+{
+	for (size_t i = 0; i < containers->getSlotCount(); i++)
+	{
+		if (!containers->isSlotOccupied(i)) { continue; }
+
+		containers->getAt(i)->setBlitPending(true);
+	}
+}
+
+bool Gui::takeExposed()
+{
+	bool exposed = removed_shown;
+	removed_shown = false;
+
+	for (size_t i = 0; i < containers->getSlotCount(); i++)
+	{
+		if (!containers->isSlotOccupied(i)) { continue; }
+
+		GuiContainer *container = containers->getAt(i);
+		if (container->isShown() && !container->isVisible())
+		{
+			container->setShown(false);
+			exposed = true;
+		}
+	}
+
+	return exposed;
+}
+
 void Gui::exitGUIState() {
 	current_active->setVisibility(false);
 	current_active = nullptr;
@@ -97,6 +219,12 @@ GuiRenderObject(x, y, width, height, fore, back)
 
 GuiElement::~GuiElement(){}
 
+void GuiElement::setVisibility(bool visible)
+{
+	if (visible != this->visible) { invalidate(); }
+	GuiRenderObject::setVisibility(visible);
+}
+
 GuiContainer::GuiContainer(int x, int y, int width, int height,
 	TCODColor fore, TCODColor back, bool dynamic, bool draw_border, string title)
 	:GuiRenderObject(x, y, width, height, fore, back)
@@ -119,6 +247,7 @@ void GuiContainer::addElement(GuiElement* element)
 {
 	elements->push_back(element);
 	element->setParent(this);
+	invalidate();
 }
 
 void GuiContainer::update(TCOD_key_t key)
@@ -126,10 +255,8 @@ void GuiContainer::update(TCOD_key_t key)
 
 }
 
-void GuiContainer::renderSelf(TCODConsole* con)
+void GuiContainer::renderSelf()
 {
-	if (!visible) { return; }
-
 	//Set Defaults
 	container_console->setDefaultBackground(background_color);
 	container_console->setDefaultForeground(foreground_color);
@@ -151,28 +278,48 @@ void GuiContainer::renderSelf(TCODConsole* con)
 	else {
 		container_console->rect(0, 0, width, height, true);
 	}
-
-	TCODConsole::blit(container_console, 0, 0, 0, 0, con, pos_x, pos_y);
 }
 
-void GuiContainer::render(TCODConsole* con)
+void GuiContainer::renderContent()
 {
-	if (!visible) { return; }
-
 	//Render the GuiContainer's own graphic elements and set the colors
-	renderSelf(con);
+	renderSelf();
 
 	//Iterate through GuiElements, render them to container_console
-	//TODO: If necessary, implement z-ordering.
 	for (std::vector<GuiElement*>::iterator it = elements->begin(); it != elements->end(); it++)
 	{
 		GuiElement *element = *it;
 		element->render(container_console);
 	}
-	
+}
+
+bool GuiContainer::updateSurface()
+{
+	for (std::vector<GuiElement*>::iterator it = elements->begin(); it != elements->end(); it++)
+	{
+		(*it)->sync();
+	}
+
+	if (!dirty) { return false; }
+
+	renderContent();
+	dirty = false;
+	return true;
+}
+
+void GuiContainer::blit(TCODConsole* con)
+{
 	TCODConsole::blit(container_console, 0, 0, 0, 0, con, pos_x, pos_y);
 }
 
+void GuiContainer::render(TCODConsole* con)
+{
+	if (!visible) { return; }
+
+	updateSurface();
+	blit(con);
+}
+
 GuiTextBox::GuiTextBox(string id, int x, int y, int width, int height, string text, TCODColor fore, TCODColor back, TCOD_alignment_t alignment)
 	:GuiElement(id, x, y, width, height, fore, back, nullptr){
 	this->text = text;
@@ -184,6 +331,14 @@ GuiTextBox::~GuiTextBox()
 
 }
 
+void GuiTextBox::setText(string text)
+{
+	if (text == this->text) { return; }
+
+	this->text = text;
+	invalidate();
+}
+
 void GuiTextBox::render(TCODConsole* con){
 	if (!visible) { return; }
 
@@ -193,6 +348,50 @@ void GuiTextBox::render(TCODConsole* con){
 	con->printRect(pos_x, pos_y, width, height, text.c_str());
 }
 
+GuiItemList::GuiItemList()
+{
+	rows = new std::vector<GuiObjectLink*>();
+	changes = new std::vector<GuiListRange>();
+}
+
+GuiItemList::~GuiItemList()
+{
+	for (auto it = rows->begin(); it != rows->end(); it++) { delete *it; }
+	delete rows;
+	delete changes;
+}
+
+void GuiItemList::add(unsigned long long object_handle, const string& text, TCODColor fore, TCODColor back)
+{
+	rows->push_back(new GuiObjectLink(object_handle, new ColoredText(text, fore, back)));
+	changes->push_back(GuiListRange((int)rows->size() - 1, 1, GUI_LIST_INSERTED));
+}
+
+void GuiItemList::remove(int first, int count)
+{
+	if (first < 0 || count <= 0 || first + count > getRowCount()) { return; }
+
+	for (int i = first; i < first + count; i++) { delete rows->at(i); }
+	rows->erase(rows->begin() + first, rows->begin() + first + count);
+
+	changes->push_back(GuiListRange(first, count, GUI_LIST_REMOVED));
+}
+
+int GuiItemList::find(const string& text) const
+{
+	for (size_t i = 0; i < rows->size(); i++)
+	{
+		if ((*rows)[i]->text->getText() == text) { return (int)i; }
+	}
+	return -1;
+}
+
+void GuiItemList::takeChanges(std::vector<GuiListRange>* changes)
+{
+	changes->clear();
+	changes->swap(*this->changes);
+}
+
 ActiveGuiElement::ActiveGuiElement(string id, int x, int y, int width, int height,
 	int max_item_display,
 	TCODColor fore, TCODColor back,
@@ -207,26 +406,23 @@ ActiveGuiElement::ActiveGuiElement(string id, int x, int y, int width, int heigh
 
 	this->max_item_display = max_item_display;
 
-	items = new std::vector<GuiObjectLink*>();
+	items = new GuiItemList();
+	source = items;
 }
 
 ActiveGuiElement::~ActiveGuiElement()
 {
-	items->erase(items->begin(), items->end());
 	delete items;
 }
 
-void ActiveGuiElement::addItem(std::string object_uuid, string text, TCODColor fore, TCODColor back)
+void ActiveGuiElement::addItem(unsigned long long object_handle, string text, TCODColor fore, TCODColor back)
 {
-	ColoredText* t = new ColoredText(text, fore, back);
-	items->push_back(new GuiObjectLink(object_uuid, t));
-	item_count++;
-	item_change = true;
+	items->add(object_handle, text, fore, back);
 }
 
-void ActiveGuiElement::addItem(std::string object_uuid, ColoredText* text)
+void ActiveGuiElement::addItem(unsigned long long object_handle, ColoredText* text)
 {
-	addItem(object_uuid, text->getText(), text->getForeColor(), text->getBackColor());
+	addItem(object_handle, text->getText(), text->getForeColor(), text->getBackColor());
 }
 
 void ActiveGuiElement::addItems(std::vector<GuiObjectLink*>* list)
@@ -234,17 +430,28 @@ void ActiveGuiElement::addItems(std::vector<GuiObjectLink*>* list)
 	for (std::vector<GuiObjectLink*>::iterator it = list->begin(); it != list->end(); it++)
 	{
 		GuiObjectLink* link = *it;
-		addItem(link->object_uuid, link->text);
+		addItem(link->object_handle, link->text);
 	}
 }
 
+void ActiveGuiElement::setDataSource(GuiListDataSource* source)
+{
+	this->source = source != nullptr ? source : items;
+
+	std::vector<GuiListRange> dropped;
+	this->source->takeChanges(&dropped);
+	invalidate();
+}
+
 void ActiveGuiElement::makeActive()
 {
+	if (!active) { invalidate(); }
 	active = true;
 }
 
 void ActiveGuiElement::makeInactive()
 {
+	if (active) { invalidate(); }
 	active = false;
 }
 
@@ -254,64 +461,97 @@ GuiListChooser::GuiListChooser(string id, int x, int y, int width, int height,
 	TCODColor sel_fore_act, TCODColor sel_back_act,
 	TCODColor sel_fore_inact, TCODColor sel_back_inact) :
 	ActiveGuiElement(id, x, y, width, height, max_item_display,
-	fore, back, sel_fore_act, sel_back_act, sel_fore_inact, sel_back_inact){}
+	fore, back, sel_fore_act, sel_back_act, sel_fore_inact, sel_back_inact)
+{
+	changes = new std::vector<GuiListRange>();
+}
 
 GuiListChooser::~GuiListChooser()
 {
-	delete selected;
+	delete changes;
 }
 
 bool GuiListChooser::removeItem(string text)
 {
-	for (std::vector<GuiObjectLink*>::iterator it = items->begin(); it != items->end(); it++)
-	{
-		GuiObjectLink *item = *it;
-		if (item == selected){ selected = nullptr; }
-		if (text.compare(item->text->getText())){
+	int index = items->find(text);
+	if (index < 0) { return false; }
+
+	items->remove(index, 1);
+	return true;
+}
+
+void GuiListChooser::removeItems(int first, int count)
+{
+	items->remove(first, count);
+}
+
+void GuiListChooser::setDataSource(GuiListDataSource* source)
+{
+	ActiveGuiElement::setDataSource(source);
+	selected_index = 0;
+	first_visible = 0;
+}
+
+void GuiListChooser::applyChanges()
+{
+	source->takeChanges(changes);
+	if (changes->empty()) { return; }
 
-			items->erase(it);
-			delete item;
+	invalidate();
 
-			item_count--;
-			item_change = true;
+	//The number of rows before the changes, which is followed while replaying them
+	int count = source->getRowCount();
+	for (auto it = changes->begin(); it != changes->end(); it++)
+	{
+		count += it->type == GUI_LIST_INSERTED ? -it->count : it->count;
+	}
+	bool was_empty = count == 0;
 
-			return true;
+	for (auto it = changes->begin(); it != changes->end(); it++)
+	{
+		if (it->type == GUI_LIST_INSERTED)
+		{
+			//Only a row at or after the inserted ones moves down, not the selection of an empty list
+			if (selected_index >= it->first && selected_index < count) { selected_index += it->count; }
+			count += it->count;
+		}
+		else
+		{
+			//Rows after the removed ones move up, a removed selection moves to the row following it
+			if (selected_index >= it->first + it->count) { selected_index -= it->count; }
+			else if (selected_index >= it->first) { selected_index = it->first; }
+			count -= it->count;
 		}
 	}
-	return false;
+
+	count = source->getRowCount();
+	if (selected_index >= count) { selected_index = count - 1; }
+	if (selected_index < 0) { selected_index = 0; }
+
+	//A list filled from empty starts at its first row
+	assert(!was_empty || selected_index == 0);
 }
 
-int GuiListChooser::getSelected(std::vector<std::string>* obj_uuids)
+int GuiListChooser::getSelected(std::vector<unsigned long long>* obj_handles)
 {
 	//Only one item!
-	obj_uuids->clear();
-	obj_uuids->push_back(selected->object_uuid);
+	obj_handles->clear();
+
+	applyChanges();
+	if (source->getRowCount() == 0) { return 0; }
+
+	obj_handles->push_back(source->getRow(selected_index)->object_handle);
 	return 1;
 }
 
 
 void GuiListChooser::update(TCOD_key_t key)
 {
-	//If list is empty, return
-	if (item_count <= 0 || items->size() == 0) { return; }
-	
-	//If item list changed, update selected_index to point at selected item
-	if (item_change && selected != nullptr){
-		for (int i = 0; i < item_count; i++)
-		{
-			if (selected == items->at(i)){
-				selected_index = i;
-				break;
-			}
-		}
-	}
+	applyChanges();
 
-	//If no selection (after init or if selected element got removed)
-	// select first item in list.
-	if (selected == nullptr) 
-	{ 
-		selected_index = 0; 
-	} 
+	//If list is empty, return
+	int item_count = source->getRowCount();
+	if (item_count <= 0) { return; }
 	
 	//If key pressed, modify selected_index accordingly, while "wrapping around"
 	// but only, if Element is currently the active one
@@ -321,91 +561,85 @@ void GuiListChooser::update(TCOD_key_t key)
 		case list_up:
 			if (selected_index > 0) { selected_index--; }
 			else { selected_index = item_count - 1; }
+			invalidate();
 			break;
 
 		case list_down:
 			if (selected_index < item_count - 1) { selected_index++; }
 			else { selected_index = 0; }
+			invalidate();
 			break;
 		}
 	}
-	//Refresh selected pointer to point at newly selected object
-	selected = items->at(selected_index);
+}
+
+void GuiListChooser::scrollToSelection()
+{
+	int item_count = source->getRowCount();
 
-	//selected pointer and selected_index are "synchronized" now
-	item_change = false;
+	if (item_count <= max_item_display)
+	{
+		first_visible = 0;
+		return;
+	}
 
+	//While there are more rows below the screen, the last line shows "..." instead of a row
+	int shown = max_item_display > 1 ? max_item_display - 1 : max_item_display;
+
+	if (selected_index < first_visible) { first_visible = selected_index; }
+	if (selected_index >= first_visible + shown) { first_visible = selected_index - shown + 1; }
+
+	//At the end of the list, all lines show rows
+	first_visible = std::max(0, std::min(first_visible, item_count - max_item_display));
 }
 
 void GuiListChooser::render(TCODConsole* con)
 {
 	if (!visible) { return; }
 
-	//NOTE: whenever max_item_display is used for "positioning", it needs to be reduced
-	// by 1, because it starts at "1", whereas the index of the first element is "0"!!
-
-	int index = 0;
-	int first_item = 0; //First item shown by default is the first item in the list
-	int last_item = max_item_display - 1;	//Last item shown is either the last one in the list
-										// (if item_count < max_item_display)
-										// or the the last fitting on screen.
+	applyChanges();
+	scrollToSelection();
 
-	//If there are more items than can be displayed, the last item is replaced by "..."
-	if (item_count > max_item_display) { last_item = max_item_display - 2; }
-
-	//If the selected item is "normally" not shown on screen because it is too far
-	// down the list, the list is scrolled to have it as it's last element, and the
-	// first is changed accordingly.
-	if (selected_index >= max_item_display - 2) 
-	{
-		first_item = (selected_index - (max_item_display-2));
-		last_item = selected_index;
-	}
+	int item_count = source->getRowCount();
+	bool more_below = max_item_display > 1 && first_visible + max_item_display < item_count;
+	int last_item = std::min(item_count, first_visible + (more_below ? max_item_display - 1 : max_item_display));
 
 	con->setDefaultBackground(background_color);
 	con->setDefaultForeground(foreground_color);
 
 	con->rect(pos_x, pos_y, width, height, true);
-	
-	for (std::vector<GuiObjectLink*>::iterator it = items->begin(); it != items->end(); it++)
-	{
-		//If there are more items than can be displayed, the last item is replaced by "..."
-		if (index == last_item + 1 && item_count > max_item_display)
-		{
-			con->setDefaultBackground(gui_default_back);
-			con->setDefaultForeground(gui_default_fore);
-			con->printRect(pos_x, pos_y + (index - first_item), width, 1, "...");
-			break;
-		}
 
-		//Render only the items between first_item and last_item
-		if (index >= first_item && index <= last_item)
-		{
-			GuiObjectLink *item = *it;
+	//Only the rows on screen are read from the source
+	for (int index = first_visible; index < last_item; index++)
+	{
+		const GuiObjectLink* item = source->getRow(index);
 
-			//GuiListChooser will use the Fore color of the Item,
-			// but overwrite it's Back color with it's own back_inactive
-			// (or, on selection, the back_active color)
-			con->setDefaultForeground(item->text->getForeColor());
-
-			if (item == selected)
-			{
-				if (active) {
-					con->setDefaultBackground(sel_back_active);
-				}
-				else {
-					con->setDefaultBackground(sel_back_inactive);
-				}
+		//GuiListChooser will use the Fore color of the Item,
+		// but overwrite it's Back color with it's own back_inactive
+		// (or, on selection, the back_active color)
+		con->setDefaultForeground(item->text->getForeColor());
 
+		if (index == selected_index)
+		{
+			if (active) {
+				con->setDefaultBackground(sel_back_active);
 			}
 			else {
-				con->setDefaultBackground(background_color);
+				con->setDefaultBackground(sel_back_inactive);
 			}
-
-			con->printRect(pos_x, pos_y + (index-first_item), width, 1, item->text->getText().c_str());
+		}
+		else {
+			con->setDefaultBackground(background_color);
 		}
 
-		index++;
+		con->printRect(pos_x, pos_y + (index - first_visible), width, 1, item->text->getText().c_str());
 	}
 
+	//If there are more items than can be displayed, the last line is "..."
+	if (more_below)
+	{
+		con->setDefaultBackground(gui_default_back);
+		con->setDefaultForeground(gui_default_fore);
+		con->printRect(pos_x, pos_y + (last_item - first_visible), width, 1, "...");
+	}
 }
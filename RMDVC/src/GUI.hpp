@@ -4,6 +4,7 @@
 #include "libtcod.hpp"
 #include "Object.hpp"
 #include "GUI_structs.hpp"
+#include "Handle.hpp"
 
 class Body;
 
@@ -40,7 +41,7 @@ public:
 	void setHeight(int h){ height = h; }
 
 	bool isVisible(){ return visible; }
-	void setVisibility(bool visible) { this->visible = visible; }
+	virtual void setVisibility(bool visible) { this->visible = visible; }
 
 	~GuiRenderObject();
 };
@@ -80,10 +81,40 @@ protected:
 	bool draw_border;
 	string title;
 
+	/** The handle under which the container is registered in the Gui. It is
+	* assigned by Gui::addContainer().
+	*/
+	GuiContainerHandle handle;
+
+	/** Containers with a higher z-order are drawn over those with a lower one.
+	*/
+	int z_order = 0;
+
+	/** Whether container_console has to be redrawn, see invalidate().
+	*/
+	bool dirty = true;
+
+	/** Whether container_console has to be blitted again, because it has been redrawn or the area
+	* it covers on the target console has been painted over. Set and cleared by the Gui.
+	*/
+	bool blit_pending = true;
+
+	/** Whether the container is on the target console, as of the last Gui::render().
+	*/
+	bool shown = false;
+
+	/** Draws the container onto container_console: its own graphic elements (renderSelf()),
+	* then all GuiElements in the elements vector.
+	*/
+	virtual void renderContent();
+
 public:
 	GuiContainer(int x, int y, int width, int height, TCODColor fore, TCODColor back, bool dynamic = false, bool draw_border = false, string title = "");
 	~GuiContainer();
 
+	GuiContainerHandle getHandle() const { return handle; }
+	void setHandle(GuiContainerHandle handle) { this->handle = handle; }
+
 	bool isDynamic() { return dynamic; };
 	void setDynamic(bool value) { dynamic = value; };
 
@@ -92,23 +123,67 @@ public:
 
 	virtual void update(TCOD_key_t key);
 
-	/** This function renders only the GuiContainers own graphic elements (such as the border).
-	* It does not call the render() function of it's children to allow for custom rendering
-	* (such as with ActiveElements).
+	int getZOrder() const { return z_order; }
+	void setZOrder(int z) { z_order = z; }
+
+	/** Marks container_console to be redrawn before it is shown next. Elements call it (through
+	* GuiElement::invalidate()) whenever what they show changes; until then, the container is
+	* composited from the surface it has already drawn.
+	*
+	* @brief Discards the drawn surface of the container.
+	*/
+	void invalidate() { dirty = true; }
+
+	bool isBlitPending() const { return blit_pending; }
+	void setBlitPending(bool pending) { blit_pending = pending; }
+
+	bool isShown() const { return shown; }
+	void setShown(bool shown) { this->shown = shown; }
+
+	/** @brief Returns whether the container overlaps the given area of the target console.
+	*/
+	bool overlaps(int x, int y, int width, int height) const
+	{
+		return x < pos_x + this->width && pos_x < x + width && y < pos_y + this->height && pos_y < y + height;
+	}
+
+	/** As container_console is opaque, a container covering another one hides it entirely.
+	*
+	* @brief Returns whether the container covers all of the area of the given one.
+	*/
+	bool covers(const GuiContainer* other) const
+	{
+		return pos_x <= other->pos_x && pos_y <= other->pos_y &&
+			other->pos_x + other->width <= pos_x + width && other->pos_y + other->height <= pos_y + height;
+	}
+
+	/** This function renders only the GuiContainers own graphic elements (such as the border)
+	* onto the container_console. It does not call the render() function of it's children to allow
+	* for custom rendering (such as with ActiveElements).
 	* Note that this function should be called before calling the child render function(s), otherwise
-	* it will overwrite the output on the console.
+	* it will overwrite their output.
 	*
-	* @brief Renders only the GuiContainers own graphic elements onto the given console.
+	* @brief Renders only the GuiContainers own graphic elements.
 	*/
-	void renderSelf(TCODConsole* con);
+	void renderSelf();
 
-	/** This function calls the render() function of all GuiElements contained
-	* in the elements vector, after calling renderSelf() .
-	* These functions draw on the container_console, which is then blitted onto the given console.
+	/** Brings the elements up to date with their data (see GuiElement::sync()) and, if the container
+	* has been invalidated, redraws container_console by calling renderContent().
 	*
-	* @brief Renders all 'child' GuiElements on the given console.
+	* @return Whether container_console has been redrawn.
 	*/
-	virtual void render(TCODConsole* con);
+	bool updateSurface();
+
+	/** @brief Blits container_console as it is onto the given console, at the position of the container.
+	*/
+	void blit(TCODConsole* con);
+
+	/** Redraws container_console if necessary (see updateSurface()) and blits it onto the given console.
+	* The Gui composites its containers by itself, which saves the blits that would change nothing.
+	*
+	* @brief Renders the container with all 'child' GuiElements on the given console.
+	*/
+	void render(TCODConsole* con);
 };
 
 /** It provides parent handling functions.
@@ -126,6 +201,20 @@ public:
 	void setParent(GuiContainer* parent) { this->parent = parent; }
 	const GuiContainer* getParent() { return parent; }
 
+	/** @brief Makes the parent redraw the element, which must be done whenever what it shows changes.
+	*/
+	void invalidate() { if (parent != nullptr) { parent->invalidate(); } }
+
+	/** Elements showing data that changes without them being told (such as a GuiListDataSource)
+	* look for changes here and invalidate() themselves if there are any. It is called before
+	* every composition of the parent.
+	*
+	* @brief Brings the element up to date with the data it shows.
+	*/
+	virtual void sync() {}
+
+	void setVisibility(bool visible);
+
 	virtual void render(TCODConsole* con) = 0;
 
 	~GuiElement();
@@ -144,23 +233,58 @@ public:
 	GuiTextBox(string id, int x, int y, int width, int height, string text, TCODColor fore, TCODColor back, TCOD_alignment_t alignment = TCOD_LEFT);
 	~GuiTextBox();
 
-	void setText(string text){ this->text = text; }
+	void setText(string text);
 	string getText(){ return text; }
 
-	void setAlignment(TCOD_alignment_t alignment){ this->alignment = alignment; }
+	void setAlignment(TCOD_alignment_t alignment){ this->alignment = alignment; invalidate(); }
 	TCOD_alignment_t getAlignment(){ return alignment; }
 
 	void render(TCODConsole* con);
 };
 
+/** The list owns copies of the items added to it, which suits short lists built by the GUI itself.
+* Long lists are better shown straight from the data of their owner, through a GuiListDataSource
+* of their own (see Body::getPartListSource()).
+*
+* @brief A GuiListDataSource owning its rows.
+*/
+class GuiItemList : public GuiListDataSource
+{
+private:
+	std::vector<GuiObjectLink*>* rows;
+	std::vector<GuiListRange>* changes;
+
+public:
+	/** @brief Appends a copy of the given item.
+	*/
+	void add(unsigned long long object_handle, const string& text, TCODColor fore, TCODColor back);
+
+	/** @brief Removes (and deletes) count rows starting at the given position.
+	*/
+	void remove(int first, int count);
+	void clear() { remove(0, getRowCount()); }
+
+	/** @brief Returns the index of the first row with the given text, or -1.
+	*/
+	int find(const string& text) const;
+
+	int getRowCount() const { return (int)rows->size(); }
+	const GuiObjectLink* getRow(int index) const { return rows->at(index); }
+	void takeChanges(std::vector<GuiListRange>* changes);
+
+	GuiItemList();
+	~GuiItemList();
+};
+
 /** There may be multiple active elements in a GUI, but only one can be the currently
 * active one (the one "in focus"), the class implements methods for handling/checking activation.
 * Since all GUI elements reacting to input are for choosing/selecting something,
 * this class defines colors for the selected items, while the element is active and while
 * it is inactive. 
 *
-* It also implements a vector of GuiObjectLink structs representing the items that may
-* be selected and functions for adding items and tracking their number (item_count).
+* The items that may be selected are read from a GuiListDataSource. By default, that is a
+* GuiItemList of the element's own, filled by addItem(), which copies the items; setDataSource()
+* makes the element show the rows of another source instead, without copying them.
 *
 * Since this is the base class, removeItem(), update(), getSelected() and render() are abstract and
 * must be implemented by the derived class for the specific implementation.
@@ -172,9 +296,6 @@ class ActiveGuiElement : public GuiElement
 protected:
 	bool active = false;
 
-	bool item_change = false; //Set true when changing item list
-							  // handle in update(), then set false
-	
 	//The colors for the selected item(s), when
 	// the Element is focus (active) and when it's not.
 	TCODColor sel_fore_active; 
@@ -182,8 +303,13 @@ protected:
 	TCODColor sel_fore_inactive;
 	TCODColor sel_back_inactive;
 
-	std::vector<GuiObjectLink*>* items;
-	int item_count = 0;
+	/** The items added by addItem(), which is the data source unless another one has been set.
+	*/
+	GuiItemList* items;
+
+	/** The source of the rows shown, either items or a source set by setDataSource() (not owned).
+	*/
+	GuiListDataSource* source;
 
 	int max_item_display = 0;
 
@@ -199,52 +325,80 @@ public:
 	virtual void makeActive();
 	virtual void makeInactive();
 
-	void setSelectionForeColorInactive(TCODColor color){ sel_fore_inactive = color; }
-	void setSelectionBackColorInactive(TCODColor color){ sel_back_inactive = color; }
-	void setSelectionForeColorActive(TCODColor color){ sel_fore_active = color; }
-	void setSelectionBackColorActive(TCODColor color){ sel_back_active = color; }
+	void setSelectionForeColorInactive(TCODColor color){ sel_fore_inactive = color; invalidate(); }
+	void setSelectionBackColorInactive(TCODColor color){ sel_back_inactive = color; invalidate(); }
+	void setSelectionForeColorActive(TCODColor color){ sel_fore_active = color; invalidate(); }
+	void setSelectionBackColorActive(TCODColor color){ sel_back_active = color; invalidate(); }
 
 	TCODColor getSelectionForeColorInactive() { return sel_fore_inactive; }
 	TCODColor getSelectionBackColorInactive() { return sel_back_inactive; }
 	TCODColor getSelectionForeColorActive() { return sel_fore_active; }
 	TCODColor getSelectionBackColorActive() { return sel_back_active; }
 
-	void addItem(std::string object_uuid, string text, TCODColor fore = gui_default_fore, TCODColor back = gui_default_back);
-	void addItem(std::string object_uuid, ColoredText* text);
+	void addItem(unsigned long long object_handle, string text, TCODColor fore = gui_default_fore, TCODColor back = gui_default_back);
+	void addItem(unsigned long long object_handle, ColoredText* text);
 
 	void addItems(std::vector<GuiObjectLink*>* list);
 
+	/** Makes the element show the rows of the given source instead of its own items. The source
+	* must stay alive as long as it is set; with the nullptr, the element shows its own items again.
+	* Changes of the source that are still pending are dropped, as the element starts over.
+	*/
+	virtual void setDataSource(GuiListDataSource* source);
+	GuiListDataSource* getDataSource() { return source; }
+
 	/* This has to be virtual, because the removed Item might be part of the
 	current selection, which needs to be handled in order to avoid having
-	the selection pointer pointing at a destroyed element!*/
+	the selection pointing at a destroyed element!*/
 	virtual bool removeItem(string text) = 0; 
 
-	int getItemCount(){ return item_count; }
+	int getItemCount(){ return source->getRowCount(); }
 	
 	virtual void update(TCOD_key_t key) = 0;
 
 	//There may be multiple Objects selected. Return the number
 	// of Objects and modify the parameter array within the function to 
-	// return the UUIDs of the selected Objects.
-	virtual int getSelected(std::vector<std::string>* obj_uuids) = 0;
+	// return the (packed) handles of the selected Objects.
+	virtual int getSelected(std::vector<unsigned long long>* obj_handles) = 0;
 
+	/** @brief Deletes the element's own items and shows them again, if another source was set.
+	*/
 	virtual void reset(){
-		//items->clearAndDelete();
-		items->erase(items->begin(), items->end());
-		item_count = 0;
-		item_change = true;
+		items->clear();
+		setDataSource(nullptr);
 	};
 };
 
-/**
+/** The list is virtualized: it only keeps the index of the selected row and of the first row on
+* screen, and reads the rows on screen from its data source when it renders. Rendering and moving
+* the selection therefore cost O(visible rows), however long the list is. Changes of the rows are
+* taken from the source, and the selection follows them.
+*
 * @brief A class representing a list of objects on the GUI, from which _one_ may be chosen.
 */
 class GuiListChooser : public ActiveGuiElement
 {
 protected:
-	GuiObjectLink* selected = nullptr;
 	int selected_index = 0;
 
+	/** The first row on screen, the rows above it are scrolled out of view.
+	*/
+	int first_visible = 0;
+
+	/** The changes taken from the source, kept to avoid reallocation.
+	*/
+	std::vector<GuiListRange>* changes;
+
+	/** Takes the changes from the source and moves the selection along, so it stays on the same row.
+	* If that row has been removed, the row following it (or the last row) is selected instead.
+	* The element is invalidated if there were any changes.
+	*/
+	void applyChanges();
+
+	/** Scrolls the least amount that brings the selected row on screen.
+	*/
+	void scrollToSelection();
+
 public:
 	GuiListChooser(string id, int x, int y, int width, int height,
 		int max_item_display,
@@ -253,17 +407,21 @@ public:
 		TCODColor sel_fore_inact, TCODColor sel_back_inact);
 	~GuiListChooser();
 
+	/** Removes the first of the element's own items with the given text.
+	*/
 	bool removeItem(string text);
 
+	/** Removes (and deletes) count of the element's own items starting at the given position. If the
+	* selected item is among them, the item following the removed ones (or the last item) is selected instead.
+	*/
+	void removeItems(int first, int count);
+
+	void setDataSource(GuiListDataSource* source);
+
+	void sync() { applyChanges(); }
+
 	void update(TCOD_key_t key);
-	int getSelected(std::vector<std::string>* obj_uuids);
-	void reset(){ 
-		selected = nullptr;
-		selected_index = 0;
-		items->erase(items->begin(), items->end());
-		item_count = 0; 
-		item_change = true; 
-	}
+	int getSelected(std::vector<unsigned long long>* obj_handles);
 
 	void render(TCODConsole* con);
 };
@@ -282,7 +440,6 @@ protected:
 	GuiTextBox* bp_info;
 	GuiListChooser* tissue_browser;
 
-	std::vector<GuiObjectLink*>* part_list;
 	std::vector<GuiObjectLink*>* tissue_list;
 
 	ActiveGuiElement* active_element;
@@ -293,27 +450,42 @@ public:
 	~GuiBodyViewer();
 
 	void activate(Body* b);
-	void render(TCODConsole* con);
 	void update(TCOD_key_t key);
 
 	Body* getActiveBody() { return body; };
 	
 };
 
-/** It contains a render function, which will draw every registered GuiContainer
+/** It contains a render function, which composites every visible GuiContainer
 * with all of its elements onto the given console.
 *
+* The Gui is retained: the target console is expected to keep what was drawn onto it, and every
+* container keeps its drawn surface. A frame only redraws the containers that have been invalidated
+* and only blits those that have been redrawn, or whose area of the target console has been painted
+* over (see invalidateRegion()) or uncovered. Containers hidden entirely beneath another one are not
+* drawn at all.
+*
 * @brief A class which provides Gui handling functions to the Engine.
 */
 class Gui
 {
 private:
 	//The active one, and all marked as dynamic are updated every turn
-	std::map<string, GuiContainer*>* containers;
+	SlotMap<GuiContainer>* containers;
 
 	GuiContainer* current_active = nullptr;
 
-	GuiContainer* getContainerFromUUID(string uuid);
+	/** The visible containers of the current frame, bottom to top, and those blitted so far.
+	* Kept to avoid reallocation.
+	*/
+	std::vector<GuiContainer*>* layers;
+	std::vector<GuiContainer*>* blitted;
+
+	/** Whether a container that was shown has been removed since the last takeExposed().
+	*/
+	bool removed_shown = false;
+
+	GuiContainer* getContainer(GuiContainerHandle handle);
 
 	const GuiContainer* getCurrentActiveContainer() { return current_active; }
 	void makeActive(GuiContainer* container);
@@ -321,15 +493,34 @@ public:
 	Gui();
 	~Gui();
 
+	/** Composites the visible containers onto the given console, bottom to top in z-order.
+	* Containers of the same z-order are drawn in the order they were added.
+	*/
 	void render(TCODConsole* con);
 
+	/** Tells the Gui that the given area of the console it renders onto has been painted over,
+	* so the containers overlapping it have to be blitted again.
+	*/
+	void invalidateRegion(int x, int y, int width, int height);
+
+	/** @brief Makes the next render() blit every visible container, e.g. after the console has been cleared.
+	*/
+	void invalidateAll();
+
+	/** Hidden and removed containers leave their last image on the console, which the Gui does not
+	* restore: whatever lies beneath them has to be drawn again by the caller.
+	*
+	* @return Whether a container has been hidden or removed since the last call.
+	*/
+	bool takeExposed();
+
 	/**@brief This function sends key input to the active container (window)
 	*/
 	void update(TCOD_key_t key);
 
-	void addContainer(GuiContainer* container);
-	bool removeContainer(string uuid);
-	bool makeActive(string uuid);
+	GuiContainerHandle addContainer(GuiContainer* container);
+	bool removeContainer(GuiContainerHandle handle);
+	bool makeActive(GuiContainerHandle handle);
 
 	/** This function is called when the engine switches out of the GameState::GUI state
 	* and closes all active elements (makes them invisible).
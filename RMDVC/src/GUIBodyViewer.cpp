@@ -14,7 +14,6 @@ GuiBodyViewer::GuiBodyViewer(string id, int x, int y,
 	//tissue_list = new std::vector<GuiObjectLink*>();
 
 	//Declare GUI Parts
-	//TODO: Make GuiListChooser scrollable, set active element!
 	bp_browser = new GuiListChooser("listChooser_BodyViewer_BPBrowser", 
 		1, 1,
 		(int)(width / 2), height - 2,
@@ -48,7 +47,6 @@ GuiBodyViewer::~GuiBodyViewer()
 	//TODO: Remove GuiObjectLink elements?
 	//delete part_list;
 	//delete tissue_list;
-	part_list = nullptr;
 	tissue_list = nullptr;
 
 	//Destroy GUI Parts
@@ -61,9 +59,9 @@ void GuiBodyViewer::setActiveBody(Body* b)
 {
 	if (b != nullptr) { body = b; }
 
-	//Fill BP_Browser with Parts
-	part_list = b->getPartGUIList();
-	bp_browser->addItems(part_list);
+	//The BP_Browser shows the part list of the Body as it is, following its changes.
+	// Earlier changes are dropped, as the list is shown from the start.
+	bp_browser->setDataSource(body->getPartListSource());
 }
 
 void GuiBodyViewer::activate(Body* b)
@@ -83,25 +81,25 @@ void GuiBodyViewer::update(TCOD_key_t key)
 	if (active_element == bp_browser)
 	{
 		//Retrieve currently selected Part from bp_browser
-		std::vector<std::string>* p_uuid = new std::vector<std::string>();
-		if (bp_browser->getSelected(p_uuid) != 1)
+		std::vector<unsigned long long>* p_handle = new std::vector<unsigned long long>();
+		if (bp_browser->getSelected(p_handle) != 1)
 		{
 			debug_error("ERROR: Expected only one string from GuiListChooser->getSelected(x)!");
 			return;
 		}
 
-		if (p_uuid->size() == 0)
+		if (p_handle->size() == 0)
 		{
-			debug_error("ERROR: Expected a string from GuiListChooser->getSelected(x), but returned vector is empty!");
+			debug_error("ERROR: Expected a handle from GuiListChooser->getSelected(x), but returned vector is empty!");
 			return;
 		}
 
-		std::string uuid = p_uuid->at(0);
+		PartHandle handle = PartHandle::fromRaw(p_handle->at(0));
 
-		Part* p = body->getPartByUUID(uuid).get();
+		Part* p = body->getPartByHandle(handle).get();
 		if (p == nullptr) 
 		{ 
-			debug_error("ERROR: No Part could be resolved from UUID %s.", uuid.c_str());
+			debug_error("ERROR: No Part could be resolved from handle %u.", handle.index);
 			return;
 		}
 
@@ -126,29 +124,30 @@ void GuiBodyViewer::update(TCOD_key_t key)
 			
 			Organ* o = (Organ*)p;
 			temp_info.append("\n\nBodyPart: ");
-			temp_info.append(body->getPartByUUID(o->getSuperPartUUID())->getName().c_str());
+			temp_info.append(body->getPartByHandle(o->getSuperPart())->getName().c_str());
 			temp_info.append("\nSurface Area: ");
 			temp_info.append(std::to_string((int)(o->getSurface() * 100)));
 			
 			temp_info.append("%%\nConnector: ");
-			if (o->getConnectorUUID() != "") {
-				temp_info.append(body->getPartByUUID(o->getConnectorUUID())->getName().c_str());
+			if (o->getConnector().isValid()) {
+				temp_info.append(body->getPartByHandle(o->getConnector())->getName().c_str());
 			}
 			else {
 				temp_info.append("None [Root Organ]");
 			}
 			temp_info.append("\nConnected Organs:");
 
-			//Add Connectees (derive from UUID list returned by o->getConnectedOrganUUIDs())
-			std::vector<std::string>* temp = o->getConnectedOrgansRW();
+			//Add Connectees (derive from handle list returned by o->getConnectedOrgans())
+			std::vector<PartHandle>* temp = o->getConnectedOrgans();
 
-			for (std::vector<std::string>::iterator it = temp->begin(); it != temp->end(); it++)
+			for (std::vector<PartHandle>::iterator it = temp->begin(); it != temp->end(); it++)
 			{
-				if (*it == "") { continue; }
 				temp_info.append("\n  ");
-				temp_info.append(body->getPartByUUID(*it)->getName().c_str());
+				temp_info.append(body->getPartByHandle(*it)->getName().c_str());
 			}
 
+			delete temp;
+
 			if (o->isStump()){
 				temp_info.append("\n\nOrgan is a stump.");
 			}
@@ -160,24 +159,11 @@ void GuiBodyViewer::update(TCOD_key_t key)
 		//Handle "special" debug input
 #ifdef _DEBUG
 		if (key.vk == TCODK_DELETE){ 
-			body->removePart(uuid); 
-			activate(body);
+			body->removePart(handle); 
 		}
 		
 #endif
 		//Cleanup
-		delete p_uuid;
+		delete p_handle;
 	}
 }
-
-
-void GuiBodyViewer::render(TCODConsole* con) 
-{
-	renderSelf(con);
-
-	bp_browser->render(container_console);
-	bp_info->render(container_console);
-	tissue_browser->render(container_console);
-
-	TCODConsole::blit(container_console, 0, 0, 0, 0, con, pos_x, pos_y);
-}
\ No newline at end of file
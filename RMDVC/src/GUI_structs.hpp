@@ -5,6 +5,7 @@
 #include "Object.hpp"
 #include <string>
 #include <memory>
+#include <vector>
 
 using std::string;
 
@@ -70,9 +71,11 @@ public:
 
 /** This struct is for use with ActiveGuiElement instances which present some form
 * of list of objects. It provides a convenient way of linking (for example)
-* game entities to thier associated list entry by associating their UUID with a ColoredText.
+* game entities to thier associated list entry by associating their handle with a ColoredText.
+* Since the list elements are not specific to one kind of object, the handle is stored in its
+* packed form (see Handle::toRaw()) and must be unpacked by the user of the list.
 *
-* @brief A struct encapsulating an Objects UUID and a pointer to an associated ColoredText.
+* @brief A struct encapsulating an Objects handle and a pointer to an associated ColoredText.
 */
 struct GuiObjectLink
 {
@@ -81,17 +84,64 @@ private:
 	template<class Archive>
 	void serialize(Archive & ar, const unsigned int version)
 	{
-		ar & BOOST_SERIALIZATION_NVP(object_uuid);
+		ar & BOOST_SERIALIZATION_NVP(object_handle);
 		ar & BOOST_SERIALIZATION_NVP(text);
 	}
 
 public:
-	std::string object_uuid;
+	unsigned long long object_handle;
 	ColoredText* text;
 
-	GuiObjectLink(std::string uuid, ColoredText* t){ object_uuid = uuid; text = t; };
+	GuiObjectLink(unsigned long long handle, ColoredText* t){ object_handle = handle; text = t; };
 	GuiObjectLink(){};
 	~GuiObjectLink(){ delete text; };
 };
 
+/** The kinds of changes of a list of GuiObjectLinks, see GuiListRange.
+*/
+enum GuiListChangeType {
+	GUI_LIST_REMOVED,
+	GUI_LIST_INSERTED,
+	SIZE_OF_GUI_LIST_CHANGE_TYPE_ENUM
+};
+
+/** Lists of GuiObjectLinks that change after they have been handed to the GUI report the change as
+* ranges of removed or inserted entries, so the GUI can follow it (e.g. keep the selection on the same
+* entry) instead of starting over. The ranges of one change are applied in order, every range refers
+* to the list with the previous ones already applied.
+*
+* @brief A struct describing a range of consecutive entries of a list of GuiObjectLinks.
+*/
+struct GuiListRange
+{
+	GuiListChangeType type;
+	int first;
+	int count;
+
+	GuiListRange(int first, int count, GuiListChangeType type = GUI_LIST_REMOVED) : type(type), first(first), count(count) {};
+};
+
+/** A virtualized list (see GuiListChooser) does not copy the rows it shows: it asks its source for the
+* number of rows and for the few rows on screen when it renders, and follows the changes of the rows
+* by taking them from the source (see GuiListRange). The rows stay owned by the source.
+*
+* @brief The interface through which GUI lists read their rows.
+*/
+class GuiListDataSource
+{
+public:
+	virtual int getRowCount() const = 0;
+
+	/** Returns the row at the given index (in [0, getRowCount())). The pointer is valid until the rows change.
+	*/
+	virtual const GuiObjectLink* getRow(int index) const = 0;
+
+	/** Moves the changes of the rows since the last call into the given vector (which is cleared
+	* beforehand). Only one list can follow the changes of a source.
+	*/
+	virtual void takeChanges(std::vector<GuiListRange>* changes) = 0;
+
+	virtual ~GuiListDataSource() {};
+};
+
 #endif
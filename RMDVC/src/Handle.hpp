@@ -0,0 +1,222 @@
+#ifndef HANDLE_HPP
+#define HANDLE_HPP
+
+#include <vector>
+#include <cassert>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/vector.hpp>
+
+/** A handle consists of the index of a slot in a SlotMap and the generation of that slot at
+* the time the object was inserted. When the object is removed and the slot is reused, the
+* generation of the slot changes and all handles still referring to the old object become stale,
+* which the SlotMap detects on lookup.
+*
+* The type parameter is only used to keep handles to different kinds of objects apart at
+* compile time (an ActorHandle cannot be passed where a PartHandle is expected).
+* Handles are cheap to copy and compare, and resolving them neither hashes nor allocates.
+* For persistence and debug output, the string UUID of the Object is used instead.
+*
+* @brief A generational index referring to an object in a SlotMap.
+*/
+template<class T>
+struct Handle
+{
+private:
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version)
+	{
+		ar & BOOST_SERIALIZATION_NVP(index);
+		ar & BOOST_SERIALIZATION_NVP(generation);
+	}
+
+public:
+	unsigned int index;
+
+	/**The generation of the slot. Valid generations start at 1, so a
+	* default-constructed handle (generation 0) never refers to an object.
+	*/
+	unsigned int generation;
+
+	Handle() : index(0), generation(0) {};
+	Handle(unsigned int index, unsigned int generation) : index(index), generation(generation) {};
+
+	/**@brief Returns false for a default-constructed ("null") handle.
+	*/
+	bool isValid() const { return generation != 0; }
+
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+	bool operator<(const Handle& other) const
+	{
+		if (index != other.index) { return index < other.index; }
+		return generation < other.generation;
+	}
+
+	/**@brief Packs the handle into a single integer, e.g. for storage in untyped GUI links.
+	*/
+	unsigned long long toRaw() const { return ((unsigned long long)generation << 32) | index; }
+
+	/**@brief Unpacks a handle packed by toRaw().
+	*/
+	static Handle fromRaw(unsigned long long raw)
+	{
+		return Handle((unsigned int)(raw & 0xFFFFFFFFULL), (unsigned int)(raw >> 32));
+	}
+};
+
+/** Values are stored in a vector of slots. Removing a value puts its slot on a free list, from
+* which it is reused by later insertions with an increased generation. Insertion, removal and
+* lookup are O(1). Slot indices are handed out in insertion order as long as nothing was removed,
+* so objects inserted in a meaningful order (such as the depth-first order of the Parts of a Body)
+* can be iterated in that order via the slot accessors.
+*
+* @brief A registry resolving generational handles to values.
+*/
+template<class T, class V = T*>
+class SlotMap
+{
+private:
+	struct Slot
+	{
+	private:
+		friend class boost::serialization::access;
+		template<class Archive>
+		void serialize(Archive & ar, const unsigned int version)
+		{
+			ar & BOOST_SERIALIZATION_NVP(value);
+			ar & BOOST_SERIALIZATION_NVP(generation);
+			ar & BOOST_SERIALIZATION_NVP(occupied);
+		}
+
+	public:
+		V value;
+		unsigned int generation;
+		bool occupied;
+
+		Slot() : value(), generation(0), occupied(false) {};
+	};
+
+	std::vector<Slot> slots;
+	std::vector<unsigned int> free_slots;
+	size_t count;
+
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version)
+	{
+		ar & BOOST_SERIALIZATION_NVP(slots);
+		ar & BOOST_SERIALIZATION_NVP(free_slots);
+		ar & BOOST_SERIALIZATION_NVP(count);
+	}
+
+public:
+	/**@brief Stores the value in a free slot and returns the handle to it.
+	*/
+	Handle<T> insert(const V& value)
+	{
+		unsigned int index;
+		if (!free_slots.empty())
+		{
+			index = free_slots.back();
+			free_slots.pop_back();
+		}
+		else {
+			index = (unsigned int)slots.size();
+			slots.push_back(Slot());
+		}
+
+		Slot& slot = slots[index];
+		slot.generation++;
+		//Skip the "null" generation on wrap-around
+		if (slot.generation == 0) { slot.generation = 1; }
+
+		slot.value = value;
+		slot.occupied = true;
+		count++;
+
+		return Handle<T>(index, slot.generation);
+	}
+
+	/**@brief Removes the value the handle refers to. Returns false if the handle is stale.
+	*/
+	bool remove(Handle<T> handle)
+	{
+		if (!contains(handle)) { return false; }
+
+		Slot& slot = slots[handle.index];
+		slot.value = V();
+		slot.occupied = false;
+		free_slots.push_back(handle.index);
+		count--;
+
+		return true;
+	}
+
+	/**@brief Returns true if the handle refers to a value stored in this SlotMap.
+	*/
+	bool contains(Handle<T> handle) const
+	{
+		return handle.index < slots.size()
+			&& slots[handle.index].occupied
+			&& slots[handle.index].generation == handle.generation;
+	}
+
+	/**@brief Returns a pointer to the value the handle refers to, or the nullptr if the handle is stale.
+	*/
+	V* get(Handle<T> handle)
+	{
+		if (!contains(handle)) { return nullptr; }
+		return &slots[handle.index].value;
+	}
+
+	/**@brief Returns a copy of the value the handle refers to, or a default-constructed value
+	* (i.e. the nullptr for pointers) if the handle is stale.
+	*/
+	V lookup(Handle<T> handle) const
+	{
+		if (!contains(handle)) { return V(); }
+		return slots[handle.index].value;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	void clear()
+	{
+		slots.clear();
+		free_slots.clear();
+		count = 0;
+	}
+
+	/**@brief Returns the number of slots (occupied or not), i.e. the upper bound for slot indices.
+	*/
+	size_t getSlotCount() const { return slots.size(); }
+
+	bool isSlotOccupied(size_t index) const { return slots[index].occupied; }
+
+	/**@brief Returns the handle to the value in the given (occupied) slot.
+	*/
+	Handle<T> getHandleAt(size_t index) const
+	{
+		assert(slots[index].occupied);
+		return Handle<T>((unsigned int)index, slots[index].generation);
+	}
+
+	V& getAt(size_t index) { return slots[index].value; }
+	const V& getAt(size_t index) const { return slots[index].value; }
+
+	SlotMap() : count(0) {};
+};
+
+class Actor;
+class Part;
+class GuiContainer;
+
+typedef Handle<Actor> ActorHandle;
+typedef Handle<Part> PartHandle;
+typedef Handle<GuiContainer> GuiContainerHandle;
+
+#endif
@@ -0,0 +1,135 @@
+#include "HitLocationSampler.hpp"
+#include "Trace.hpp"
+
+void AliasTable::build(const std::vector<float>& weights)
+{
+	int n = (int)weights.size();
+	probability.assign(n, 1.0f);
+	alias.resize(n);
+	for (int i = 0; i < n; i++) { alias[i] = i; }
+
+	if (n == 0) { return; }
+
+	double sum = 0.0;
+	for (int i = 0; i < n; i++) { if (weights[i] > 0.0f) { sum += weights[i]; } }
+
+	//Scale the weights so the average is 1, then fill every column that is below average
+	// with a part of one that is above
+	std::vector<double> scaled(n);
+	std::vector<int> small, large;
+
+	for (int i = 0; i < n; i++)
+	{
+		scaled[i] = sum > 0.0 ? std::max(weights[i], 0.0f) * n / sum : 1.0;
+		(scaled[i] < 1.0 ? small : large).push_back(i);
+	}
+
+	while (!small.empty() && !large.empty())
+	{
+		int s = small.back();
+		small.pop_back();
+		int l = large.back();
+		large.pop_back();
+
+		probability[s] = (float)scaled[s];
+		alias[s] = l;
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+		(scaled[l] < 1.0 ? small : large).push_back(l);
+	}
+
+	//What is left is (up to rounding errors) exactly average and keeps its own outcome
+}
+
+HitLocationSampler::HitLocationSampler(const Body* body) : body(body), build_count(0)
+{
+	int count = body->getLayout()->getPartCount();
+
+	tables.resize(count);
+	stale.assign(count, true);
+	children.resize(count);
+}
+
+void HitLocationSampler::build(int index)
+{
+	TRACE_ZONE("HitLocationSampler::build");
+
+	const BodyLayout* layout = body->getLayout();
+	weights.clear();
+
+	if (layout->getType(index) == TYPE_ORGAN)
+	{
+		for (int t = layout->getTissueBegin(index); t < layout->getTissueEnd(index); t++)
+		{
+			weights.push_back(layout->getTissue(t).hit_prob);
+		}
+	}
+	else
+	{
+		children[index].clear();
+
+		for (int c = layout->getFirstChild(index); c != BodyLayout::NO_PART; c = layout->getNextSibling(c))
+		{
+			if (body->isRemovedAt(c)) { continue; }
+
+			children[index].push_back(c);
+			weights.push_back(layout->getSurface(c));
+		}
+	}
+
+	tables[index].build(weights);
+	stale[index] = false;
+	build_count++;
+}
+
+void HitLocationSampler::partsRemoved(const std::vector<int>& removed)
+{
+	const BodyLayout* layout = body->getLayout();
+
+	for (auto it = removed.begin(); it != removed.end(); it++)
+	{
+		int super = layout->getParent(*it);
+		if (super != BodyLayout::NO_PART && !body->isRemovedAt(super)) { stale[super] = true; }
+	}
+}
+
+bool HitLocationSampler::sample(RandomStream* rng, HitLocation* result, int start)
+{
+	const BodyLayout* layout = body->getLayout();
+	if (body->isRemovedAt(start)) { return false; }
+
+	//Every remaining BodyPart has at least one remaining child, otherwise it would have been removed
+	int index = start;
+	while (layout->getType(index) == TYPE_BODYPART)
+	{
+		const AliasTable& table = getTable(index);
+		if (table.isEmpty()) { return false; }
+
+		index = children[index][table.sample(rng)];
+	}
+
+	const AliasTable& table = getTable(index);
+
+	result->organ = index;
+	result->body_part = layout->getParent(index);
+	result->tissue = table.isEmpty() ? -1 : table.sample(rng);
+
+	return true;
+}
+
+int HitLocationSampler::sampleBatch(RandomStream* rng, int count, std::vector<HitLocation>* result, int start)
+{
+	if (body->isRemovedAt(start)) { return 0; }
+
+	size_t first = result->size();
+	result->resize(first + count);
+
+	int drawn = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (sample(rng, &(*result)[first + drawn], start)) { drawn++; }
+	}
+
+	result->resize(first + drawn);
+	return drawn;
+}
@@ -0,0 +1,132 @@
+#ifndef HITLOCATIONSAMPLER_HPP
+#define HITLOCATIONSAMPLER_HPP
+
+#include "libtcod.hpp"
+#include "Body.hpp"
+#include "Random.hpp"
+
+#include <vector>
+
+/** The table is built with Walker's alias method (in Vose's variant): every outcome gets a column
+* of equal probability, which is split between the outcome itself and one "alias" outcome, so drawing
+* an outcome takes one uniform column and one biased coin flip, independent of the number of outcomes.
+*
+* @brief A table for drawing one of several weighted outcomes in O(1).
+*/
+class AliasTable
+{
+private:
+	/** The probability of the column's own outcome; otherwise the alias is drawn.
+	*/
+	std::vector<float> probability;
+	std::vector<int> alias;
+
+public:
+	/** Builds the table for the given weights in O(n). Negative weights count as 0; if no weight
+	* is positive, all outcomes are equally likely.
+	*/
+	void build(const std::vector<float>& weights);
+
+	/** @brief Draws an outcome (the index of its weight). The table must not be empty.
+	*/
+	int sample(RandomStream* rng) const
+	{
+		int column = rng->getInt(0, (int)probability.size() - 1);
+		return rng->getFloat(0.0f, 1.0f) < probability[column] ? column : alias[column];
+	}
+
+	int getSize() const { return (int)probability.size(); }
+	bool isEmpty() const { return probability.empty(); }
+};
+
+/** @brief The location a blow hits: an Organ, the BodyPart it belongs to and one of its tissues.
+*/
+struct HitLocation {
+	/** The layout indices of the Organ and of the BodyPart holding it.
+	*/
+	int body_part;
+	int organ;
+
+	/** The index of the tissue within the Organ (see Organ::getTissue()), or -1 if it has none.
+	*/
+	int tissue;
+
+	HitLocation() : body_part(BodyLayout::NO_PART), organ(BodyLayout::NO_PART), tissue(-1) {};
+};
+
+/** A hit is resolved by descending the part tree from a BodyPart: at every BodyPart, one of its
+* remaining children is drawn by relative surface (see Part::getSurface()), until an Organ is reached,
+* whose tissue is drawn by the hit probabilities of its tissue definitions. Every level takes one draw
+* from an AliasTable.
+*
+* The table of a Part is built the first time a hit passes it. When Parts are removed, only the
+* tables of the BodyParts that lost children are rebuilt (on their next use); the tables of the
+* Organs never change, as their tissues are fixed by the layout.
+*
+* @brief Draws hit locations on a Body, weighted by surface and tissue hit probability.
+*/
+class HitLocationSampler
+{
+private:
+	const Body* body;
+
+	/** The table of every Part, indexed like the layout: over the remaining children for
+	* BodyParts, over the tissues for Organs. Only valid where stale is not set.
+	*/
+	std::vector<AliasTable> tables;
+	std::vector<bool> stale;
+
+	/** The layout indices of the children of every BodyPart, in the order of the outcomes of its table.
+	*/
+	std::vector<std::vector<int>> children;
+
+	/** The weights of the table being built, kept to avoid reallocation.
+	*/
+	std::vector<float> weights;
+
+	unsigned long long build_count;
+
+	void build(int index);
+
+	const AliasTable& getTable(int index)
+	{
+		if (stale[index]) { build(index); }
+		return tables[index];
+	}
+
+public:
+	/** The layout index of the root BodyPart, which is the first Part in depth-first order.
+	*/
+	static const int ROOT = 0;
+
+	/** Marks the tables of the (remaining) super parts of the given removed Parts as stale.
+	* This is called by Body::removeParts().
+	*
+	* @param removed The layout indices of the removed Parts.
+	*/
+	void partsRemoved(const std::vector<int>& removed);
+
+	/** Draws the location of a hit on the given (remaining) Part and below it.
+	*
+	* @param rng The random number generator to draw with.
+	* @param result The location, if one could be drawn.
+	* @param start The layout index of the Part that is hit, ROOT for the whole body.
+	* @return false if the Part has been removed.
+	*/
+	bool sample(RandomStream* rng, HitLocation* result, int start = ROOT);
+
+	/** Draws the locations of many hits on the same Part at once, e.g. for area damage.
+	* The locations are appended to the result vector.
+	*
+	* @return The number of locations drawn (0 if the Part has been removed).
+	*/
+	int sampleBatch(RandomStream* rng, int count, std::vector<HitLocation>* result, int start = ROOT);
+
+	/** @brief Returns the number of tables built (or rebuilt) so far.
+	*/
+	unsigned long long getBuildCount() const { return build_count; }
+
+	HitLocationSampler(const Body* body);
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "Input.hpp"
+
+#include <cstring>
+
+TCOD_key_t makeKey(TCOD_keycode_t vk, char c)
+{
+	TCOD_key_t key;
+	memset(&key, 0, sizeof(key));
+
+	key.vk = vk;
+	key.c = c;
+	key.pressed = true;
+
+	return key;
+}
+
+TCOD_key_t KeyboardInput::nextKey()
+{
+	TCOD_key_t key;
+	TCODSystem::waitForEvent(TCOD_EVENT_KEY_PRESS, &key, nullptr, true);
+	return key;
+}
+
+bool KeyboardInput::pollKey(TCOD_key_t* key)
+{
+	TCOD_key_t pressed;
+	if ((TCODSystem::checkForEvent(TCOD_EVENT_KEY_PRESS, &pressed, nullptr) & TCOD_EVENT_KEY_PRESS) == 0) { return false; }
+
+	*key = pressed;
+	return true;
+}
+
+ScriptedInput::ScriptedInput(bool loop) : position(0), loop(loop)
+{
+	keys = new std::vector<TCOD_key_t>();
+}
+
+ScriptedInput::~ScriptedInput()
+{
+	delete keys;
+}
+
+void ScriptedInput::addKey(TCOD_keycode_t vk)
+{
+	keys->push_back(makeKey(vk));
+}
+
+void ScriptedInput::addChar(char c)
+{
+	keys->push_back(makeKey(TCODK_CHAR, c));
+}
+
+TCOD_key_t ScriptedInput::nextKey()
+{
+	if (position >= keys->size())
+	{
+		if (!loop || keys->empty()) { return makeKey(TCODK_NONE); }
+		position = 0;
+	}
+
+	return keys->at(position++);
+}
+
+RandomInput::RandomInput(const RandomStream& rng) : rng(rng)
+{
+}
+
+RandomInput::~RandomInput()
+{
+}
+
+TCOD_key_t RandomInput::nextKey()
+{
+	static const TCOD_keycode_t directions[] = { TCODK_UP, TCODK_DOWN, TCODK_LEFT, TCODK_RIGHT };
+	return makeKey(directions[rng.getInt(0, 3)]);
+}
@@ -0,0 +1,88 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include "libtcod.hpp"
+#include "Random.hpp"
+
+#include <vector>
+
+/** The Engine reads all its input through an InputSource, so it can be driven by the keyboard,
+* by a script or randomly (e.g. in headless mode, where there is no window to read keys from).
+*
+* @brief Base class for all sources of key input.
+*/
+class InputSource
+{
+public:
+	/**@brief Returns the next key. Blocks until one is available if the source is interactive.
+	*/
+	virtual TCOD_key_t nextKey() = 0;
+
+	/**Returns the next key if one is available right away, without blocking. Sources that are not
+	* interactive always have a key available, so by default this is nextKey().
+	*
+	* @return false if no key is available, in which case key is not modified.
+	*/
+	virtual bool pollKey(TCOD_key_t* key) { *key = nextKey(); return true; }
+
+	virtual ~InputSource() {};
+};
+
+/** @brief An InputSource that waits for key presses in the root console window.
+*/
+class KeyboardInput : public InputSource
+{
+public:
+	TCOD_key_t nextKey();
+	bool pollKey(TCOD_key_t* key);
+};
+
+/** The keys are returned in the order they were added. When all keys have been returned,
+* the script starts over if it loops; otherwise, TCODK_NONE is returned from then on.
+*
+* @brief An InputSource that replays a fixed sequence of keys.
+*/
+class ScriptedInput : public InputSource
+{
+private:
+	std::vector<TCOD_key_t>* keys;
+	size_t position;
+	bool loop;
+
+public:
+	/**@brief Appends a special key (such as TCODK_UP) to the script.
+	*/
+	void addKey(TCOD_keycode_t vk);
+
+	/**@brief Appends a character key to the script.
+	*/
+	void addChar(char c);
+
+	TCOD_key_t nextKey();
+
+	ScriptedInput(bool loop = true);
+	~ScriptedInput();
+};
+
+/** @brief An InputSource that returns random arrow keys, i.e. lets the player wander around.
+*/
+class RandomInput : public InputSource
+{
+private:
+	RandomStream rng;
+
+public:
+	TCOD_key_t nextKey();
+
+	/**@param rng The stream to draw the keys from, e.g. the RANDOM_INPUT stream of the RandomService,
+	*	so runs can be repeated.
+	*/
+	RandomInput(const RandomStream& rng);
+	~RandomInput();
+};
+
+/**@brief Returns a TCOD_key_t for a key press of the given special key.
+*/
+TCOD_key_t makeKey(TCOD_keycode_t vk, char c = 0);
+
+#endif
@@ -0,0 +1,489 @@
+#include "Journal.hpp"
+#include "Action.hpp"
+#include "Actor.hpp"
+#include "Map.hpp"
+#include "Body.hpp"
+#include "Destructible.hpp"
+#include "Diagnostics.hpp"
+#include "Trace.hpp"
+
+#include <boost/uuid/uuid_io.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+void Journal::writeActor(const Actor* actor)
+{
+	write(actor->getRawUUID().data, 16);
+}
+
+void Journal::recordMove(const Actor* actor)
+{
+	writeValue<unsigned char>(JOURNAL_MOVE);
+	writeActor(actor);
+	writeValue<int>(actor->getPosX());
+	writeValue<int>(actor->getPosY());
+}
+
+void Journal::recordSchedule(Action* action, bool player_action)
+{
+	int d_x = 0, d_y = 0;
+	if (action->getActionType() == ACTION_MOVE)
+	{
+		MoveAction* move = static_cast<MoveAction*>(action);
+		d_x = move->getDeltaX();
+		d_y = move->getDeltaY();
+	}
+
+	writeValue<unsigned char>(JOURNAL_SCHEDULE);
+	writeActor(action->getActor());
+	writeValue<int>(action->getActionType());
+	writeValue<int>(d_x);
+	writeValue<int>(d_y);
+	writeValue<unsigned char>(player_action ? 1 : 0);
+}
+
+void Journal::recordDequeue()
+{
+	writeValue<unsigned char>(JOURNAL_DEQUEUE);
+}
+
+void Journal::recordPartRemoval(const Actor* actor, const PartRemovalResult& result)
+{
+	if (result.removed.empty()) { return; }
+
+	writeValue<unsigned char>(JOURNAL_PART_REMOVAL);
+	writeActor(actor);
+	writeValue<int>((int)result.removed.size());
+	write(result.removed.data(), result.removed.size() * sizeof(int));
+}
+
+void Journal::recordTurnEnd(const RandomState& random)
+{
+	writeValue<unsigned char>(JOURNAL_TURN_END);
+	writeValue<unsigned int>(random.seed);
+	writeValue<int>((int)random.streams.size());
+	for (auto it = random.streams.begin(); it != random.streams.end(); it++)
+	{
+		writeValue<unsigned long long>(it->getState());
+	}
+}
+
+std::string* Journal::takeRecords()
+{
+	std::string* taken = records;
+	records = new std::string();
+	return taken;
+}
+
+/** Reads the records of a journal front to back. All reads fail once the end has been reached,
+* so a record cut off by a crash is detected, not misread.
+*/
+class JournalReader
+{
+private:
+	const char* pos;
+	const char* end;
+
+public:
+	bool read(void* data, size_t size)
+	{
+		if ((size_t)(end - pos) < size) { return false; }
+		memcpy(data, pos, size);
+		pos += size;
+		return true;
+	}
+
+	template<class T>
+	bool readValue(T* value) { return read(value, sizeof(T)); }
+
+	bool readUUID(std::string* uuid)
+	{
+		boost::uuids::uuid id;
+		if (!read(id.data, 16)) { return false; }
+		*uuid = boost::uuids::to_string(id);
+		return true;
+	}
+
+	const char* getPos() const { return pos; }
+
+	JournalReader(const char* begin, const char* end) : pos(begin), end(end) {};
+};
+
+/** A record as read from a journal.
+*/
+struct JournalRecord {
+	unsigned char type;
+	std::string uuid;
+	int a, b, c;
+	unsigned char flag;
+	std::vector<int> indices;
+	RandomState random;
+};
+
+static bool readRecord(JournalReader* reader, JournalRecord* record)
+{
+	if (!reader->readValue(&record->type)) { return false; }
+
+	switch (record->type)
+	{
+	case JOURNAL_MOVE:
+		return reader->readUUID(&record->uuid) && reader->readValue(&record->a) && reader->readValue(&record->b);
+	case JOURNAL_SCHEDULE:
+		return reader->readUUID(&record->uuid) && reader->readValue(&record->a) && reader->readValue(&record->b)
+			&& reader->readValue(&record->c) && reader->readValue(&record->flag);
+	case JOURNAL_DEQUEUE:
+		return true;
+	case JOURNAL_PART_REMOVAL:
+	{
+		int count = 0;
+		if (!reader->readUUID(&record->uuid) || !reader->readValue(&count) || count < 0) { return false; }
+		record->indices.resize(count);
+		return count == 0 || reader->read(record->indices.data(), count * sizeof(int));
+	}
+	case JOURNAL_TURN_END:
+	{
+		int count = 0;
+		if (!reader->readValue(&record->random.seed) || !reader->readValue(&count) || count < 0) { return false; }
+		record->random.streams.clear();
+		for (int i = 0; i < count; i++)
+		{
+			unsigned long long state;
+			if (!reader->readValue(&state)) { return false; }
+			record->random.streams.push_back(RandomStream(state));
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+static bool applyRecord(const JournalRecord& record, SaveGameData* data)
+{
+	if (record.type == JOURNAL_DEQUEUE)
+	{
+		if (data->scheduler->getQueueSize() == 0) { return false; }
+		delete data->scheduler->nextAction();
+		return true;
+	}
+	if (record.type == JOURNAL_TURN_END)
+	{
+		data->random = record.random;
+		return true;
+	}
+
+	Actor* actor;
+	try {
+		actor = data->actors->getActorByUUID(record.uuid);
+	}
+	catch (std::out_of_range&) {
+		debug_error("ERROR while replaying the journal: unknown Actor %s\n", record.uuid.c_str());
+		return false;
+	}
+
+	switch (record.type)
+	{
+	case JOURNAL_MOVE:
+		data->actors->moveActor(actor->getHandle(), record.a, record.b);
+		return true;
+	case JOURNAL_SCHEDULE:
+	{
+		Action* action;
+		if (record.a == ACTION_MOVE) { action = new MoveAction(actor, data->map, data->actors, record.b, record.c); }
+		else if (record.a == ACTION_IDLE) { action = new IdleAction(actor); }
+		else { return false; }
+
+		data->scheduler->scheduleAction(action, record.flag != 0);
+		return true;
+	}
+	case JOURNAL_PART_REMOVAL:
+	{
+		if (actor->destructible == nullptr || actor->destructible->body == nullptr) { return false; }
+		Body* body = actor->destructible->body;
+
+		//The handles are resolved before anything is removed, as removeParts() skips stale ones
+		std::vector<PartHandle> handles;
+		for (auto it = record.indices.begin(); it != record.indices.end(); it++)
+		{
+			handles.push_back(body->getHandleAt(*it));
+		}
+		body->removeParts(&handles);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool Journal::replay(const std::string& records, SaveGameData* data, int* turns)
+{
+	const char* begin = records.data();
+	const char* end = begin + records.size();
+	*turns = 0;
+
+	//Only the records up to the last turn end are applied, a turn cut off by a crash is dropped
+	const char* complete = begin;
+	JournalReader scan(begin, end);
+	JournalRecord record;
+	while (readRecord(&scan, &record))
+	{
+		if (record.type == JOURNAL_TURN_END) { complete = scan.getPos(); }
+	}
+
+	JournalReader reader(begin, complete);
+	while (readRecord(&reader, &record))
+	{
+		if (!applyRecord(record, data)) { return false; }
+		if (record.type == JOURNAL_TURN_END) { (*turns)++; }
+	}
+
+	return true;
+}
+
+Autosave::Autosave(const std::string& path, int snapshot_interval) :
+	snapshot_filename(path + ".bin"), journal_filename(path + ".journal"),
+	snapshot_interval(snapshot_interval), turns_since_snapshot(0), snapshot_requested(true),
+	journal(new Journal()), stopping(false), writing(false), snapshot_failed(false), journal_generation(0)
+{
+	//Generations continue from the autosave on disk, so its journal never matches a new snapshot
+	generation = readGeneration(snapshot_filename);
+	unsigned int old_journal = readGeneration(journal_filename);
+	if (old_journal > generation) { generation = old_journal; }
+
+	writer = std::thread(&Autosave::work, this);
+}
+
+Autosave::~Autosave()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobs_changed.notify_all();
+	writer.join();
+
+	delete journal;
+}
+
+unsigned int Autosave::readGeneration(const std::string& filename)
+{
+	std::ifstream ifs(filename, std::ios::binary);
+	unsigned int generation = 0;
+	ifs.read((char*)&generation, sizeof(generation));
+	return ifs ? generation : 0;
+}
+
+void Autosave::enqueue(const Job& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	jobs_changed.notify_all();
+}
+
+void Autosave::endTurn(const SaveGameData& data)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	journal->recordTurnEnd(data.random);
+	std::string* records = journal->takeRecords();
+	stats.journal_bytes += records->size();
+	stats.turns++;
+	turns_since_snapshot++;
+	enqueue(Job(generation, records));
+
+	stats.journal_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (snapshot_failed)
+		{
+			snapshot_failed = false;
+			snapshot_requested = true;
+		}
+	}
+
+	if (snapshot_requested || turns_since_snapshot >= snapshot_interval) { takeSnapshot(data); }
+}
+
+void Autosave::takeSnapshot(const SaveGameData& data)
+{
+	TRACE_ZONE("Autosave::takeSnapshot");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//Everything but the map chunks is serialized into memory right away, so the game can go on changing its state.
+	//The chunks are serialized by the writer thread from copies of their tiles or from their files.
+	std::ostringstream* os = new std::ostringstream(std::ios::out | std::ios::binary);
+	unsigned int next = generation + 1;
+	os->write((const char*)&next, sizeof(next));
+
+	PendingSave* save = beginSave(*os, data, snapshot_filename.c_str());
+	if (save == nullptr)
+	{
+		debug_error("ERROR while taking a snapshot for %s, will retry next turn.\n", snapshot_filename.c_str());
+		delete os;
+		return;
+	}
+
+	generation = next;
+	turns_since_snapshot = 0;
+	snapshot_requested = false;
+
+	stats.snapshots++;
+	enqueue(Job(generation, os, save));
+
+	stats.snapshot_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Autosave::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!jobs.empty() || writing) { jobs_changed.wait(lock); }
+}
+
+void Autosave::work()
+{
+	Trace::setThreadName("autosave writer");
+
+	while (true)
+	{
+		Job job(0, nullptr);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && jobs.empty()) { jobs_changed.wait(lock); }
+
+			//Jobs still queued when stopping are written first
+			if (jobs.empty()) { return; }
+
+			job = jobs.front();
+			jobs.pop_front();
+			writing = true;
+		}
+
+		writeJob(job);
+		delete job.data;
+		delete job.stream;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			writing = false;
+		}
+		jobs_changed.notify_all();
+	}
+}
+
+void Autosave::writeJob(const Job& job)
+{
+	TRACE_ZONE("Autosave::writeJob");
+
+	if (!job.snapshot)
+	{
+		//Turns of a generation whose snapshot is not on disk (yet) cannot be replayed. Before the first
+		//snapshot, the turns carry the generation of the autosave on disk, which is 0 if there is none.
+		if (journal_generation == 0 || job.generation != journal_generation) { return; }
+
+		std::ofstream ofs(journal_filename, std::ios::binary | std::ios::app);
+		ofs.write(job.data->data(), job.data->size());
+		ofs.flush();
+		if (!ofs) { debug_error("ERROR while appending to %s\n", journal_filename.c_str()); }
+		return;
+	}
+
+	//The journal of this generation is not written until the snapshot is, so the next turn takes a new one on failure
+	if (!writeSnapshot(job))
+	{
+		debug_error("ERROR while taking a snapshot for %s, will retry next turn.\n", snapshot_filename.c_str());
+		std::lock_guard<std::mutex> lock(mutex);
+		snapshot_failed = true;
+	}
+}
+
+bool Autosave::writeSnapshot(const Job& job)
+{
+	if (!finishSave(job.save)) { return false; }
+	std::string snapshot = job.stream->str();
+
+	//The snapshot is written to a temporary file first, so a crash never leaves a partial snapshot
+	std::string temp_filename = snapshot_filename + ".tmp";
+	{
+		std::ofstream ofs(temp_filename, std::ios::binary | std::ios::trunc);
+		ofs.write(snapshot.data(), snapshot.size());
+		ofs.flush();
+		if (!ofs)
+		{
+			debug_error("ERROR while writing %s\n", temp_filename.c_str());
+			return false;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.snapshot_bytes += snapshot.size();
+	}
+
+	//rename() does not replace existing files on every platform
+	std::remove(snapshot_filename.c_str());
+	if (std::rename(temp_filename.c_str(), snapshot_filename.c_str()) != 0)
+	{
+		debug_error("ERROR while renaming %s to %s\n", temp_filename.c_str(), snapshot_filename.c_str());
+		return false;
+	}
+
+	//The old journal belongs to the previous generation and is started over
+	std::ofstream ofs(journal_filename, std::ios::binary | std::ios::trunc);
+	ofs.write((const char*)&job.generation, sizeof(job.generation));
+	ofs.flush();
+	if (!ofs)
+	{
+		debug_error("ERROR while writing %s\n", journal_filename.c_str());
+		return false;
+	}
+
+	journal_generation = job.generation;
+	return true;
+}
+
+bool Autosave::load(const std::string& path, SaveGameData* data)
+{
+	std::string snapshot_filename = path + ".bin";
+	std::string journal_filename = path + ".journal";
+
+	//If a crash happened between removing the old snapshot and renaming the new one, only the temporary file is left
+	std::ifstream ifs(snapshot_filename, std::ios::binary);
+	if (!ifs)
+	{
+		snapshot_filename += ".tmp";
+		ifs.open(snapshot_filename, std::ios::binary);
+		if (!ifs) { return false; }
+	}
+
+	unsigned int generation = 0;
+	ifs.read((char*)&generation, sizeof(generation));
+
+	SaveGameData loaded;
+	if (!ifs || !loadGame(ifs, SaveFormat::BINARY, &loaded, snapshot_filename.c_str())) { return false; }
+
+	std::ifstream jfs(journal_filename, std::ios::binary);
+	unsigned int journal_generation = 0;
+	jfs.read((char*)&journal_generation, sizeof(journal_generation));
+
+	if (jfs && journal_generation == generation)
+	{
+		std::string records((std::istreambuf_iterator<char>(jfs)), std::istreambuf_iterator<char>());
+
+		int turns = 0;
+		if (!Journal::replay(records, &loaded, &turns))
+		{
+			debug_error("ERROR while replaying %s after %d turns, the last turn is incomplete.\n", journal_filename.c_str(), turns);
+		}
+		debug_print("Replayed %d turns from %s.\n", turns, journal_filename.c_str());
+	}
+
+	*data = loaded;
+	return true;
+}
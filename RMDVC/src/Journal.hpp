@@ -0,0 +1,224 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include "SaveGame.hpp"
+#include "Random.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+class Actor;
+class Action;
+struct PartRemovalResult;
+
+/** The types of the records of a Journal. Every record starts with its type (one byte), followed
+* by the data listed here. Actors are identified by their UUID (16 bytes), numbers are stored as
+* they are in memory, like in binary saves.
+*/
+enum JournalRecordType {
+	JOURNAL_MOVE,			//An Actor has moved: UUID, x, y
+	JOURNAL_SCHEDULE,		//An action has been scheduled: UUID, action type, d_x, d_y, player action flag
+	JOURNAL_DEQUEUE,		//The next action has been taken from the queue
+	JOURNAL_PART_REMOVAL,	//Parts have been removed from the Body of an Actor: UUID, count, layout indices
+	JOURNAL_TURN_END,		//The turn is complete: master seed, count, stream states
+	SIZE_OF_JOURNAL_RECORD_TYPE_ENUM
+};
+
+/** The ActorMap, the ActionScheduler and the Engine record every change they make to the game state
+* in the Journal, which collects the records of one turn in memory. Replaying the records of a turn
+* onto the game state before the turn results in the game state after the turn. Only complete turns
+* (ending with a JOURNAL_TURN_END record) are replayed.
+*
+* Changes that are not recorded (e.g. new Actors) must be followed by a full snapshot, see Autosave.
+*
+* @brief The record of the changes made to the game state during the current turn.
+*/
+class Journal
+{
+private:
+	std::string* records;
+
+	void write(const void* data, size_t size) { records->append((const char*)data, size); }
+
+	template<class T>
+	void writeValue(T value) { write(&value, sizeof(T)); }
+
+	void writeActor(const Actor* actor);
+
+public:
+	void recordMove(const Actor* actor);
+	void recordSchedule(Action* action, bool player_action);
+	void recordDequeue();
+	void recordPartRemoval(const Actor* actor, const PartRemovalResult& result);
+	void recordTurnEnd(const RandomState& random);
+
+	/** Hands the records collected so far over to the caller, who takes ownership of them.
+	* The Journal starts over empty.
+	*/
+	std::string* takeRecords();
+
+	/** Replays the complete turns of the given records onto the game state.
+	*
+	* @param turns Receives the number of turns replayed.
+	* @return false if a record refers to something that is not in the game state,
+	*	in which case the game state is left partially replayed.
+	*/
+	static bool replay(const std::string& records, SaveGameData* data, int* turns);
+
+	Journal() : records(new std::string()) {};
+	~Journal() { delete records; };
+};
+
+/** @brief Counters of an Autosave.
+*/
+struct AutosaveStats {
+	/** The number of turns journaled and the number of snapshots taken.
+	*/
+	unsigned long long turns;
+	unsigned long long snapshots;
+
+	/** The bytes of the journal handed to the writer thread and the bytes of the snapshots it wrote.
+	* The latter are counted by the writer thread and only complete after Autosave::flush().
+	*/
+	unsigned long long journal_bytes;
+	unsigned long long snapshot_bytes;
+
+	/** The time the main thread spent journaling turns and taking snapshots, in seconds. Reading
+	* paged-out map chunks, serializing the map chunks and writing to disk is done by the writer
+	* thread and not included.
+	*/
+	double journal_seconds;
+	double snapshot_seconds;
+
+	AutosaveStats() : turns(0), snapshots(0), journal_bytes(0), snapshot_bytes(0),
+		journal_seconds(0.0), snapshot_seconds(0.0) {};
+};
+
+/** The game is autosaved as a snapshot (a binary save, see saveGame()) and a journal of the turns
+* played since the snapshot (see Journal), which is appended to after every turn. Every
+* snapshot_interval turns, or when a change that is not journaled has been made, a new snapshot is
+* taken and the journal is started over, which keeps it short.
+*
+* The main thread serializes the actors, the scheduler and the rest of the game state into memory,
+* but only copies the tiles of the modified map chunks that are loaded and records which are paged
+* out (see beginSave()). The writer thread reads the paged-out chunks, serializes the chunks (the
+* bulk of a snapshot) and writes snapshots and journal to disk, so the game loop never waits for the
+* disk. The files of paged-out chunks are kept until the writer thread has read them.
+*
+* Snapshot and journal carry a generation number, which is incremented with every snapshot, so
+* a journal is only replayed onto the snapshot it was started with.
+*
+* @brief Writes autosaves in the background, as snapshots and journals of the turns in between.
+*/
+class Autosave
+{
+private:
+	std::string snapshot_filename;
+	std::string journal_filename;
+
+	int snapshot_interval;
+	int turns_since_snapshot;
+	bool snapshot_requested;
+
+	/** The generation of the last snapshot handed to the writer thread.
+	*/
+	unsigned int generation;
+
+	Journal* journal;
+	AutosaveStats stats;
+
+	/** A snapshot or the records of a turn, to be written by the writer thread, which takes ownership
+	* of the data. A snapshot is the stream it is written to, preceded by its generation, and the save
+	* to be finished into it.
+	*/
+	struct Job {
+		bool snapshot;
+		unsigned int generation;
+		std::string* data;
+		std::ostringstream* stream;
+		PendingSave* save;
+
+		Job(unsigned int generation, std::string* data) : snapshot(false), generation(generation), data(data),
+			stream(nullptr), save(nullptr) {};
+		Job(unsigned int generation, std::ostringstream* stream, PendingSave* save) : snapshot(true),
+			generation(generation), data(nullptr), stream(stream), save(save) {};
+	};
+
+	std::deque<Job> jobs;
+	std::mutex mutex;
+	std::condition_variable jobs_changed;
+	bool stopping;
+
+	/** Whether the writer thread is writing a job (which is already taken out of jobs).
+	*/
+	bool writing;
+	std::thread writer;
+
+	/** Set by the writer thread if it could not finish or write a snapshot, so the next turn takes a new one.
+	*/
+	bool snapshot_failed;
+
+	/** The generation of the journal file on disk, only used by the writer thread. It is 0 until the
+	* writer thread has written a snapshot, as snapshots start at generation 1.
+	*/
+	unsigned int journal_generation;
+
+	void enqueue(const Job& job);
+	void takeSnapshot(const SaveGameData& data);
+
+	void work();
+	void writeJob(const Job& job);
+
+	/** Finishes the snapshot of the given job and writes it, starting the journal of its generation over.
+	*
+	* @return false if it failed, in which case the journal of its generation is not written.
+	*/
+	bool writeSnapshot(const Job& job);
+
+	/** Returns the generation of the snapshot or journal in the given file, or 0 if there is none.
+	*/
+	static unsigned int readGeneration(const std::string& filename);
+
+public:
+	/** @brief Returns the Journal that the ActorMap, the ActionScheduler and the Engine record their changes in.
+	*/
+	Journal* getJournal() { return journal; }
+
+	/** @brief Makes the next call of endTurn() take a snapshot, e.g. after a change that is not journaled.
+	*/
+	void requestSnapshot() { snapshot_requested = true; }
+
+	/** Completes the journal of the current turn and hands it to the writer thread, taking a snapshot
+	* if it is due. The game state must be the one whose changes are recorded in the Journal.
+	*/
+	void endTurn(const SaveGameData& data);
+
+	/** @brief Waits until the writer thread has written everything handed to it so far.
+	*/
+	void flush();
+
+	const AutosaveStats& getStats() const { return stats; }
+
+	/** Loads the autosave with the given path: the snapshot, onto which the journal is replayed.
+	*
+	* @return false if there is no (readable) snapshot, in which case data is not modified.
+	*/
+	static bool load(const std::string& path, SaveGameData* data);
+
+	/** Creates an autosave writing to the files path.bin (snapshot) and path.journal. The first
+	* snapshot is taken by the first call of endTurn(); until then, nothing is written.
+	*
+	* @param snapshot_interval The number of turns after which a new snapshot is taken.
+	*/
+	Autosave(const std::string& path, int snapshot_interval);
+
+	/** Writes everything handed to the writer thread before returning.
+	*/
+	~Autosave();
+};
+
+#endif
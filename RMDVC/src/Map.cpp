@@ -1,54 +1,603 @@
 #include "Map.hpp"
 #include "Actor.hpp"
 #include "Ai.hpp"
+#include "Diagnostics.hpp"
+#include "Journal.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <exception>
+
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+
+static const int CHUNK_SIZE = MapChunk::CHUNK_SIZE;
+
+/** The memory a resident chunk takes up, in bytes.
+*/
+static const size_t CHUNK_BYTES = sizeof(MapChunk) + CHUNK_SIZE * CHUNK_SIZE * PLANE_COUNT / 8;
+
+/** Clips the rectangle to a map of the given size.
+* @return false if nothing of the rectangle is left.
+*/
+static bool clipRect(int* x, int* y, int* w, int* h, int width, int height)
+{
+	if (*x < 0) { *w += *x; *x = 0; }
+	if (*y < 0) { *h += *y; *y = 0; }
+	if (*x + *w > width) { *w = width - *x; }
+	if (*y + *h > height) { *h = height - *y; }
+
+	return *w > 0 && *h > 0;
+}
+
+Map::Map(int width, int height) : generator(nullptr), fov_map(nullptr) {
+	init(width, height);
 
-Map::Map(int width, int height) : width(width),height(height) {
-    tiles=new Tile[width*height];
     setWall(30,22);
     setWall(50,22);
-
-	tmap = new TCODMap(width, height);
-	tmap->clear(true, true);
-	tmap->setProperties(30, 22, false, false);
-	tmap->setProperties(50, 22, false, false);
 }
 
 Map::~Map() {
-	delete tmap;
-    delete [] tiles;
+	for (auto it = chunks.begin(); it != chunks.end(); it++) { delete it->second; }
+
+	delete generator;
+	delete fov_map;
+}
+
+void Map::init(int width, int height) {
+	this->width = width;
+	this->height = height;
+	chunks_x = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunks_y = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	for (auto it = chunks.begin(); it != chunks.end(); it++) { delete it->second; }
+	chunks.clear();
+	paged_out.clear();
+	last_chunk = nullptr;
+	last_chunk_index = -1;
+
+	use_clock = 0;
+	chunk_generations = 0;
+	chunk_loads = 0;
+	chunk_evictions = 0;
+
+	//4 MB hold about 2000 chunks, i.e. the 8 million tiles around the player
+	memory_budget = 4 * 1024 * 1024;
+	chunk_directory.clear();
+	if (generator == nullptr) { generator = new FloorGenerator(); }
+
+	delete fov_map;
+	fov_map = nullptr;
+
+	transparency_version = 0;
+	walkable_version = 0;
+	fov_compute_count = 0;
+
+	dirty_cells.clear();
+	full_redraw = true;
+}
+
+MapChunk* Map::pageIn(int index) const {
+	MapChunk* chunk;
+	bool created = false;
+
+	auto it = chunks.find(index);
+	if (it != chunks.end()) {
+		chunk = it->second;
+	}
+	else {
+		chunk = new MapChunk();
+		created = true;
+
+		//Chunks are only on disk if they were modified, otherwise they are generated again
+		if (paged_out.count(index) > 0) {
+			if (readChunkFile(index, getChunkFilename(index), &chunk->tiles)) {
+				chunk->modified = true;
+				chunk_loads++;
+			}
+			else {
+				chunk->tiles.resize(CHUNK_SIZE, CHUNK_SIZE);
+				paged_out.erase(index);
+			}
+		}
+
+		if (!chunk->modified) {
+			generator->generate(index % chunks_x, index / chunks_x, &chunk->tiles);
+			chunk_generations++;
+		}
+
+		chunks[index] = chunk;
+	}
+
+	last_chunk = chunk;
+	last_chunk_index = index;
+	chunk->last_use = ++use_clock;
+
+	//The new chunk is the last accessed one, so it is not evicted itself
+	if (created) { evictChunks(); }
+
+	return chunk;
+}
+
+void Map::evictChunks() const {
+	//Modified chunks whose file is pinned are not written, they stay resident until it is unpinned
+	std::lock_guard<std::mutex> lock(pin_mutex);
+
+	while (chunks.size() * CHUNK_BYTES > memory_budget) {
+		//Find the least recently used chunk that can be evicted
+		auto victim = chunks.end();
+		for (auto it = chunks.begin(); it != chunks.end(); it++) {
+			if (it->second == last_chunk) { continue; }
+			if (it->second->modified && (chunk_directory.empty() || pinned_chunks.count(it->first) > 0)) { continue; }
+
+			if (victim == chunks.end() || it->second->last_use < victim->second->last_use) { victim = it; }
+		}
+
+		if (victim == chunks.end()) { return; }
+
+		if (victim->second->modified) {
+			std::ofstream ofs(getChunkFilename(victim->first).c_str(), std::ios::binary);
+			if (!ofs) {
+				debug_error("ERROR: could not write chunk %i to %s\n", victim->first, chunk_directory.c_str());
+				return;
+			}
+
+			boost::archive::binary_oarchive oa(ofs);
+			oa << victim->second->tiles;
+			paged_out.insert(victim->first);
+		}
+
+		delete victim->second;
+		chunks.erase(victim);
+		chunk_evictions++;
+	}
+}
+
+std::string Map::getChunkFilename(int index) const {
+	std::ostringstream filename;
+	filename << chunk_directory << "/chunk_" << index << ".bin";
+	return filename.str();
+}
+
+bool Map::readChunkFile(int index, const std::string& filename, TileLayer* tiles) {
+	std::ifstream ifs(filename.c_str(), std::ios::binary);
+	try {
+		boost::archive::binary_iarchive ia(ifs);
+		ia >> *tiles;
+	}
+	catch (std::exception& e) {
+		debug_error("ERROR while reading chunk %i: %s\n", index, e.what());
+		return false;
+	}
+
+	return true;
+}
+
+void Map::collectModifiedChunks(std::map<int, TileLayer>* result) const {
+	MapChunkView view;
+	captureChunks(&view);
+	collectChunks(&view);
+	result->swap(view.chunks);
+}
+
+void Map::captureChunks(MapChunkView* view) const {
+	for (auto it = chunks.begin(); it != chunks.end(); it++) {
+		if (it->second->modified) { view->chunks[it->first] = it->second->tiles; }
+	}
+
+	std::lock_guard<std::mutex> lock(pin_mutex);
+	for (auto it = paged_out.begin(); it != paged_out.end(); it++) {
+		if (chunks.count(*it) > 0) { continue; }
+
+		view->files.push_back(std::make_pair(*it, getChunkFilename(*it)));
+		pinned_chunks.insert(*it);
+	}
+}
+
+void Map::collectChunks(MapChunkView* view) const {
+	for (auto it = view->files.begin(); it != view->files.end(); it++) {
+		if (!readChunkFile(it->first, it->second, &view->chunks[it->first])) { view->chunks.erase(it->first); }
+	}
+
+	std::lock_guard<std::mutex> lock(pin_mutex);
+	for (auto it = view->files.begin(); it != view->files.end(); it++) {
+		pinned_chunks.erase(pinned_chunks.find(it->first));
+	}
+	view->files.clear();
+}
+
+void Map::restoreChunks(const std::map<int, TileLayer>& modified_chunks) {
+	for (auto it = modified_chunks.begin(); it != modified_chunks.end(); it++) {
+		MapChunk* chunk;
+		auto resident = chunks.find(it->first);
+		if (resident != chunks.end()) {
+			chunk = resident->second;
+		}
+		else {
+			chunk = new MapChunk();
+			chunks[it->first] = chunk;
+		}
+
+		chunk->tiles = it->second;
+		chunk->modified = true;
+	}
+	evictChunks();
+}
+
+template<class Function>
+void Map::forEachChunkIn(int x, int y, int w, int h, Function function) const {
+	if (!clipRect(&x, &y, &w, &h, width, height)) { return; }
+
+	for (int cy = y / CHUNK_SIZE; cy <= (y + h - 1) / CHUNK_SIZE; cy++) {
+		int part_y = std::max(y, cy * CHUNK_SIZE);
+		int part_h = std::min(y + h, (cy + 1) * CHUNK_SIZE) - part_y;
+
+		for (int cx = x / CHUNK_SIZE; cx <= (x + w - 1) / CHUNK_SIZE; cx++) {
+			int part_x = std::max(x, cx * CHUNK_SIZE);
+			int part_w = std::min(x + w, (cx + 1) * CHUNK_SIZE) - part_x;
+
+			function(getChunk(cx, cy), part_x, part_y, part_w, part_h);
+		}
+	}
 }
 
 bool Map::isWall(int x, int y) const {
-    return !tiles[x+y*width].canWalk;
+	//Everything outside of the map is solid
+	if (!isInMap(x, y)) { return true; }
+    return !getChunkAt(x, y)->tiles.get(PLANE_WALKABLE, x % CHUNK_SIZE, y % CHUNK_SIZE);
+}
+
+bool Map::isTransparent(int x, int y) const {
+	if (!isInMap(x, y)) { return false; }
+	return getChunkAt(x, y)->tiles.get(PLANE_TRANSPARENT, x % CHUNK_SIZE, y % CHUNK_SIZE);
+}
+
+bool Map::isExplored(int x, int y) const {
+	if (!isInMap(x, y)) { return false; }
+	return getChunkAt(x, y)->tiles.get(PLANE_EXPLORED, x % CHUNK_SIZE, y % CHUNK_SIZE);
+}
+
+void Map::setExplored(int x, int y) {
+	if (!isInMap(x, y)) { return; }
+
+	MapChunk* chunk = getChunkAt(x, y);
+	if (chunk->tiles.set(PLANE_EXPLORED, x % CHUNK_SIZE, y % CHUNK_SIZE, true)) {
+		chunk->modified = true;
+		markDirty(x, y);
+	}
+}
+
+void Map::setTile(int x, int y, bool walkable, bool transparent) {
+	if (!isInMap(x, y)) { return; }
+
+	MapChunk* chunk = getChunkAt(x, y);
+	bool walkable_changed = chunk->tiles.set(PLANE_WALKABLE, x % CHUNK_SIZE, y % CHUNK_SIZE, walkable);
+	bool transparent_changed = chunk->tiles.set(PLANE_TRANSPARENT, x % CHUNK_SIZE, y % CHUNK_SIZE, transparent);
+	if (walkable_changed || transparent_changed) { chunk->modified = true; }
+
+	tilesChanged(x, y, 1, 1, walkable_changed ? 1 : 0, transparent_changed ? 1 : 0);
 }
- 
-void Map::setWall(int x, int y) {
-    tiles[x+y*width].canWalk=false;
+
+void Map::fillRect(int x, int y, int w, int h, bool walkable, bool transparent) {
+	int walkable_changed = 0;
+	int transparent_changed = 0;
+
+	forEachChunkIn(x, y, w, h, [&](MapChunk* chunk, int part_x, int part_y, int part_w, int part_h) {
+		int changed_w = chunk->tiles.fillRect(PLANE_WALKABLE, part_x % CHUNK_SIZE, part_y % CHUNK_SIZE, part_w, part_h, walkable);
+		int changed_t = chunk->tiles.fillRect(PLANE_TRANSPARENT, part_x % CHUNK_SIZE, part_y % CHUNK_SIZE, part_w, part_h, transparent);
+
+		if (changed_w + changed_t > 0) { chunk->modified = true; }
+		walkable_changed += changed_w;
+		transparent_changed += changed_t;
+	});
+
+	tilesChanged(x, y, w, h, walkable_changed, transparent_changed);
+}
+
+void Map::copyRegion(const Map& src, int src_x, int src_y, int w, int h, int dest_x, int dest_y) {
+	//Clip against the source, then against this map, moving the other rectangle along
+	int x = src_x, y = src_y;
+	if (!clipRect(&x, &y, &w, &h, src.width, src.height)) { return; }
+	dest_x += x - src_x;
+	dest_y += y - src_y;
+	src_x = x; src_y = y;
+
+	x = dest_x; y = dest_y;
+	if (!clipRect(&x, &y, &w, &h, width, height)) { return; }
+	src_x += x - dest_x;
+	src_y += y - dest_y;
+	dest_x = x; dest_y = y;
+
+	//The region is gathered from the chunks of the source first, so only one chunk
+	// is accessed at a time and the source may overlap the destination
+	TileLayer region(w, h);
+
+	src.forEachChunkIn(src_x, src_y, w, h, [&](MapChunk* chunk, int part_x, int part_y, int part_w, int part_h) {
+		region.copyRegion(chunk->tiles, PLANE_WALKABLE, part_x % CHUNK_SIZE, part_y % CHUNK_SIZE, part_w, part_h,
+			part_x - src_x, part_y - src_y);
+		region.copyRegion(chunk->tiles, PLANE_TRANSPARENT, part_x % CHUNK_SIZE, part_y % CHUNK_SIZE, part_w, part_h,
+			part_x - src_x, part_y - src_y);
+	});
+
+	int walkable_changed = 0;
+	int transparent_changed = 0;
+
+	forEachChunkIn(dest_x, dest_y, w, h, [&](MapChunk* chunk, int part_x, int part_y, int part_w, int part_h) {
+		int changed_w = chunk->tiles.copyRegion(region, PLANE_WALKABLE, part_x - dest_x, part_y - dest_y, part_w, part_h,
+			part_x % CHUNK_SIZE, part_y % CHUNK_SIZE);
+		int changed_t = chunk->tiles.copyRegion(region, PLANE_TRANSPARENT, part_x - dest_x, part_y - dest_y, part_w, part_h,
+			part_x % CHUNK_SIZE, part_y % CHUNK_SIZE);
+
+		if (changed_w + changed_t > 0) { chunk->modified = true; }
+		walkable_changed += changed_w;
+		transparent_changed += changed_t;
+	});
+
+	tilesChanged(dest_x, dest_y, w, h, walkable_changed, transparent_changed);
 }
 
-void Map::render(TCODConsole* con) const {
-    static const TCODColor darkWall(0,0,100);
-    static const TCODColor darkGround(50,50,150);
+int Map::countWalkable(int x, int y, int w, int h) const {
+	int result = 0;
+
+	forEachChunkIn(x, y, w, h, [&](MapChunk* chunk, int part_x, int part_y, int part_w, int part_h) {
+		result += chunk->tiles.countRect(PLANE_WALKABLE, part_x % CHUNK_SIZE, part_y % CHUNK_SIZE, part_w, part_h);
+	});
 
-	for (int x=0; x < width; x++) {
-	    for (int y=0; y < height; y++) {
-	        con->setCharBackground( x,y,
-	            isWall(x,y) ? darkWall : darkGround );
-	    }
+	return result;
+}
+
+void Map::tilesChanged(int x, int y, int w, int h, int walkable_changed, int transparent_changed) {
+	if (walkable_changed == 0 && transparent_changed == 0) { return; }
+
+	if (walkable_changed > 0) { walkable_version++; }
+	if (transparent_changed > 0) { transparency_version++; }
+
+	if (!clipRect(&x, &y, &w, &h, width, height)) { return; }
+
+	//Large changes are cheaper to redraw as a whole
+	if (w * h >= 1024) {
+		markAllDirty();
+		return;
+	}
+
+	for (int cy = y; cy < y + h; cy++) {
+		for (int cx = x; cx < x + w; cx++) { markDirty(cx, cy); }
 	}
 }
 
+void Map::setGenerator(ChunkGenerator* generator) {
+	delete this->generator;
+	this->generator = generator;
+}
+
+void Map::setMemoryBudget(size_t bytes) {
+	memory_budget = bytes;
+	evictChunks();
+}
+
+size_t Map::getMemoryUsage() const {
+	return chunks.size() * CHUNK_BYTES;
+}
+
+void Map::clearDirty()
+{
+	//Chunks that have been evicted in the meantime have lost their dirty bits anyway
+	for (auto it = dirty_cells.begin(); it != dirty_cells.end(); it++)
+	{
+		int x = *it % width;
+		int y = *it / width;
+
+		auto chunk = chunks.find(x / CHUNK_SIZE + (y / CHUNK_SIZE) * chunks_x);
+		if (chunk != chunks.end()) { chunk->second->tiles.set(PLANE_DIRTY, x % CHUNK_SIZE, y % CHUNK_SIZE, false); }
+	}
+
+	dirty_cells.clear();
+	full_redraw = false;
+}
+
+bool Map::updateFov(FovCache* cache, int x, int y, int radius)
+{
+	if (!prepareFov(cache, x, y, radius)) { return false; }
+
+	computeFov(cache, &fov_map);
+	return true;
+}
+
+bool Map::prepareFov(FovCache* cache, int x, int y, int radius)
+{
+	if (cache->valid && cache->origin_x == x && cache->origin_y == y
+		&& cache->radius == radius && cache->map_version == transparency_version)
+	{
+		return false;
+	}
+
+	//Field of view never reaches beyond the square around the origin, so only that
+	// square is copied out of the chunks (cells outside of the map are opaque)
+	int side = 2 * radius + 1;
+	cache->transparent.assign(side * side, false);
+	cache->walkable.assign(side * side, false);
+
+	int left = x - radius;
+	int top = y - radius;
+
+	forEachChunkIn(left, top, side, side, [&](MapChunk* chunk, int part_x, int part_y, int part_w, int part_h) {
+		for (int cy = part_y; cy < part_y + part_h; cy++) {
+			for (int cx = part_x; cx < part_x + part_w; cx++) {
+				int cell = (cx - left) + (cy - top) * side;
+				cache->transparent[cell] = chunk->tiles.get(PLANE_TRANSPARENT, cx % CHUNK_SIZE, cy % CHUNK_SIZE);
+				cache->walkable[cell] = chunk->tiles.get(PLANE_WALKABLE, cx % CHUNK_SIZE, cy % CHUNK_SIZE);
+			}
+		}
+	});
+
+	cache->origin_x = x;
+	cache->origin_y = y;
+	cache->radius = radius;
+	cache->map_version = transparency_version;
+	cache->valid = false;
+	cache->pending = true;
+	fov_compute_count++;
+
+	return true;
+}
+
+void Map::computeFov(FovCache* cache, TCODMap** fov_map)
+{
+	if (!cache->pending) { return; }
+
+	TRACE_ZONE("Map::computeFov");
+
+	int side = 2 * cache->radius + 1;
+	if (*fov_map == nullptr || (*fov_map)->getWidth() != side)
+	{
+		delete *fov_map;
+		*fov_map = new TCODMap(side, side);
+	}
+
+	for (int dy = 0; dy < side; dy++) {
+		for (int dx = 0; dx < side; dx++) {
+			(*fov_map)->setProperties(dx, dy, cache->transparent[dx + dy * side], cache->walkable[dx + dy * side]);
+		}
+	}
+
+	(*fov_map)->computeFov(cache->radius, cache->radius, cache->radius, true, FOV_BASIC);
+
+	cache->visible.assign(side * side, false);
+
+	for (int dy = 0; dy < side; dy++) {
+		for (int dx = 0; dx < side; dx++) {
+			cache->visible[dx + dy * side] = (*fov_map)->isInFov(dx, dy);
+		}
+	}
+
+	cache->pending = false;
+	cache->valid = true;
+}
+
+static const TCODColor darkWall(0,0,100);
+static const TCODColor darkGround(50,50,150);
+
+void Map::render(TCODConsole* con, int view_x, int view_y) const {
+	TRACE_ZONE("Map::render");
+
+	forEachChunkIn(view_x, view_y, con->getWidth(), con->getHeight(),
+		[&](MapChunk* chunk, int part_x, int part_y, int part_w, int part_h) {
+		for (int y = part_y; y < part_y + part_h; y++) {
+		    for (int x = part_x; x < part_x + part_w; x++) {
+		        con->setCharBackground(x - view_x, y - view_y,
+		            chunk->tiles.get(PLANE_WALKABLE, x % CHUNK_SIZE, y % CHUNK_SIZE) ? darkGround : darkWall);
+		    }
+		}
+	});
+}
+
+void Map::renderCell(TCODConsole* con, int x, int y, int view_x, int view_y) const {
+	con->setChar(x - view_x, y - view_y, ' ');
+	con->setCharBackground(x - view_x, y - view_y, isWall(x,y) ? darkWall : darkGround);
+}
+
+ActorMap::ActorMap(int width, int height) : width(width), height(height), dirty_map(nullptr), journal(nullptr)
+{
+	actors = new std::map<std::string, Actor*>();
+	registry = new SlotMap<Actor>();
+	occupancy = new std::vector<Actor**>();
+	resetOccupancy();
+}
+
 ActorMap::~ActorMap()
 {
-	delete actor_pos;
+	for (auto it = occupancy->begin(); it != occupancy->end(); it++) { delete[] *it; }
+	delete occupancy;
+	delete registry;
 	//All references to any Actor* are invalid after destroying ActorMap !!!
 	delete actors;
 }
 
-void ActorMap::addActor(Actor* actor)
+Actor** ActorMap::getOccupancyCell(int pos_x, int pos_y, bool allocate) const
 {
+	Actor**& chunk = (*occupancy)[pos_x / CHUNK_SIZE + (pos_y / CHUNK_SIZE) * chunks_x];
+	if (chunk == nullptr)
+	{
+		if (!allocate) { return nullptr; }
+
+		chunk = new Actor*[CHUNK_SIZE * CHUNK_SIZE];
+		std::fill(chunk, chunk + CHUNK_SIZE * CHUNK_SIZE, (Actor*)nullptr);
+	}
+
+	return &chunk[pos_x % CHUNK_SIZE + (pos_y % CHUNK_SIZE) * CHUNK_SIZE];
+}
+
+void ActorMap::setOccupant(int pos_x, int pos_y, Actor* actor)
+{
+	if (!isInBounds(pos_x, pos_y)) { return; }
+	*getOccupancyCell(pos_x, pos_y, true) = actor;
+
+	if (dirty_map != nullptr) { dirty_map->markDirty(pos_x, pos_y); }
+}
+
+void ActorMap::clearOccupant(int pos_x, int pos_y, Actor* actor)
+{
+	if (!isInBounds(pos_x, pos_y)) { return; }
+
+	//Only clear the cell if it is actually held by the given actor
+	Actor** cell = getOccupancyCell(pos_x, pos_y, false);
+	if (cell != nullptr && *cell == actor) { *cell = nullptr; }
+
+	if (dirty_map != nullptr) { dirty_map->markDirty(pos_x, pos_y); }
+}
+
+void ActorMap::resetOccupancy()
+{
+	for (auto it = occupancy->begin(); it != occupancy->end(); it++) { delete[] *it; }
+
+	chunks_x = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	int chunks_y = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	occupancy->assign(chunks_x * chunks_y, nullptr);
+}
+
+void ActorMap::rebuildOccupancy()
+{
+	resetOccupancy();
+
+	for (auto it = actors->begin(); it != actors->end(); it++)
+	{
+		setOccupant(it->second->getPosX(), it->second->getPosY(), it->second);
+	}
+}
+
+void ActorMap::rebuildRegistry()
+{
+	registry->clear();
+
+	for (auto it = actors->begin(); it != actors->end(); it++)
+	{
+		it->second->setHandle(registry->insert(it->second));
+	}
+}
+
+ActorHandle ActorMap::addActor(Actor* actor)
+{
+	//Already registered (e.g. the player after loading a game)
+	if (registry->lookup(actor->getHandle()) == actor) { return actor->getHandle(); }
+
 	actors->insert(std::make_pair(actor->getUUID(),actor));
-	actor_pos->insert(std::make_pair(actor->getUUID(), new Vector2(actor->getPosX(), actor->getPosY())));
+	actor->setHandle(registry->insert(actor));
+	setOccupant(actor->getPosX(), actor->getPosY(), actor);
+
+	return actor->getHandle();
+}
+
+void ActorMap::removeActor(ActorHandle handle)
+{
+	Actor* actor = getActor(handle);
+	if (actor == nullptr) { return; }
+
+	clearOccupant(actor->getPosX(), actor->getPosY(), actor);
+	actors->erase(actor->getUUID());
+	registry->remove(handle);
+	actor->setHandle(ActorHandle());
 }
 
 Actor* ActorMap::getActorByUUID(std::string uuid)
@@ -56,45 +605,116 @@ Actor* ActorMap::getActorByUUID(std::string uuid)
 	return actors->at(uuid);
 }
 
-void ActorMap::moveActor(std::string uuid, int pos_x, int pos_y)
+const Actor* ActorMap::getActorConstByUUID(std::string uuid)
 {
-	Actor* actor = getActorByUUID(uuid);
-	//assert(actor != nullptr);
+	return actors->at(uuid);
+}
+
+void ActorMap::moveActor(ActorHandle handle, int pos_x, int pos_y)
+{
+	Actor* actor = getActor(handle);
+	assert(actor != nullptr);
+
+	clearOccupant(actor->getPosX(), actor->getPosY(), actor);
 	
 	actor->setPosX(pos_x);
 	actor->setPosY(pos_y);
 
-	updateActorPosition(uuid, pos_x, pos_y);
+	setOccupant(pos_x, pos_y, actor);
+
+	if (journal != nullptr) { journal->recordMove(actor); }
 }
 
-void ActorMap::updateActorPosition(std::string uuid, int pos_x, int pos_y)
+ActorHandle ActorMap::isOccupied(int pos_x, int pos_y) const
 {
-	Vector2* pos = actor_pos->at(uuid);
-	pos->pos_x = pos_x;
-	pos->pos_y = pos_y;
+	Actor* actor = getActorAt(pos_x, pos_y);
+	if (actor == nullptr) { return ActorHandle(); }
+
+	return actor->getHandle();
+}
+
+Actor* ActorMap::getActorAt(int pos_x, int pos_y) const
+{
+	if (!isInBounds(pos_x, pos_y)) { return nullptr; }
+
+	Actor** cell = getOccupancyCell(pos_x, pos_y, false);
+	return cell != nullptr ? *cell : nullptr;
 }
 
-std::string ActorMap::isOccupied(int pos_x, int pos_y)
+int ActorMap::getActorsInRadius(int pos_x, int pos_y, int radius, std::vector<Actor*>* result) const
 {
-	for (auto it = actor_pos->begin(); it != actor_pos->end(); it++)
+	int found = 0;
+	int r_sq = radius * radius;
+
+	int min_x = std::max(pos_x - radius, 0);
+	int max_x = std::min(pos_x + radius, width - 1);
+	int min_y = std::max(pos_y - radius, 0);
+	int max_y = std::min(pos_y + radius, height - 1);
+
+	if (min_x > max_x || min_y > max_y) { return 0; }
+
+	//If there are fewer actors than cells in the bounding box, checking 
+	// every actor is cheaper than scanning the grid.
+	if ((size_t)((max_x - min_x + 1) * (max_y - min_y + 1)) > actors->size())
 	{
-		if (it->second->pos_x == pos_x && it->second->pos_y == pos_y)
-			return it->first;
+		for (auto it = actors->begin(); it != actors->end(); it++)
+		{
+			int d_x = it->second->getPosX() - pos_x;
+			int d_y = it->second->getPosY() - pos_y;
+			if (d_x * d_x + d_y * d_y <= r_sq)
+			{
+				result->push_back(it->second);
+				found++;
+			}
+		}
+		return found;
 	}
 
-	return "";
+	for (int y = min_y; y <= max_y; y++)
+	{
+		for (int x = min_x; x <= max_x; x++)
+		{
+			Actor* actor = getActorAt(x, y);
+			if (actor == nullptr) { continue; }
+
+			if ((x - pos_x) * (x - pos_x) + (y - pos_y) * (y - pos_y) <= r_sq)
+			{
+				result->push_back(actor);
+				found++;
+			}
+		}
+	}
+
+	return found;
 }
 
-void ActorMap::updateActor(std::string uuid, Engine* eng, TCOD_key_t key)
+void ActorMap::getActors(std::vector<Actor*>* result) const
 {
-	Actor* actor = getActorByUUID(uuid);
-	if (actor->ai != nullptr)
+	for (size_t i = 0; i < registry->getSlotCount(); i++) {
+		if (!registry->isSlotOccupied(i)) { continue; }
+		result->push_back(registry->getAt(i));
+	}
+}
+
+void ActorMap::updateActor(ActorHandle handle, Engine* eng, TCOD_key_t key)
+{
+	Actor* actor = getActor(handle);
+	if (actor != nullptr && actor->ai != nullptr)
 		actor->ai->update(actor, eng, key);
 }
 
-void ActorMap::render(TCODConsole* con)
+void ActorMap::render(TCODConsole* con, int view_x, int view_y)
 {
-	for (auto it = actors->begin();	it != actors->end(); it++) {
-		it->second->render(con);
+	TRACE_ZONE("ActorMap::render");
+
+	for (size_t i = 0; i < registry->getSlotCount(); i++) {
+		if (!registry->isSlotOccupied(i)) { continue; }
+
+		Actor* actor = registry->getAt(i);
+		int x = actor->getPosX() - view_x;
+		int y = actor->getPosY() - view_y;
+		if (x < 0 || y < 0 || x >= con->getWidth() || y >= con->getHeight()) { continue; }
+
+		actor->render(con, view_x, view_y);
 	}
 }
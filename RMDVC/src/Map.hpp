@@ -2,12 +2,22 @@
 #define MAP_HPP
 
 #include "libtcod.hpp"
+#include "Handle.hpp"
+#include "TileLayer.hpp"
+#include "MapChunk.hpp"
 class Engine;
 class Actor;
+class Journal;
 
 #include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 #include <string>
+#include <vector>
 #include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/map.hpp>
 #include <boost/serialization/split_member.hpp>
 
 /** @brief A struct representing a two-dimensional vector.
@@ -30,23 +40,93 @@ public:
 	Vector2(){};
 };
 
-/** @brief A stuct encapsulating map tile properties.
+/** The field of view is stored for the square of cells within the radius around the origin only,
+* together with the transparency version of the Map it was computed on. As long as neither the origin
+* nor the transparency of the map changes, the stored field of view is still valid and
+* Map::updateFov() does not recompute it.
+*
+* The computation is split in two steps: Map::prepareFov() copies the transparency of the square
+* out of the map, Map::computeFov() computes the field of view from that copy alone. The second
+* step does not touch the Map, so the fields of view of several Ais can be computed concurrently.
+*
+* @brief A field of view computed on a Map, owned by whoever needs to keep it (e.g. an Ai).
 */
-struct Tile {
-private:
-	friend class boost::serialization::access;
-	template<class Archive>
-	void serialize(Archive & ar, const unsigned int version)
+struct FovCache {
+	int origin_x;
+	int origin_y;
+	int radius;
+
+	/** The transparency version of the Map when the field of view was computed, see Map::getTransparencyVersion().
+	*/
+	unsigned int map_version;
+	bool valid;
+
+	/** Visibility of the cells of the (2*radius+1)^2 square around the origin, row by row.
+	*/
+	std::vector<bool> visible;
+
+	/** The transparency and walkability of the same square, copied by Map::prepareFov().
+	* While pending is set, they have not been computed into visible yet.
+	*/
+	std::vector<bool> transparent;
+	std::vector<bool> walkable;
+	bool pending;
+
+	/** @brief Returns whether the given cell was in the field of view.
+	*/
+	bool isInFov(int x, int y) const
 	{
-		ar & BOOST_SERIALIZATION_NVP(canWalk);
+		if (!valid) { return false; }
+
+		int dx = x - origin_x + radius;
+		int dy = y - origin_y + radius;
+		int side = 2 * radius + 1;
+		if (dx < 0 || dy < 0 || dx >= side || dy >= side) { return false; }
+
+		return visible[dx + dy * side];
 	}
 
-public:
-    bool canWalk; // can we walk through this tile?
-    Tile() : canWalk(true) {}
+	/** @brief Marks the field of view as outdated, so the next Map::updateFov() recomputes it.
+	*/
+	void invalidate() { valid = false; }
+
+	FovCache() : origin_x(0), origin_y(0), radius(0), map_version(0), valid(false), pending(false) {};
+};
+
+/** Taking the view (Map::captureChunks()) only copies the modified chunks that are resident and
+* records the files of those that are paged out, which is cheap. Reading the files (Map::collectChunks())
+* can then be done later, on another thread, while the game goes on changing the Map.
+*
+* @brief The modified chunks of a Map at one point in time.
+*/
+struct MapChunkView {
+	/** The tiles of the modified chunks, by chunk index. Paged-out chunks are added by Map::collectChunks().
+	*/
+	std::map<int, TileLayer> chunks;
+
+	/** The chunks that were paged out and the files they were read from, which the Map
+	* does not overwrite until they have been read.
+	*/
+	std::vector<std::pair<int, std::string>> files;
 };
- 
-/** @brief A class encapsulating functions and members representing a map. 
+
+/** The tiles of the map are stored in chunks of MapChunk::CHUNK_SIZE x MapChunk::CHUNK_SIZE tiles,
+* which are created by a ChunkGenerator the first time they are accessed. When the chunks take up more
+* memory than the budget, the least recently used ones are evicted: unmodified chunks are simply dropped
+* (they are generated again when needed), modified ones are written to the chunk directory and read
+* from there later. Without a chunk directory, modified chunks are never evicted.
+*
+* Paging is invisible to the users of the map, all queries (isWall(), updateFov(), ...) work across
+* chunk boundaries and load the chunks they need. This is why the chunk storage is mutable: reading
+* a tile may page in a chunk.
+*
+* The modified chunks are not part of the serialized Map, they are written separately (see
+* collectModifiedChunks(), restoreChunks()), so a save can serialize them after everything else.
+*
+* The tiles are the only place the walkability and transparency are stored. Field of view is computed
+* on a TCODMap the size of the field of view, which is filled from the tiles around the origin.
+*
+* @brief A class encapsulating functions and members representing a map. 
 */
 class Map {
 private:
@@ -55,7 +135,6 @@ private:
 	template<class Archive>
 	void save(Archive & ar, const unsigned int version) const
 	{
-		// invoke serialization of the base class 
 		ar << BOOST_SERIALIZATION_NVP(width);
 		ar << BOOST_SERIALIZATION_NVP(height);
 	}
@@ -63,74 +142,414 @@ private:
 	template<class Archive>
 	void load(Archive & ar, const unsigned int version)
 	{
-		// invoke serialization of the base class 
-		ar >> BOOST_SERIALIZATION_NVP(width);
-		ar >> BOOST_SERIALIZATION_NVP(height);
-		
-		tiles = new Tile[width*height];
-		setWall(30, 22);
-		setWall(50, 22);
-
-		tmap = new TCODMap(width, height);
-		tmap->clear(true, true);
-		tmap->setProperties(30, 22, false, false);
-		tmap->setProperties(50, 22, false, false);
+		int w, h;
+		ar >> boost::serialization::make_nvp("width", w);
+		ar >> boost::serialization::make_nvp("height", h);
+		init(w, h);
 	}
 
 	BOOST_SERIALIZATION_SPLIT_MEMBER();
 
+	/** Initializes an empty map of the given size, without any resident chunks.
+	*/
+	void init(int width, int height);
+
 protected:
-	Tile* tiles;
+	int chunks_x, chunks_y;
+
+	/** The resident chunks, the key being chunk_x + chunk_y * chunks_x.
+	*/
+	mutable std::unordered_map<int, MapChunk*> chunks;
+
+	/** The chunks that have been written to the chunk directory when they were evicted.
+	*/
+	mutable std::set<int> paged_out;
+
+	/** The paged-out chunks whose files are still to be read for a MapChunkView. While a chunk is
+	* pinned, it is not evicted (if it is resident), as that would overwrite its file. The pins are the
+	* only part of the Map collectChunks() touches, so they are guarded by a mutex of their own.
+	*/
+	mutable std::multiset<int> pinned_chunks;
+	mutable std::mutex pin_mutex;
+
+	/** The chunk that was accessed last, which is most often the one accessed next.
+	*/
+	mutable MapChunk* last_chunk;
+	mutable int last_chunk_index;
+
+	mutable unsigned long long use_clock;
+	mutable unsigned long long chunk_generations;
+	mutable unsigned long long chunk_loads;
+	mutable unsigned long long chunk_evictions;
+
+	size_t memory_budget;
+	std::string chunk_directory;
+	ChunkGenerator* generator;
 
-	void setWall(int x, int y);
+	/** The TCODMap (the size of the square around the origin) field of view is computed on.
+	*/
+	TCODMap* fov_map;
+
+	/** Incremented whenever the transparency of a tile changes, which invalidates all FovCaches.
+	*/
+	unsigned int transparency_version;
+
+	/** Incremented whenever the walkability of a tile changes, which invalidates all ChaseMaps.
+	*/
+	unsigned int walkable_version;
+
+	/** The number of field of view computations done by updateFov().
+	*/
+	unsigned long long fov_compute_count;
+
+	/** Cells whose appearance has changed since the last frame, as PLANE_DIRTY bits of the tiles
+	* and as list of cell indices. If full_redraw is set, the whole map has to be redrawn instead.
+	*/
+	std::vector<int> dirty_cells;
+	bool full_redraw;
+
+	/** Returns the chunk with the given chunk coordinates (which must be within the map), reading or
+	* generating it if it is not resident.
+	*/
+	MapChunk* getChunk(int chunk_x, int chunk_y) const
+	{
+		int index = chunk_x + chunk_y * chunks_x;
+		if (index != last_chunk_index) { return pageIn(index); }
+
+		last_chunk->last_use = ++use_clock;
+		return last_chunk;
+	}
+
+	/** Returns the chunk holding the given tile (which must be within the map).
+	*/
+	MapChunk* getChunkAt(int x, int y) const { return getChunk(x / MapChunk::CHUNK_SIZE, y / MapChunk::CHUNK_SIZE); }
+
+	/** Looks up the chunk with the given index, pages it in if necessary and makes it the last accessed chunk.
+	*/
+	MapChunk* pageIn(int index) const;
+
+	/** Evicts least recently used chunks (but never the last accessed one) until the resident
+	* chunks fit into the memory budget or no chunk can be evicted.
+	*/
+	void evictChunks() const;
+
+	std::string getChunkFilename(int index) const;
+
+	/** Reads the tiles of a chunk file written by evictChunks().
+	*
+	* @return false if the file could not be read.
+	*/
+	static bool readChunkFile(int index, const std::string& filename, TileLayer* tiles);
+
+	bool isInMap(int x, int y) const { return x >= 0 && y >= 0 && x < width && y < height; }
+
+	/** Makes the tile at the given position a wall.
+	* Positions outside of the map are ignored.
+	*/
+	void setWall(int x, int y) { setTile(x, y, false, false); }
+
+	/** Calls the function for every part of the rectangle (clipped to the map) that lies in one chunk,
+	* with the chunk and the part of the rectangle in chunk coordinates.
+	*/
+	template<class Function>
+	void forEachChunkIn(int x, int y, int w, int h, Function function) const;
+
+	/** Called after the tiles of the rectangle have been changed: updates the versions and marks
+	* the rectangle dirty.
+	*
+	* @param walkable_changed The number of tiles whose walkability changed.
+	* @param transparent_changed The number of tiles whose transparency changed.
+	*/
+	void tilesChanged(int x, int y, int w, int h, int walkable_changed, int transparent_changed);
 
 public:
     int width,height;
-	TCODMap* tmap;
 
     bool isWall(int x, int y) const;
+	bool isTransparent(int x, int y) const;
+
+	/** Sets the walkability and transparency of the tile at the given position.
+	* Positions outside of the map are ignored.
+	*/
+	void setTile(int x, int y, bool walkable, bool transparent);
+
+	/** Sets the walkability and transparency of all tiles of the rectangle (clipped to the map).
+	*/
+	void fillRect(int x, int y, int w, int h, bool walkable, bool transparent);
+
+	/** Copies the walkability and transparency of the rectangle of w*h tiles at (src_x, src_y) of
+	* the source Map to the rectangle at (dest_x, dest_y) of this Map. The source may be this Map.
+	*/
+	void copyRegion(const Map& src, int src_x, int src_y, int w, int h, int dest_x, int dest_y);
+
+	/** @brief Returns the number of walkable tiles of the map. This pages in every chunk.
+	*/
+	int countWalkable() const { return countWalkable(0, 0, width, height); }
+
+	/** @brief Returns the number of walkable tiles of the rectangle (clipped to the map).
+	*/
+	int countWalkable(int x, int y, int w, int h) const;
+
+	/** Whether the tile has been seen (by the player). Positions outside of the map are never explored.
+	*/
+	bool isExplored(int x, int y) const;
+	void setExplored(int x, int y);
+
+	/** Sets the generator for chunks that have not been accessed yet. The Map takes ownership.
+	*/
+	void setGenerator(ChunkGenerator* generator);
+
+	/** Sets the directory modified chunks are written to when they are evicted. Without one
+	* (the default), modified chunks stay resident.
+	*/
+	void setChunkDirectory(const std::string& directory) { chunk_directory = directory; }
+
+	/** Sets the memory the resident chunks may take up, in bytes, and evicts chunks if necessary.
+	*/
+	void setMemoryBudget(size_t bytes);
 
- 	void render(TCODConsole* con) const;
+	/** @brief Fills the given map with the tiles of all modified chunks, resident or paged out.
+	*/
+	void collectModifiedChunks(std::map<int, TileLayer>* result) const;
+
+	/** Takes a view of the modified chunks: copies the resident ones and records (and pins, see
+	* collectChunks()) the files of the paged-out ones without reading them.
+	*/
+	void captureChunks(MapChunkView* view) const;
+
+	/** Reads the files recorded in the view into its chunks and unpins them. This may be called on
+	* any thread, also while the Map is in use; the Map must outlive the view, though.
+	*/
+	void collectChunks(MapChunkView* view) const;
+
+	/** Makes the given chunks the modified chunks of the Map, e.g. after it has been loaded.
+	*/
+	void restoreChunks(const std::map<int, TileLayer>& modified_chunks);
+
+	size_t getMemoryBudget() const { return memory_budget; }
+	size_t getMemoryUsage() const;
+	int getResidentChunkCount() const { return (int)chunks.size(); }
+	unsigned long long getChunkGenerations() const { return chunk_generations; }
+	unsigned long long getChunkLoads() const { return chunk_loads; }
+	unsigned long long getChunkEvictions() const { return chunk_evictions; }
+
+	/** Marks the cell as changed, so it is redrawn in the next frame. Positions outside
+	* of the map are ignored.
+	*/
+	void markDirty(int x, int y)
+	{
+		if (!isInMap(x, y)) { return; }
+
+		MapChunk* chunk = getChunkAt(x, y);
+		if (!chunk->tiles.set(PLANE_DIRTY, x % MapChunk::CHUNK_SIZE, y % MapChunk::CHUNK_SIZE, true)) { return; }
+
+		dirty_cells.push_back(x + y * width);
+	}
+
+	/** Requests a redraw of the whole map in the next frame (e.g. after the console was
+	* covered by the GUI).
+	*/
+	void markAllDirty() { full_redraw = true; }
+
+	bool needsFullRedraw() const { return full_redraw; }
+
+	/** @brief Returns the indices (x + y * width) of the cells marked by markDirty().
+	*/
+	const std::vector<int>& getDirtyCells() const { return dirty_cells; }
+
+	/** @brief Forgets all changes, called once they have been drawn.
+	*/
+	void clearDirty();
+
+	unsigned int getTransparencyVersion() const { return transparency_version; }
+	unsigned int getWalkableVersion() const { return walkable_version; }
+	unsigned long long getFovComputeCount() const { return fov_compute_count; }
+
+	/** Brings the given field of view up to date for the given origin and radius. The field of view
+	* is only computed if the cache was computed for another origin or radius, or before the
+	* transparency of the map last changed.
+	*
+	* @return true if the field of view was recomputed, false if the cache was still valid.
+	*/
+	bool updateFov(FovCache* cache, int x, int y, int radius);
+
+	/** The first half of updateFov(): if the field of view has to be recomputed, the tiles around
+	* the origin are copied into the cache and it is marked pending, to be finished by computeFov().
+	*
+	* @return true if the field of view has to be recomputed, false if the cache was still valid.
+	*/
+	bool prepareFov(FovCache* cache, int x, int y, int radius);
+
+	/** The second half of updateFov(): computes a pending field of view from the tiles copied into
+	* the cache. It only reads the cache, so it may run on any thread.
+	*
+	* @param cache The field of view to compute; nothing is done unless it is pending.
+	* @param fov_map The TCODMap to compute on, which is (re)created if it does not have the size
+	*	of the field of view. Concurrent computations must use different TCODMaps.
+	*/
+	static void computeFov(FovCache* cache, TCODMap** fov_map);
+
+	/** Draws the part of the map visible through the console, whose top left corner shows the
+	* cell (view_x, view_y). Only the chunks within the view are touched.
+	*/
+ 	void render(TCODConsole* con, int view_x, int view_y) const;
+
+	/** Draws a single cell of the map onto the console whose top left corner shows the cell
+	* (view_x, view_y), overwriting whatever was drawn there before.
+	*/
+	void renderCell(TCODConsole* con, int x, int y, int view_x, int view_y) const;
 
 	Map(int width, int height);
-	Map(){};
+	Map() : generator(nullptr), fov_map(nullptr) { init(0, 0); };
 	~Map();
 };
 
-/** @brief A class holding pointers and positions to the actors currently loaded.
+/** The actors are registered in a SlotMap, which resolves the ActorHandle of an Actor in O(1).
+* The map of UUIDs to actors is only used for persistence (it is what is saved, the handles are
+* reassigned on load) and for debugging.
+*
+* Besides the registry, it keeps an occupancy grid the size of the Map,
+* in which every cell holds a pointer to the Actor standing on it (or the nullptr). The grid is
+* updated by addActor(), moveActor() and removeActor(), so occupancy checks are O(1) and 
+* range queries only touch the cells (or, if there are fewer, the actors) in range.
+* Like the tiles of the Map, the grid is split into chunks, which are only allocated once
+* an Actor enters them.
+*
+* @brief A class holding pointers and positions to the actors currently loaded.
 */
 class ActorMap {
 private:
 	std::map<std::string, Actor*>* actors;
-	std::map<std::string, Vector2*>* actor_pos;
 
-	void updateActorPosition(std::string uuid, int pos_x, int pos_y);
+	SlotMap<Actor>* registry;
+
+	/**The chunks of the occupancy grid (index = chunk_x + chunk_y * chunks_x), each of them
+	* MapChunk::CHUNK_SIZE squared cells stored row-major, or the nullptr if no Actor has entered it yet.
+	*/
+	std::vector<Actor**>* occupancy;
+	int width, height;
+	int chunks_x;
+
+	/**The Map on which the cells that actors enter or leave are marked dirty (may be the nullptr).
+	*/
+	Map* dirty_map;
+
+	/**The Journal every move of an actor is recorded in (may be the nullptr).
+	*/
+	Journal* journal;
+
+	bool isInBounds(int pos_x, int pos_y) const { 
+		return pos_x >= 0 && pos_y >= 0 && pos_x < width && pos_y < height; 
+	}
+
+	/**Returns the cell of the occupancy grid at the given position (which must be within bounds).
+	* If the chunk of the cell has not been allocated, it is allocated if allocate is set,
+	* otherwise the nullptr is returned.
+	*/
+	Actor** getOccupancyCell(int pos_x, int pos_y, bool allocate) const;
+
+	void setOccupant(int pos_x, int pos_y, Actor* actor);
+	void clearOccupant(int pos_x, int pos_y, Actor* actor);
+
+	/**Frees all chunks of the occupancy grid and resizes it to the current width and height.
+	*/
+	void resetOccupancy();
+
+	/**Rebuilds the occupancy grid from the positions of all registered actors.
+	*/
+	void rebuildOccupancy();
+
+	/**Registers all actors of the actors map in the registry and assigns their handles.
+	*/
+	void rebuildRegistry();
 
 	friend class boost::serialization::access;
 	template<class Archive>
-	void serialize(Archive & ar, const unsigned int version)
+	void save(Archive & ar, const unsigned int version) const
 	{
-		ar & BOOST_SERIALIZATION_NVP(actors);
-		ar & BOOST_SERIALIZATION_NVP(actor_pos);
+		ar << BOOST_SERIALIZATION_NVP(actors);
+		ar << BOOST_SERIALIZATION_NVP(width);
+		ar << BOOST_SERIALIZATION_NVP(height);
+	}
+
+	template<class Archive>
+	void load(Archive & ar, const unsigned int version)
+	{
+		ar >> BOOST_SERIALIZATION_NVP(actors);
+		ar >> BOOST_SERIALIZATION_NVP(width);
+		ar >> BOOST_SERIALIZATION_NVP(height);
+
+		//Neither the handles nor the grid are stored, they are
+		// derived from the actors map.
+		rebuildRegistry();
+		rebuildOccupancy();
 	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER();
+
 public:
-	void addActor(Actor* actor);
-	void removeActor(std::string uuid);
+	/**@brief Registers the Actor (if it is not already registered) and returns its handle.
+	*/
+	ActorHandle addActor(Actor* actor);
+	void removeActor(ActorHandle actor);
 
 	//This function assumes map and actor map have been tested for collisions
-	void moveActor(std::string uuid, int pos_x, int pos_y);
+	void moveActor(ActorHandle actor, int pos_x, int pos_y);
+
+	bool isActorRegistered(ActorHandle actor) const { return registry->contains(actor); }
 
-	bool isActorRegistered(std::string uuid);
+	/**@brief Returns the Actor the handle refers to, or the nullptr if the handle is stale.
+	*/
+	Actor* getActor(ActorHandle actor) const { return registry->lookup(actor); }
 
 	Actor* getActorByUUID(std::string uuid);
 	const Actor* getActorConstByUUID(std::string uuid);
 
-	std::string isOccupied(int pos_x, int pos_y);
+	/**@brief Returns the handle of the Actor at the given position, or an invalid handle if the cell is free.
+	*/
+	ActorHandle isOccupied(int pos_x, int pos_y) const;
+
+	/**@brief Returns the Actor at the given position, or the nullptr if the cell is free.
+	*/
+	Actor* getActorAt(int pos_x, int pos_y) const;
+
+	/**This function adds all actors within the given (euclidean) radius around the given position
+	* to the result vector. The vector is not cleared beforehand.
+	*
+	* @param pos_x The x coordinate of the center.
+	* @param pos_y The y coordinate of the center.
+	* @param radius The radius (inclusive) in cells.
+	* @param result The vector to add the actors to.
+	* @return The number of actors added.
+	*/
+	int getActorsInRadius(int pos_x, int pos_y, int radius, std::vector<Actor*>* result) const;
+
+	int getActorCount() const { return (int)actors->size(); }
+
+	/**@brief Adds all actors to the result vector, which is not cleared beforehand.
+	*/
+	void getActors(std::vector<Actor*>* result) const;
+
+	void updateActor(ActorHandle actor, Engine* eng, TCOD_key_t key);
+
+	/**Draws all actors visible through the console, whose top left corner shows the cell (view_x, view_y).
+	*/
+	void render(TCODConsole* con, int view_x, int view_y);
+
+	/**Sets the Map on which every cell an Actor enters or leaves is marked dirty.
+	*/
+	void setDirtyMap(Map* map) { dirty_map = map; }
 
-	void updateActor(std::string uuid, Engine* eng, TCOD_key_t key);
-	void render(TCODConsole* con);
+	/**Sets the Journal every move of an Actor is recorded in.
+	*/
+	void setJournal(Journal* journal) { this->journal = journal; }
 
-	ActorMap() : actors(new std::map<std::string, Actor*>()), actor_pos(new std::map<std::string, Vector2*>) {};
+	/**Creates a new, empty ActorMap with an occupancy grid of the given size, which should
+	* match the size of the Map.
+	*/
+	ActorMap(int width, int height);
+	ActorMap() : actors(new std::map<std::string, Actor*>()), registry(new SlotMap<Actor>()), 
+		occupancy(new std::vector<Actor**>()), width(0), height(0), chunks_x(0), dirty_map(nullptr), journal(nullptr) {};
 	~ActorMap();
 };
 
@@ -0,0 +1,7 @@
+#include "MapChunk.hpp"
+
+void FloorGenerator::generate(int chunk_x, int chunk_y, TileLayer* tiles)
+{
+	tiles->fillRect(PLANE_WALKABLE, 0, 0, tiles->getWidth(), tiles->getHeight(), true);
+	tiles->fillRect(PLANE_TRANSPARENT, 0, 0, tiles->getWidth(), tiles->getHeight(), true);
+}
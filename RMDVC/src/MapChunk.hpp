@@ -0,0 +1,53 @@
+#ifndef MAPCHUNK_HPP
+#define MAPCHUNK_HPP
+
+#include "TileLayer.hpp"
+
+/** @brief A square block of CHUNK_SIZE x CHUNK_SIZE tiles of a Map, the unit in which tiles are paged.
+*/
+struct MapChunk {
+	static const int CHUNK_SIZE = 64;
+
+	TileLayer tiles;
+
+	/** The value of the use clock of the Map when the chunk was last accessed, for
+	* evicting the least recently used chunks first.
+	*/
+	unsigned long long last_use;
+
+	/** Whether the tiles differ from what the generator created. Unmodified chunks are
+	* dropped when evicted (and generated again when needed), modified ones written to disk.
+	*/
+	bool modified;
+
+	MapChunk() : tiles(CHUNK_SIZE, CHUNK_SIZE), last_use(0), modified(false) {};
+};
+
+/** The generator creates the tiles of a chunk the first time the chunk is accessed (unless
+* it was written to disk before). It must always create the same tiles for the same chunk, as
+* unmodified chunks are not stored anywhere but generated again when they are needed again.
+* Generators drawing random numbers therefore use a stream of their own per chunk, derived with
+* RandomService::deriveStream(RANDOM_MAP, chunk index).
+*
+* @brief The source of the tiles of chunks that have never been modified.
+*/
+class ChunkGenerator
+{
+public:
+	/** Fills the tiles of the chunk at the given chunk coordinates (tile coordinates / CHUNK_SIZE),
+	* which are all cleared beforehand.
+	*/
+	virtual void generate(int chunk_x, int chunk_y, TileLayer* tiles) = 0;
+
+	virtual ~ChunkGenerator() {};
+};
+
+/** @brief Generates open floor: every tile is walkable and transparent.
+*/
+class FloorGenerator : public ChunkGenerator
+{
+public:
+	void generate(int chunk_x, int chunk_y, TileLayer* tiles);
+};
+
+#endif
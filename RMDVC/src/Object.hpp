@@ -2,11 +2,11 @@
 #define OBJECT_HPP
 
 #include "libtcod.hpp"
+#include "Random.hpp"
 #include <string>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
-#include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_serialize.hpp>
 
 #include <boost/serialization/access.hpp>
@@ -33,12 +33,22 @@ private:
 protected:
 	uuid id;
 
+	/**Gives the object a new random UUID, e.g. after it has been copied from a prototype.
+	*/
+	void renewUUID() { id = RandomService::getInstance()->nextUUID(); }
+
 public:
 	string getUUID(){ return boost::uuids::to_string(id); }
 
+	/**@brief Returns the UUID in its binary form (16 bytes), e.g. for compact records.
+	*/
+	const uuid& getRawUUID() const { return id; }
+
 	virtual string toString() { return getUUID(); }
 
-	Object() : id(boost::uuids::random_generator()()) {};
+	/**The UUID is drawn from the RandomService, so it is the same in every game with the same seed.
+	*/
+	Object() : id(RandomService::getInstance()->nextUUID()) {};
 	~Object() {};
 };
 
@@ -83,8 +93,8 @@ protected:
 	RenderObject(int x, int y, TCODColor fore, TCODColor back, wchar_t ch = 20);
 
 public:
-	int getPosX(){ return pos_x; }
-	int getPosY(){ return pos_y; }
+	int getPosX() const { return pos_x; }
+	int getPosY() const { return pos_y; }
 
 	TCODColor getForeColor() { return foreground_color; }
 	TCODColor getBackColor() { return background_color; }
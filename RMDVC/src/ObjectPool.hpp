@@ -0,0 +1,110 @@
+#ifndef OBJECTPOOL_HPP
+#define OBJECTPOOL_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/** @brief Allocation counters of an ObjectPool.
+*/
+struct PoolStats {
+	/** The number of objects allocated from and released to the pool.
+	*/
+	unsigned long long allocations;
+	unsigned long long releases;
+
+	/** The number of times the pool requested memory from the heap, each time for BLOCK_SIZE objects.
+	*/
+	unsigned long long heap_allocations;
+
+	unsigned long long getLiveCount() const { return allocations - releases; }
+
+	PoolStats() : allocations(0), releases(0), heap_allocations(0) {};
+};
+
+/** Released memory is kept on a free list and handed out again by the next allocation, so once
+* the pool has grown to the largest number of objects alive at the same time, allocating and releasing
+* never touch the heap. Memory is requested from the heap in blocks of BLOCK_SIZE objects and only
+* returned when the pool is destroyed.
+*
+* A class uses a pool by forwarding its class-specific operator new and operator delete to
+* allocate() and release(), so its objects are still created with new and destroyed with delete
+* (also by Boost when loading a saved game).
+*
+* @brief A free list of memory for objects of type T.
+*/
+template<class T>
+class ObjectPool
+{
+private:
+	union Slot {
+		Slot* next;
+		typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+	};
+
+	static const int BLOCK_SIZE = 64;
+
+	Slot* free_list;
+	std::vector<Slot*> blocks;
+
+	PoolStats stats;
+
+	void grow()
+	{
+		Slot* block = new Slot[BLOCK_SIZE];
+		blocks.push_back(block);
+		stats.heap_allocations++;
+
+		for (int i = BLOCK_SIZE - 1; i >= 0; i--)
+		{
+			block[i].next = free_list;
+			free_list = &block[i];
+		}
+	}
+
+public:
+	/** Returns memory for an object of the given size. Objects of classes derived from T
+	* (which are larger) are allocated on the heap instead.
+	*/
+	void* allocate(size_t size)
+	{
+		if (size != sizeof(T)) { return ::operator new(size); }
+
+		if (free_list == nullptr) { grow(); }
+
+		Slot* slot = free_list;
+		free_list = slot->next;
+		stats.allocations++;
+
+		return slot;
+	}
+
+	/** Returns the memory of an object of the given size, which was allocated with allocate().
+	*/
+	void release(void* p, size_t size)
+	{
+		if (p == nullptr) { return; }
+
+		if (size != sizeof(T))
+		{
+			::operator delete(p);
+			return;
+		}
+
+		Slot* slot = static_cast<Slot*>(p);
+		slot->next = free_list;
+		free_list = slot;
+		stats.releases++;
+	}
+
+	const PoolStats& getStats() const { return stats; }
+
+	ObjectPool() : free_list(nullptr) {};
+	~ObjectPool()
+	{
+		for (auto it = blocks.begin(); it != blocks.end(); it++) { delete[] *it; }
+	};
+};
+
+#endif
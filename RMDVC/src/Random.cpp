@@ -0,0 +1,105 @@
+#include "Random.hpp"
+
+#include <chrono>
+#include <utility>
+
+/** The SplitMix64 output function, which turns the counter into well-mixed bits.
+*/
+static unsigned long long mix(unsigned long long z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static const unsigned long long GOLDEN_GAMMA = 0x9E3779B97F4A7C15ULL;
+
+unsigned long long RandomStream::next()
+{
+	state += GOLDEN_GAMMA;
+	return mix(state);
+}
+
+int RandomStream::getInt(int min, int max)
+{
+	if (max < min) { std::swap(min, max); }
+
+	//The range is mapped onto the upper 32 bits by multiplication, which avoids a division
+	unsigned long long range = (unsigned long long)((long long)max - (long long)min) + 1;
+	return (int)((long long)min + (long long)(((next() >> 32) * range) >> 32));
+}
+
+float RandomStream::getFloat(float min, float max)
+{
+	//24 bits fill the mantissa of a float
+	float unit = (float)(next() >> 40) * (1.0f / 16777216.0f);
+	return min + unit * (max - min);
+}
+
+RandomService::RandomService()
+{
+	setSeed(1);
+}
+
+RandomService* RandomService::getInstance()
+{
+	static RandomService instance;
+	return &instance;
+}
+
+void RandomService::setSeed(unsigned int seed)
+{
+	if (seed == 0)
+	{
+		seed = (unsigned int)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+		if (seed == 0) { seed = 1; }
+	}
+
+	this->seed = seed;
+
+	for (int i = 0; i < SIZE_OF_RANDOM_SUBSYSTEM_ENUM; i++)
+	{
+		streams[i] = RandomStream(mix(seed + GOLDEN_GAMMA * (i + 1)));
+	}
+}
+
+RandomStream RandomService::deriveStream(RandomSubsystem subsystem, unsigned long long key) const
+{
+	return RandomStream(mix(mix(seed + GOLDEN_GAMMA * (subsystem + 1)) ^ mix(key + GOLDEN_GAMMA)));
+}
+
+boost::uuids::uuid RandomService::nextUUID()
+{
+	boost::uuids::uuid id;
+	RandomStream* stream = getStream(RANDOM_UUID);
+
+	for (int half = 0; half < 2; half++)
+	{
+		unsigned long long bits = stream->next();
+		for (int i = 0; i < 8; i++) { id.data[half * 8 + i] = (unsigned char)(bits >> (i * 8)); }
+	}
+
+	//Mark it as a random UUID (version 4, RFC 4122 variant)
+	id.data[6] = (id.data[6] & 0x0F) | 0x40;
+	id.data[8] = (id.data[8] & 0x3F) | 0x80;
+
+	return id;
+}
+
+RandomState RandomService::getState() const
+{
+	RandomState state;
+	state.seed = seed;
+	state.streams.assign(streams, streams + SIZE_OF_RANDOM_SUBSYSTEM_ENUM);
+	return state;
+}
+
+void RandomService::setState(const RandomState& state)
+{
+	setSeed(state.seed);
+
+	for (size_t i = 0; i < state.streams.size() && i < SIZE_OF_RANDOM_SUBSYSTEM_ENUM; i++)
+	{
+		streams[i] = state.streams[i];
+	}
+}
@@ -0,0 +1,128 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/vector.hpp>
+
+/** The subsystems drawing random numbers, each of which has a stream of its own in the RandomService,
+* so the numbers drawn by one subsystem do not depend on how many the others have drawn.
+*/
+enum RandomSubsystem {
+	RANDOM_UUID,
+	RANDOM_BODY,
+	RANDOM_AI,
+	RANDOM_MAP,
+	RANDOM_INPUT,
+	SIZE_OF_RANDOM_SUBSYSTEM_ENUM
+};
+
+/** The generator is SplitMix64: its whole state is one 64 bit counter, so it is cheap to create,
+* copy and save, and streams created from different seeds are independent.
+* It has the same interface as TCODRandom for the functions the game uses.
+*
+* @brief A seedable stream of random numbers whose state can be saved.
+*/
+class RandomStream
+{
+private:
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version)
+	{
+		ar & BOOST_SERIALIZATION_NVP(state);
+	}
+
+	unsigned long long state;
+
+public:
+	/** @brief Returns the next 64 random bits.
+	*/
+	unsigned long long next();
+
+	/** @brief Returns a random integer in [min, max] (both inclusive).
+	*/
+	int getInt(int min, int max);
+
+	/** @brief Returns a random float in [min, max).
+	*/
+	float getFloat(float min, float max);
+
+	unsigned long long getState() const { return state; }
+
+	RandomStream(unsigned long long seed = 0) : state(seed) {};
+};
+
+/** @brief The master seed and the state of all streams of the RandomService, as stored in saved games.
+*/
+struct RandomState {
+private:
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version)
+	{
+		ar & BOOST_SERIALIZATION_NVP(seed);
+		ar & BOOST_SERIALIZATION_NVP(streams);
+	}
+
+public:
+	unsigned int seed;
+	std::vector<RandomStream> streams;
+
+	RandomState() : seed(0) {};
+};
+
+/** All randomness of the game is drawn from streams that are derived from one master seed: one
+* stream per subsystem (see RandomSubsystem) and, for things that need a stream of their own (e.g.
+* one Actor or one map chunk), streams derived from a subsystem and a key. Given the same seed and
+* the same input, a game therefore plays out exactly the same, including the UUIDs of all Objects.
+*
+* The master seed and the state of the subsystem streams are stored in saved games, so a game
+* continues the same way after loading. The service is not synchronized: random numbers are only
+* drawn on the main thread.
+*
+* @brief The source of all random numbers of the game.
+*/
+class RandomService
+{
+private:
+	unsigned int seed;
+	RandomStream streams[SIZE_OF_RANDOM_SUBSYSTEM_ENUM];
+
+	RandomService();
+
+public:
+	static RandomService* getInstance();
+
+	/** Reseeds all subsystem streams from the given master seed. With 0, a seed is picked
+	* from the clock (and can be read with getSeed() to repeat the game).
+	*/
+	void setSeed(unsigned int seed);
+	unsigned int getSeed() const { return seed; }
+
+	/** @brief Returns the stream of the given subsystem.
+	*/
+	RandomStream* getStream(RandomSubsystem subsystem) { return &streams[subsystem]; }
+
+	/** Returns a new stream derived from the master seed, the subsystem and the key. The same
+	* key always yields the same stream (for the same seed), however many numbers have been drawn
+	* from the subsystem stream; e.g. a map chunk generated again gets the same tiles.
+	*/
+	RandomStream deriveStream(RandomSubsystem subsystem, unsigned long long key) const;
+
+	/** Returns a new (version 4, i.e. random) UUID drawn from the RANDOM_UUID stream.
+	*/
+	boost::uuids::uuid nextUUID();
+
+	RandomState getState() const;
+
+	/** Restores the seed and streams from a saved game. States with a different number of
+	* streams (of other versions) only restore the seed and the streams they hold.
+	*/
+	void setState(const RandomState& state);
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include "SaveGame.hpp"
+#include "Map.hpp"
+#include "Actor.hpp"
+#include "Action.hpp"
+#include "Ai.hpp"
+#include "Body.hpp"
+#include "Destructible.hpp"
+#include "Diagnostics.hpp"
+
+#include <fstream>
+#include <exception>
+#include <string>
+
+#include <boost/archive/xml_oarchive.hpp>
+#include <boost/archive/xml_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/serialization/export.hpp>
+
+//The exports have to follow the includes of all archives they are used with
+BOOST_CLASS_EXPORT_GUID(BodyPart, "BodyPart")
+BOOST_CLASS_EXPORT_GUID(Organ, "Organ")
+BOOST_CLASS_EXPORT_GUID(PlayerAi, "PlayerAi")
+BOOST_CLASS_EXPORT_GUID(MeleeAi, "MeleeAi")
+BOOST_CLASS_EXPORT_GUID(MoveAction, "MoveAction")
+BOOST_CLASS_EXPORT_GUID(IdleAction, "IdleAction")
+
+const unsigned int SAVE_BINARY_MAGIC = 0x53444D52;
+const unsigned int SAVE_BINARY_VERSION = 6;
+
+struct PendingSave {
+	std::ostream* os;
+	boost::archive::binary_oarchive* archive;
+	const Map* map;
+	MapChunkView chunks;
+	std::string name;
+};
+
+/** Writes everything but the modified map chunks, which follow it (see writeChunks()).
+*/
+template<class Archive>
+static void writeState(Archive& oa, const SaveGameData& data)
+{
+	oa << boost::serialization::make_nvp("actors", data.actors);
+	oa << boost::serialization::make_nvp("map", data.map);
+	oa << boost::serialization::make_nvp("scheduler", data.scheduler);
+	oa << boost::serialization::make_nvp("player", data.player);
+	oa << boost::serialization::make_nvp("random", data.random);
+}
+
+/** Writes the modified map chunks, the largest part of a save. Unmodified chunks are generated again on load.
+*/
+template<class Archive>
+static void writeChunks(Archive& oa, const std::map<int, TileLayer>& modified_chunks)
+{
+	oa << boost::serialization::make_nvp("modified_chunks", modified_chunks);
+}
+
+template<class Archive>
+static void writeData(Archive& oa, const SaveGameData& data)
+{
+	writeState(oa, data);
+
+	std::map<int, TileLayer> modified_chunks;
+	data.map->collectModifiedChunks(&modified_chunks);
+	writeChunks(oa, modified_chunks);
+}
+
+template<class Archive>
+static void readData(Archive& ia, SaveGameData* data)
+{
+	ia >> boost::serialization::make_nvp("actors", data->actors);
+	ia >> boost::serialization::make_nvp("map", data->map);
+	ia >> boost::serialization::make_nvp("scheduler", data->scheduler);
+	ia >> boost::serialization::make_nvp("player", data->player);
+	ia >> boost::serialization::make_nvp("random", data->random);
+
+	std::map<int, TileLayer> modified_chunks;
+	ia >> boost::serialization::make_nvp("modified_chunks", modified_chunks);
+	data->map->restoreChunks(modified_chunks);
+}
+
+bool saveGame(std::ostream& os, SaveFormat format, const SaveGameData& data, const char* name)
+{
+	try {
+		if (format == SaveFormat::XML)
+		{
+			boost::archive::xml_oarchive oa(os);
+			writeData(oa, data);
+		}
+		else
+		{
+			os.write((const char*)&SAVE_BINARY_MAGIC, sizeof(SAVE_BINARY_MAGIC));
+			os.write((const char*)&SAVE_BINARY_VERSION, sizeof(SAVE_BINARY_VERSION));
+
+			boost::archive::binary_oarchive oa(os);
+			writeData(oa, data);
+		}
+	}
+	catch (std::exception& e) {
+		debug_error("ERROR while saving %s: %s\n", name, e.what());
+		return false;
+	}
+
+	return (bool)os;
+}
+
+PendingSave* beginSave(std::ostream& os, const SaveGameData& data, const char* name)
+{
+	PendingSave* save = new PendingSave();
+	save->os = &os;
+	save->archive = nullptr;
+	save->map = data.map;
+	save->name = name;
+
+	try {
+		os.write((const char*)&SAVE_BINARY_MAGIC, sizeof(SAVE_BINARY_MAGIC));
+		os.write((const char*)&SAVE_BINARY_VERSION, sizeof(SAVE_BINARY_VERSION));
+
+		save->archive = new boost::archive::binary_oarchive(os);
+		writeState(*save->archive, data);
+	}
+	catch (std::exception& e) {
+		debug_error("ERROR while saving %s: %s\n", name, e.what());
+		delete save->archive;
+		delete save;
+		return nullptr;
+	}
+
+	//Nothing can fail from here on, so the pins taken by the view are always released by finishSave()
+	data.map->captureChunks(&save->chunks);
+	return save;
+}
+
+bool finishSave(PendingSave* save)
+{
+	save->map->collectChunks(&save->chunks);
+
+	bool success = true;
+	try {
+		writeChunks(*save->archive, save->chunks.chunks);
+	}
+	catch (std::exception& e) {
+		debug_error("ERROR while saving %s: %s\n", save->name.c_str(), e.what());
+		success = false;
+	}
+
+	delete save->archive;
+	success = success && (bool)*save->os;
+
+	delete save;
+	return success;
+}
+
+bool saveGame(const char* filename, SaveFormat format, const SaveGameData& data)
+{
+	std::ofstream ofs(filename, format == SaveFormat::BINARY ? std::ios::out | std::ios::binary : std::ios::out);
+	if (!ofs) { return false; }
+
+	return saveGame(ofs, format, data, filename);
+}
+
+bool loadGame(std::istream& is, SaveFormat format, SaveGameData* data, const char* name)
+{
+	SaveGameData loaded;
+
+	try {
+		if (format == SaveFormat::XML)
+		{
+			boost::archive::xml_iarchive ia(is);
+			readData(ia, &loaded);
+		}
+		else
+		{
+			unsigned int magic = 0, version = 0;
+			is.read((char*)&magic, sizeof(magic));
+			is.read((char*)&version, sizeof(version));
+
+			if (!is || magic != SAVE_BINARY_MAGIC)
+			{
+				debug_error("ERROR while loading %s: not a binary save.\n", name);
+				return false;
+			}
+			if (version != SAVE_BINARY_VERSION)
+			{
+				debug_error("ERROR while loading %s: save format version %u, expected %u.\n",
+					name, version, SAVE_BINARY_VERSION);
+				return false;
+			}
+
+			boost::archive::binary_iarchive ia(is);
+			readData(ia, &loaded);
+		}
+	}
+	catch (std::exception& e) {
+		debug_error("ERROR while loading %s: %s\n", name, e.what());
+		return false;
+	}
+
+	loaded.actors->addActor(loaded.player);
+	loaded.actors->setDirtyMap(loaded.map);
+
+	*data = loaded;
+	return true;
+}
+
+bool loadGame(const char* filename, SaveFormat format, SaveGameData* data)
+{
+	std::ifstream ifs(filename, format == SaveFormat::BINARY ? std::ios::in | std::ios::binary : std::ios::in);
+	if (!ifs) { return false; }
+
+	return loadGame(ifs, format, data, filename);
+}
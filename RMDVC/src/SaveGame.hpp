@@ -0,0 +1,88 @@
+#ifndef SAVEGAME_HPP
+#define SAVEGAME_HPP
+
+class Actor;
+class ActorMap;
+class Map;
+class ActionScheduler;
+struct PendingSave;
+
+#include "Random.hpp"
+
+#include <iostream>
+
+/** The formats a game can be saved in. The XML format is human-readable but verbose and slow,
+* the binary format is a Boost binary archive behind a header holding a magic number and the
+* format version (see SAVE_BINARY_VERSION), which is checked on load. Binary saves are not
+* portable between platforms of different endianness or type sizes. XML saves carry no version, so
+* only XML saves of the current version can be read.
+*
+* @brief The file formats of saved games.
+*/
+enum class SaveFormat { XML, BINARY };
+
+/** The magic number at the beginning of every binary save ("RMDS").
+*/
+extern const unsigned int SAVE_BINARY_MAGIC;
+
+/** The version of the binary save format. It has to be incremented whenever the serialized
+* data of any class changes; saves of other versions are refused.
+*/
+extern const unsigned int SAVE_BINARY_VERSION;
+
+/** @brief The parts of the game state that make up a saved game.
+*/
+struct SaveGameData {
+	ActorMap* actors;
+	Map* map;
+	ActionScheduler* scheduler;
+	Actor* player;
+
+	/** The master seed and the random streams, so the game continues the same way after loading.
+	* It is stored last, after everything whose loading draws UUIDs.
+	*/
+	RandomState random;
+
+	SaveGameData() : actors(nullptr), map(nullptr), scheduler(nullptr), player(nullptr) {};
+};
+
+/** Writes the game state to the given file.
+*
+* @return false if the file could not be written.
+*/
+bool saveGame(const char* filename, SaveFormat format, const SaveGameData& data);
+
+/** Writes the game state to the given stream (opened in binary mode for binary saves),
+* e.g. into memory. The name is only used in error messages.
+*/
+bool saveGame(std::ostream& os, SaveFormat format, const SaveGameData& data, const char* name);
+
+/** Writes a binary save to the given stream in two steps: beginSave() serializes the game state
+* except for the tiles of the modified map chunks, of which it only takes a view (see MapChunkView),
+* so the game can go on right away. finishSave() reads the paged-out chunks and serializes the tiles,
+* which may be done on another thread. The stream must stay alive until then; the Map must outlive
+* the PendingSave.
+*
+* @return The save to be finished, or the nullptr if it failed (the error is reported).
+*/
+PendingSave* beginSave(std::ostream& os, const SaveGameData& data, const char* name);
+
+/** Completes and deletes a save begun by beginSave().
+*
+* @return false if the save failed.
+*/
+bool finishSave(PendingSave* save);
+
+/** Reads a game state from the given file into newly allocated objects. The player is registered
+* in the ActorMap, which is linked to the Map, so the game can be resumed right away.
+*
+* @return false if the file could not be read or (for binary saves) is of another format version,
+*  in which case data is not modified.
+*/
+bool loadGame(const char* filename, SaveFormat format, SaveGameData* data);
+
+/** Reads a game state from the given stream, like loadGame(filename, ...). The name is only used in error messages.
+*/
+bool loadGame(std::istream& is, SaveFormat format, SaveGameData* data, const char* name);
+
+#endif
@@ -0,0 +1,61 @@
+#include "Symbol.hpp"
+
+#include <deque>
+#include <unordered_map>
+
+namespace {
+
+/** The texts are kept in a deque, which never moves its elements, so the references
+* returned by Symbol::str() stay valid while new texts are added.
+*/
+struct SymbolTable {
+	std::deque<std::string> texts;
+	std::unordered_map<std::string, unsigned int> values;
+
+	SymbolTable()
+	{
+		texts.push_back(std::string());
+		values[std::string()] = 0;
+	}
+};
+
+//The table is created on first use, so symbols can be interned during static initialization
+SymbolTable& getTable()
+{
+	static SymbolTable table;
+	return table;
+}
+
+}
+
+Symbol Symbol::intern(const std::string& text)
+{
+	SymbolTable& table = getTable();
+
+	auto it = table.values.find(text);
+	if (it != table.values.end()) { return Symbol(it->second); }
+
+	unsigned int value = (unsigned int)table.texts.size();
+	table.texts.push_back(text);
+	table.values[text] = value;
+
+	return Symbol(value);
+}
+
+Symbol Symbol::find(const std::string& text)
+{
+	SymbolTable& table = getTable();
+
+	auto it = table.values.find(text);
+	return it == table.values.end() ? Symbol() : Symbol(it->second);
+}
+
+int Symbol::getTableSize()
+{
+	return (int)getTable().texts.size();
+}
+
+const std::string& Symbol::str() const
+{
+	return getTable().texts[value];
+}
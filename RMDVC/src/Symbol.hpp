@@ -0,0 +1,96 @@
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include <string>
+#include <ostream>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/level.hpp>
+#include <boost/serialization/tracking.hpp>
+
+/** Identifiers that are read from the body-definition XML (the ids and names of Parts and Tissues)
+* are interned in one global symbol table: every distinct text is stored once, and a Symbol is
+* only the 32-bit number of its entry. Symbols are compared as integers, and every Body shares the
+* text, which is only looked up (by str()) for display.
+*
+* The numbers depend on the order in which texts are interned, so archives store the text
+* itself and intern it again on load.
+*
+* The symbol table is not synchronized; symbols are interned while loading body definitions
+* and saved games, which happens on the main thread.
+*
+* @brief An interned identifier string.
+*/
+class Symbol
+{
+private:
+	/** The index of the text in the symbol table. 0 is the empty string.
+	*/
+	unsigned int value;
+
+	explicit Symbol(unsigned int value) : value(value) {};
+
+	friend class boost::serialization::access;
+	template<class Archive>
+	void save(Archive & ar, const unsigned int version) const
+	{
+		std::string text = str();
+		ar << BOOST_SERIALIZATION_NVP(text);
+	}
+
+	template<class Archive>
+	void load(Archive & ar, const unsigned int version)
+	{
+		std::string text;
+		ar >> BOOST_SERIALIZATION_NVP(text);
+		value = intern(text).value;
+	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER();
+
+public:
+	/** Returns the symbol of the given text, adding the text to the symbol table if it is new.
+	*/
+	static Symbol intern(const std::string& text);
+
+	/** Returns the symbol of the given text without adding it to the symbol table,
+	* or the empty symbol if the text has never been interned (so nothing can be identified by it).
+	* This is used for lookups by text that may not be valid.
+	*/
+	static Symbol find(const std::string& text);
+
+	/** @brief Returns the number of distinct texts in the symbol table.
+	*/
+	static int getTableSize();
+
+	/** @brief Returns the text of the symbol, which stays valid for the lifetime of the program.
+	*/
+	const std::string& str() const;
+	const char* c_str() const { return str().c_str(); }
+
+	bool empty() const { return value == 0; }
+	unsigned int getValue() const { return value; }
+
+	bool operator==(const Symbol& other) const { return value == other.value; }
+	bool operator!=(const Symbol& other) const { return value != other.value; }
+
+	/** Orders symbols by their number (not alphabetically), so they can be used as map keys.
+	*/
+	bool operator<(const Symbol& other) const { return value < other.value; }
+
+	Symbol() : value(0) {};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const Symbol& symbol)
+{
+	return stream << symbol.str();
+}
+
+//A Symbol is stored as its bare text, without class information or object tracking
+BOOST_CLASS_IMPLEMENTATION(Symbol, boost::serialization::object_serializable)
+BOOST_CLASS_TRACKING(Symbol, boost::serialization::track_never)
+
+#endif
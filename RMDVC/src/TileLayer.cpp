@@ -0,0 +1,179 @@
+#include "TileLayer.hpp"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+static TileLayer::Word lowMask(int count)
+{
+	return count >= TileLayer::WORD_BITS ? ~(TileLayer::Word)0 : ((TileLayer::Word)1 << count) - 1;
+}
+
+int TileLayer::popCount(Word word)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(word);
+#elif defined(__GNUC__)
+	return __builtin_popcountll(word);
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+void TileLayer::resize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	words_per_row = (width + WORD_BITS - 1) / WORD_BITS;
+
+	bits.assign(PLANE_COUNT * height * words_per_row, 0);
+}
+
+bool TileLayer::clip(int* x, int* y, int* w, int* h) const
+{
+	if (*x < 0) { *w += *x; *x = 0; }
+	if (*y < 0) { *h += *y; *y = 0; }
+	if (*x + *w > width) { *w = width - *x; }
+	if (*y + *h > height) { *h = height - *y; }
+
+	return *w > 0 && *h > 0;
+}
+
+TileLayer::Word TileLayer::readBits(const Word* row, int bit, int count)
+{
+	int word = bit / WORD_BITS;
+	int offset = bit % WORD_BITS;
+
+	Word value = row[word] >> offset;
+	if (offset > 0 && offset + count > WORD_BITS)
+	{
+		value |= row[word + 1] << (WORD_BITS - offset);
+	}
+
+	return value & lowMask(count);
+}
+
+int TileLayer::writeBits(Word* row, int bit, int count, Word value)
+{
+	int word = bit / WORD_BITS;
+	int offset = bit % WORD_BITS;
+
+	//The bits in the first word...
+	int first_count = count < WORD_BITS - offset ? count : WORD_BITS - offset;
+	Word mask = lowMask(first_count) << offset;
+	Word old = row[word];
+	row[word] = (old & ~mask) | ((value << offset) & mask);
+	int changed = popCount(old ^ row[word]);
+
+	//...and the rest in the next one
+	if (count > first_count)
+	{
+		mask = lowMask(count - first_count);
+		old = row[word + 1];
+		row[word + 1] = (old & ~mask) | ((value >> first_count) & mask);
+		changed += popCount(old ^ row[word + 1]);
+	}
+
+	return changed;
+}
+
+int TileLayer::fillRect(int plane, int x, int y, int w, int h, bool value)
+{
+	if (!clip(&x, &y, &w, &h)) { return 0; }
+
+	Word pattern = value ? ~(Word)0 : 0;
+	int changed = 0;
+
+	for (int row = y; row < y + h; row++)
+	{
+		Word* bits = getRow(plane, row);
+		for (int i = 0; i < w; i += WORD_BITS)
+		{
+			int count = w - i < WORD_BITS ? w - i : WORD_BITS;
+			changed += writeBits(bits, x + i, count, pattern);
+		}
+	}
+
+	return changed;
+}
+
+int TileLayer::copyRegion(const TileLayer& src, int plane, int src_x, int src_y, int w, int h, int dest_x, int dest_y)
+{
+	//Copying within the layer could overwrite bits that are yet to be read
+	if (&src == this)
+	{
+		TileLayer copy(*this);
+		return copyRegion(copy, plane, src_x, src_y, w, h, dest_x, dest_y);
+	}
+
+	//Clip against the source, then against this layer, moving the other rectangle along
+	int x = src_x, y = src_y;
+	if (!src.clip(&x, &y, &w, &h)) { return 0; }
+	dest_x += x - src_x;
+	dest_y += y - src_y;
+	src_x = x; src_y = y;
+
+	x = dest_x; y = dest_y;
+	if (!clip(&x, &y, &w, &h)) { return 0; }
+	src_x += x - dest_x;
+	src_y += y - dest_y;
+	dest_x = x; dest_y = y;
+
+	int changed = 0;
+
+	for (int row = 0; row < h; row++)
+	{
+		const Word* from = src.getRow(plane, src_y + row);
+		Word* to = getRow(plane, dest_y + row);
+
+		for (int i = 0; i < w; i += WORD_BITS)
+		{
+			int count = w - i < WORD_BITS ? w - i : WORD_BITS;
+			changed += writeBits(to, dest_x + i, count, readBits(from, src_x + i, count));
+		}
+	}
+
+	return changed;
+}
+
+int TileLayer::countRect(int plane, int x, int y, int w, int h) const
+{
+	if (!clip(&x, &y, &w, &h)) { return 0; }
+
+	int result = 0;
+
+	for (int row = y; row < y + h; row++)
+	{
+		const Word* bits = getRow(plane, row);
+		for (int i = 0; i < w; i += WORD_BITS)
+		{
+			int count = w - i < WORD_BITS ? w - i : WORD_BITS;
+			result += popCount(readBits(bits, x + i, count));
+		}
+	}
+
+	return result;
+}
+
+int TileLayer::count(int plane) const
+{
+	//The bits past the width are always zero, so whole rows can be counted
+	int result = 0;
+	int words = height * words_per_row;
+	if (words == 0) { return 0; }
+
+	const Word* bits = &this->bits[plane * words];
+
+	for (int i = 0; i < words; i++) { result += popCount(bits[i]); }
+
+	return result;
+}
+
+void TileLayer::clearPlane(int plane)
+{
+	int words = height * words_per_row;
+	std::fill(bits.begin() + plane * words, bits.begin() + (plane + 1) * words, 0);
+}
@@ -0,0 +1,154 @@
+#ifndef TILELAYER_HPP
+#define TILELAYER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/split_member.hpp>
+
+/** @brief The properties stored per tile, one bit-plane each.
+*/
+enum TilePlane {
+	PLANE_WALKABLE = 0,
+	PLANE_TRANSPARENT = 1,
+	PLANE_EXPLORED = 2,
+
+	/** Cells whose appearance has changed since the last frame. This plane is not saved.
+	*/
+	PLANE_DIRTY = 3,
+
+	PLANE_COUNT = 4
+};
+
+/** Every property of the tiles is stored as a bit-plane: one bit per tile, packed into 64-bit words
+* row by row (each row starting at a new word, the bits past the width of the layer are always zero).
+* A tile with all properties thus takes up half a byte, and operations on rectangles
+* (fillRect(), copyRegion(), countRect()) work on up to 64 tiles of a row at once.
+*
+* The operations that change tiles return the number of tiles that actually changed, so the
+* owner (the Map) can tell whether it has to update anything derived from the tiles.
+*
+* @brief Bit-packed storage for the per-tile properties of a Map.
+*/
+class TileLayer
+{
+public:
+	typedef unsigned long long Word;
+	static const int WORD_BITS = 64;
+
+private:
+	int width, height;
+	int words_per_row;
+
+	/** All planes, plane after plane, row after row.
+	*/
+	std::vector<Word> bits;
+
+	Word* getRow(int plane, int y) { return &bits[(plane * height + y) * words_per_row]; }
+	const Word* getRow(int plane, int y) const { return &bits[(plane * height + y) * words_per_row]; }
+
+	/** Clips the rectangle to the layer.
+	* @return false if nothing of the rectangle is left.
+	*/
+	bool clip(int* x, int* y, int* w, int* h) const;
+
+	/** Reads count (1 to WORD_BITS) bits of the row, starting at the given bit, into the low bits of a word.
+	*/
+	static Word readBits(const Word* row, int bit, int count);
+
+	/** Overwrites count (1 to WORD_BITS) bits of the row, starting at the given bit, with the low bits of value.
+	* @return The number of bits that changed.
+	*/
+	static int writeBits(Word* row, int bit, int count, Word value);
+
+	friend class boost::serialization::access;
+	template<class Archive>
+	void save(Archive & ar, const unsigned int version) const
+	{
+		ar << BOOST_SERIALIZATION_NVP(width);
+		ar << BOOST_SERIALIZATION_NVP(height);
+
+		//The dirty plane is the last one, it is left out
+		std::vector<Word> planes(bits.begin(), bits.begin() + PLANE_DIRTY * height * words_per_row);
+		ar << BOOST_SERIALIZATION_NVP(planes);
+	}
+
+	template<class Archive>
+	void load(Archive & ar, const unsigned int version)
+	{
+		int w, h;
+		ar >> boost::serialization::make_nvp("width", w);
+		ar >> boost::serialization::make_nvp("height", h);
+		resize(w, h);
+
+		std::vector<Word> planes;
+		ar >> BOOST_SERIALIZATION_NVP(planes);
+		std::copy(planes.begin(), planes.begin() + std::min(planes.size(), bits.size()), bits.begin());
+	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER();
+
+public:
+	/** @brief Returns the number of set bits in the word.
+	*/
+	static int popCount(Word word);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	/** Resizes the layer, clearing all planes.
+	*/
+	void resize(int width, int height);
+
+	bool get(int plane, int x, int y) const
+	{
+		return ((getRow(plane, y)[x / WORD_BITS] >> (x % WORD_BITS)) & 1) != 0;
+	}
+
+	/** @return true if the bit changed.
+	*/
+	bool set(int plane, int x, int y, bool value)
+	{
+		Word& word = getRow(plane, y)[x / WORD_BITS];
+		Word mask = (Word)1 << (x % WORD_BITS);
+		if (((word & mask) != 0) == value) { return false; }
+
+		word ^= mask;
+		return true;
+	}
+
+	/** Sets the given plane of all tiles of the rectangle (clipped to the layer) to the value.
+	* @return The number of tiles that changed.
+	*/
+	int fillRect(int plane, int x, int y, int w, int h, bool value);
+
+	/** Copies the given plane of the rectangle of w*h tiles at (src_x, src_y) of the source layer
+	* to the rectangle at (dest_x, dest_y) of this layer. The parts of the rectangles outside of
+	* either layer are skipped. The source may be this layer, even if the rectangles overlap.
+	* @return The number of tiles that changed.
+	*/
+	int copyRegion(const TileLayer& src, int plane, int src_x, int src_y, int w, int h, int dest_x, int dest_y);
+
+	/** @brief Returns the number of tiles of the rectangle (clipped to the layer) whose bit is set.
+	*/
+	int countRect(int plane, int x, int y, int w, int h) const;
+
+	/** @brief Returns the number of tiles of the layer whose bit is set.
+	*/
+	int count(int plane) const;
+
+	/** @brief Clears the plane of all tiles at once.
+	*/
+	void clearPlane(int plane);
+
+	/** @brief Returns the memory used by the bits of all planes, in bytes.
+	*/
+	size_t getMemoryUsage() const { return bits.size() * sizeof(Word); }
+
+	TileLayer(int width, int height) { resize(width, height); }
+	TileLayer() : width(0), height(0), words_per_row(0) {};
+};
+
+#endif
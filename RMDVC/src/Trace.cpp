@@ -0,0 +1,356 @@
+#include "Trace.hpp"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/** VS2013 does not support thread_local, but __declspec(thread) works for pointers.
+*/
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL thread_local
+#endif
+
+static const unsigned int TRACE_BINARY_MAGIC = 0x54444D52; //"RMDT"
+static const unsigned int TRACE_BINARY_VERSION = 1;
+
+static const char* const TRACE_LEVEL_NAMES[] = { "debug", "info", "error" };
+
+/** The buffers of all threads that have recorded events, and all counters and histograms.
+* Buffers are never freed, as their events are written after their threads may have ended.
+*/
+struct TraceRegistry {
+	std::mutex mutex;
+	std::vector<TraceBuffer*> buffers;
+	std::vector<TraceCounter*> counters;
+	std::vector<TraceHistogram*> histograms;
+};
+
+/** Counters and histograms are registered during static initialization, so the registry
+* has to be created on first use.
+*/
+static TraceRegistry* getRegistry()
+{
+	static TraceRegistry registry;
+	return &registry;
+}
+
+static TRACE_THREAD_LOCAL TraceBuffer* thread_buffer = nullptr;
+static const std::chrono::high_resolution_clock::time_point trace_start = std::chrono::high_resolution_clock::now();
+
+std::atomic<bool> Trace::enabled(false);
+int Trace::echo_level = TRACE_LEVEL_ERROR;
+
+TraceBuffer::TraceBuffer(int thread_id) : events(new TraceEvent[CAPACITY]), thread_id(thread_id)
+{
+	written = 0;
+	thread_name = "thread " + std::to_string(thread_id);
+}
+
+TraceBuffer::~TraceBuffer()
+{
+	delete[] events;
+}
+
+TraceCounter::TraceCounter(const char* name) : name(name)
+{
+	value = 0;
+
+	TraceRegistry* registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry->mutex);
+	registry->counters.push_back(this);
+}
+
+TraceHistogram::TraceHistogram(const char* name) : name(name)
+{
+	for (int i = 0; i < BUCKETS; i++) { buckets[i] = 0; }
+	count = 0;
+	sum = 0;
+	max = 0;
+
+	TraceRegistry* registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry->mutex);
+	registry->histograms.push_back(this);
+}
+
+void TraceHistogram::record(unsigned long long value)
+{
+	int bucket = 0;
+	while (bucket < BUCKETS - 1 && (value >> bucket) != 0) { bucket++; }
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+
+	unsigned long long old_max = max.load(std::memory_order_relaxed);
+	while (value > old_max && !max.compare_exchange_weak(old_max, value, std::memory_order_relaxed)) {}
+}
+
+unsigned long long TraceHistogram::getPercentile(double fraction) const
+{
+	unsigned long long target = (unsigned long long)(fraction * getCount());
+	unsigned long long below = 0;
+
+	for (int i = 0; i < BUCKETS; i++)
+	{
+		below += getBucket(i);
+		if (below > target || below == getCount()) { return 1ULL << i; }
+	}
+
+	return getMax();
+}
+
+TraceBuffer* Trace::getThreadBuffer()
+{
+	if (thread_buffer != nullptr) { return thread_buffer; }
+
+	TraceRegistry* registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry->mutex);
+	thread_buffer = new TraceBuffer((int)registry->buffers.size());
+	registry->buffers.push_back(thread_buffer);
+	return thread_buffer;
+}
+
+void Trace::setThreadName(const char* name)
+{
+	TraceBuffer* buffer = getThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(getRegistry()->mutex);
+	buffer->setThreadName(name);
+}
+
+unsigned long long Trace::now()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::high_resolution_clock::now() - trace_start).count();
+}
+
+void Trace::message(int level, const char* function, int line, const char* format, ...)
+{
+	TraceBuffer* buffer = getThreadBuffer();
+	TraceEvent* event = buffer->next();
+	event->type = TRACE_EVENT_MESSAGE;
+	event->level = (unsigned char)level;
+	event->name = function;
+	event->value = line;
+	event->start = now();
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(event->text, TraceEvent::TEXT_SIZE, format, args);
+	va_end(args);
+
+	buffer->publish();
+
+	//The echo is formatted again, as the text in the event may be truncated
+	if (level >= echo_level)
+	{
+		FILE* out = level >= TRACE_LEVEL_ERROR ? stderr : stdout;
+		if (level >= TRACE_LEVEL_ERROR) { fprintf(out, "%s:%d: ", function, line); }
+
+		va_start(args, format);
+		vfprintf(out, format, args);
+		va_end(args);
+	}
+}
+
+void Trace::zone(const char* name, unsigned long long start, unsigned long long duration)
+{
+	TraceBuffer* buffer = getThreadBuffer();
+	TraceEvent* event = buffer->next();
+	event->type = TRACE_EVENT_ZONE;
+	event->level = 0;
+	event->name = name;
+	event->start = start;
+	event->value = (long long)duration;
+	event->text[0] = '\0';
+	buffer->publish();
+}
+
+void Trace::counter(const char* name, long long value)
+{
+	if (!isEnabled()) { return; }
+
+	TraceBuffer* buffer = getThreadBuffer();
+	TraceEvent* event = buffer->next();
+	event->type = TRACE_EVENT_COUNTER;
+	event->level = 0;
+	event->name = name;
+	event->start = now();
+	event->value = value;
+	event->text[0] = '\0';
+	buffer->publish();
+}
+
+/** Writes a string as a JSON string literal.
+*/
+static void writeJsonString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\') { fputc('\\', file); fputc(*c, file); }
+		else if (*c == '\n') { fputs("\\n", file); }
+		else if ((unsigned char)*c < 0x20) { fprintf(file, "\\u%04x", (unsigned char)*c); }
+		else { fputc(*c, file); }
+	}
+	fputc('"', file);
+}
+
+bool Trace::writeChromeJson(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr) { return false; }
+
+	TraceRegistry* registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry->mutex);
+
+	fputs("{\"traceEvents\":[\n", file);
+	bool first = true;
+
+	for (auto it = registry->buffers.begin(); it != registry->buffers.end(); it++)
+	{
+		TraceBuffer* buffer = *it;
+		int tid = buffer->getThreadId();
+
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", tid);
+		writeJsonString(file, buffer->getThreadName().c_str());
+		fputs("}}", file);
+		first = false;
+
+		unsigned long long end = buffer->getWrittenCount();
+		unsigned long long begin = end > TraceBuffer::CAPACITY ? end - TraceBuffer::CAPACITY : 0;
+
+		for (unsigned long long i = begin; i < end; i++)
+		{
+			const TraceEvent& event = buffer->getEvent(i);
+
+			//Chrome expects microseconds
+			fputs(",\n{\"name\":", file);
+			writeJsonString(file, event.name);
+			fprintf(file, ",\"pid\":1,\"tid\":%d,\"ts\":%.3f", tid, event.start / 1000.0);
+
+			switch (event.type)
+			{
+			case TRACE_EVENT_ZONE:
+				fprintf(file, ",\"ph\":\"X\",\"dur\":%.3f}", event.value / 1000.0);
+				break;
+			case TRACE_EVENT_COUNTER:
+				fprintf(file, ",\"ph\":\"C\",\"args\":{\"value\":%lld}}", event.value);
+				break;
+			default:
+				fprintf(file, ",\"ph\":\"i\",\"s\":\"t\",\"args\":{\"level\":\"%s\",\"line\":%lld,\"text\":",
+					TRACE_LEVEL_NAMES[event.level < TRACE_LEVEL_OFF ? event.level : TRACE_LEVEL_ERROR], event.value);
+				writeJsonString(file, event.text);
+				fputs("}}", file);
+				break;
+			}
+		}
+	}
+
+	fputs("\n]}\n", file);
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+bool Trace::writeBinary(const char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr) { return false; }
+
+	TraceRegistry* registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry->mutex);
+
+	//Names are written once and referred to by index
+	std::map<std::string, unsigned int> name_indices;
+	std::vector<const std::string*> names;
+	for (auto it = registry->buffers.begin(); it != registry->buffers.end(); it++)
+	{
+		unsigned long long end = (*it)->getWrittenCount();
+		unsigned long long begin = end > TraceBuffer::CAPACITY ? end - TraceBuffer::CAPACITY : 0;
+		for (unsigned long long i = begin; i < end; i++)
+		{
+			auto inserted = name_indices.insert(std::make_pair(std::string((*it)->getEvent(i).name), (unsigned int)names.size()));
+			if (inserted.second) { names.push_back(&inserted.first->first); }
+		}
+	}
+
+	fwrite(&TRACE_BINARY_MAGIC, sizeof(TRACE_BINARY_MAGIC), 1, file);
+	fwrite(&TRACE_BINARY_VERSION, sizeof(TRACE_BINARY_VERSION), 1, file);
+
+	unsigned int count = (unsigned int)names.size();
+	fwrite(&count, sizeof(count), 1, file);
+	for (auto it = names.begin(); it != names.end(); it++)
+	{
+		unsigned int length = (unsigned int)(*it)->size();
+		fwrite(&length, sizeof(length), 1, file);
+		fwrite((*it)->data(), 1, length, file);
+	}
+
+	for (auto it = registry->buffers.begin(); it != registry->buffers.end(); it++)
+	{
+		TraceBuffer* buffer = *it;
+		int tid = buffer->getThreadId();
+		unsigned int length = (unsigned int)buffer->getThreadName().size();
+		fwrite(&tid, sizeof(tid), 1, file);
+		fwrite(&length, sizeof(length), 1, file);
+		fwrite(buffer->getThreadName().data(), 1, length, file);
+
+		unsigned long long end = buffer->getWrittenCount();
+		unsigned long long begin = end > TraceBuffer::CAPACITY ? end - TraceBuffer::CAPACITY : 0;
+		count = (unsigned int)(end - begin);
+		fwrite(&count, sizeof(count), 1, file);
+
+		for (unsigned long long i = begin; i < end; i++)
+		{
+			const TraceEvent& event = buffer->getEvent(i);
+			unsigned int name = name_indices[event.name];
+			unsigned char text_length = (unsigned char)strnlen(event.text, TraceEvent::TEXT_SIZE);
+
+			fwrite(&event.type, sizeof(event.type), 1, file);
+			fwrite(&event.level, sizeof(event.level), 1, file);
+			fwrite(&name, sizeof(name), 1, file);
+			fwrite(&event.start, sizeof(event.start), 1, file);
+			fwrite(&event.value, sizeof(event.value), 1, file);
+			fwrite(&text_length, sizeof(text_length), 1, file);
+			fwrite(event.text, 1, text_length, file);
+		}
+	}
+
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+bool Trace::write(const char* filename)
+{
+	size_t length = strlen(filename);
+	if (length >= 5 && strcmp(filename + length - 5, ".json") == 0) { return writeChromeJson(filename); }
+	return writeBinary(filename);
+}
+
+void Trace::writeMetrics(FILE* file)
+{
+	TraceRegistry* registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry->mutex);
+
+	for (auto it = registry->counters.begin(); it != registry->counters.end(); it++)
+	{
+		fprintf(file, "  %-20s %12lld\n", (*it)->getName(), (*it)->getValue());
+	}
+
+	for (auto it = registry->histograms.begin(); it != registry->histograms.end(); it++)
+	{
+		TraceHistogram* histogram = *it;
+		if (histogram->getCount() == 0) { continue; }
+
+		fprintf(file, "  %-20s %12llu  mean %.0f, p50 < %llu, p99 < %llu, max %llu\n", histogram->getName(),
+			histogram->getCount(), (double)histogram->getSum() / histogram->getCount(),
+			histogram->getPercentile(0.5), histogram->getPercentile(0.99), histogram->getMax());
+	}
+}
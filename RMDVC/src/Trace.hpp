@@ -0,0 +1,274 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+/** The levels of trace messages. Messages below TRACE_MIN_LEVEL are compiled out: their
+* arguments are never evaluated. By default, debug builds keep all messages and release
+* builds keep errors only.
+*/
+#define TRACE_LEVEL_DEBUG 0
+#define TRACE_LEVEL_INFO 1
+#define TRACE_LEVEL_ERROR 2
+#define TRACE_LEVEL_OFF 3
+
+#ifndef TRACE_MIN_LEVEL
+#ifdef _DEBUG
+#define TRACE_MIN_LEVEL TRACE_LEVEL_DEBUG
+#else
+#define TRACE_MIN_LEVEL TRACE_LEVEL_ERROR
+#endif
+#endif
+
+/** Defining TRACE_NO_ZONES compiles out all zones (see TRACE_ZONE).
+*/
+#ifndef TRACE_NO_ZONES
+#define TRACE_ZONES_ENABLED 1
+#else
+#define TRACE_ZONES_ENABLED 0
+#endif
+
+enum TraceEventType {
+	TRACE_EVENT_ZONE,		//A timed zone: start and duration
+	TRACE_EVENT_MESSAGE,	//A message: level, source line and text
+	TRACE_EVENT_COUNTER,	//The value of a counter at a point in time
+	SIZE_OF_TRACE_EVENT_TYPE_ENUM
+};
+
+/** Events are fixed-size, so recording one never allocates. The name is a string with static
+* storage duration (a literal or __FUNCTION__), which is only resolved when the trace is written.
+*
+* @brief One entry of the trace.
+*/
+struct TraceEvent {
+	/** Nanoseconds since the trace was started.
+	*/
+	unsigned long long start;
+
+	/** The duration of zones in nanoseconds, the value of counters, the source line of messages.
+	*/
+	long long value;
+
+	const char* name;
+	unsigned char type;
+	unsigned char level;
+
+	static const int TEXT_SIZE = 78;
+	char text[TEXT_SIZE];
+};
+
+/** Every thread writes into a buffer of its own, so recording an event takes no lock: the owning
+* thread fills the next slot and then publishes it by incrementing the write count. Once the buffer
+* is full, the oldest events are overwritten.
+*
+* The buffers are read when the trace is written, which should happen while no other thread is
+* recording (e.g. between turns or at exit); events recorded meanwhile may be torn.
+*
+* @brief The ring buffer of trace events of one thread.
+*/
+class TraceBuffer
+{
+private:
+	TraceEvent* events;
+	std::atomic<unsigned long long> written;
+
+	int thread_id;
+	std::string thread_name;
+
+public:
+	static const int CAPACITY = 16384;
+
+	/** Returns the slot the next event is written to. It is recorded by publish().
+	*/
+	TraceEvent* next() { return &events[written.load(std::memory_order_relaxed) % CAPACITY]; }
+	void publish() { written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	/** @brief Returns the number of events ever written, of which the last CAPACITY are kept.
+	*/
+	unsigned long long getWrittenCount() const { return written.load(std::memory_order_acquire); }
+
+	/** @brief Returns the index-th event ever written, which must be one of the last CAPACITY.
+	*/
+	const TraceEvent& getEvent(unsigned long long index) const { return events[index % CAPACITY]; }
+
+	int getThreadId() const { return thread_id; }
+	const std::string& getThreadName() const { return thread_name; }
+	void setThreadName(const std::string& name) { thread_name = name; }
+
+	TraceBuffer(int thread_id);
+	~TraceBuffer();
+};
+
+/** A counter is defined once (at namespace scope, so it is registered before any thread can
+* use it) and incremented from anywhere: TRACE_COUNT(counter, n). Incrementing is a relaxed
+* atomic addition and never records an event; the totals are listed by Trace::writeMetrics().
+*
+* @brief A named, thread-safe event count.
+*/
+class TraceCounter
+{
+private:
+	const char* name;
+	std::atomic<long long> value;
+
+public:
+	void add(long long n) { value.fetch_add(n, std::memory_order_relaxed); }
+	long long getValue() const { return value.load(std::memory_order_relaxed); }
+	const char* getName() const { return name; }
+
+	TraceCounter(const char* name);
+};
+
+/** Values are counted in power-of-two buckets (bucket i holds the values in [2^(i-1), 2^i)),
+* which is enough to tell the typical from the worst case at the cost of one atomic increment.
+* Zones can record their duration (in nanoseconds) into a histogram, see TRACE_ZONE_HISTOGRAM.
+*
+* @brief A named, thread-safe distribution of values.
+*/
+class TraceHistogram
+{
+public:
+	static const int BUCKETS = 64;
+
+private:
+	const char* name;
+	std::atomic<unsigned long long> buckets[BUCKETS];
+	std::atomic<unsigned long long> count;
+	std::atomic<unsigned long long> sum;
+	std::atomic<unsigned long long> max;
+
+public:
+	void record(unsigned long long value);
+
+	const char* getName() const { return name; }
+	unsigned long long getCount() const { return count.load(std::memory_order_relaxed); }
+	unsigned long long getSum() const { return sum.load(std::memory_order_relaxed); }
+	unsigned long long getMax() const { return max.load(std::memory_order_relaxed); }
+	unsigned long long getBucket(int i) const { return buckets[i].load(std::memory_order_relaxed); }
+
+	/** Returns the (exclusive) upper bound of the bucket in which the given fraction (e.g. 0.99)
+	* of the values is reached.
+	*/
+	unsigned long long getPercentile(double fraction) const;
+
+	TraceHistogram(const char* name);
+};
+
+/** The trace replaces printing diagnostics: messages (debug_print(), debug_error()), timed zones
+* (TRACE_ZONE) and counter values are recorded into per-thread ring buffers, which costs a few
+* nanoseconds and no I/O. Messages at or above the echo level are printed right away as well.
+* The trace is written at the end, as Chrome trace JSON (viewable in chrome://tracing) or in a
+* compact binary format.
+*
+* Zones and counter events are only recorded while the trace is enabled; messages always are.
+*
+* @brief Low-overhead tracing of messages, timed zones and metrics.
+*/
+class Trace
+{
+private:
+	static std::atomic<bool> enabled;
+	static int echo_level;
+
+public:
+	/** @brief Returns the buffer of the calling thread, creating it on first use.
+	*/
+	static TraceBuffer* getThreadBuffer();
+
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+	static void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+
+	/** @brief Sets the level from which messages are printed (TRACE_LEVEL_OFF for none).
+	*/
+	static void setEchoLevel(int level) { echo_level = level; }
+
+	/** @brief Names the calling thread in the written trace.
+	*/
+	static void setThreadName(const char* name);
+
+	/** @brief Returns the nanoseconds since the trace was started.
+	*/
+	static unsigned long long now();
+
+	/** @brief Records a message, formatted like printf().
+	*/
+	static void message(int level, const char* function, int line, const char* format, ...);
+
+	static void zone(const char* name, unsigned long long start, unsigned long long duration);
+	static void counter(const char* name, long long value);
+
+	/** Writes all threads' events as Chrome trace JSON.
+	*
+	* @return false if the file could not be written.
+	*/
+	static bool writeChromeJson(const char* filename);
+
+	/** Writes all threads' events in the binary format: the magic "RMDT", the version, the number
+	* of names followed by the names (length, characters), then per thread its id, the length and
+	* characters of its name, the number of events and the events (type, level, name index, start,
+	* value, text length, text), all numbers as they are in memory.
+	*
+	* @return false if the file could not be written.
+	*/
+	static bool writeBinary(const char* filename);
+
+	/** @brief Writes the trace as Chrome trace JSON if the filename ends with ".json", binary otherwise.
+	*/
+	static bool write(const char* filename);
+
+	/** @brief Prints all counters and histograms.
+	*/
+	static void writeMetrics(FILE* file);
+};
+
+/** Measures the time from its construction to its destruction as a zone of the trace
+* and, if one is given, into a histogram.
+*
+* @brief A scoped timing zone, see TRACE_ZONE.
+*/
+class TraceZone
+{
+private:
+	const char* name;
+	TraceHistogram* histogram;
+	unsigned long long start;
+	bool active;
+
+public:
+	TraceZone(const char* name, TraceHistogram* histogram = nullptr) : name(name), histogram(histogram),
+		active(Trace::isEnabled())
+	{
+		start = active ? Trace::now() : 0;
+	}
+
+	~TraceZone()
+	{
+		if (!active) { return; }
+
+		unsigned long long duration = Trace::now() - start;
+		Trace::zone(name, start, duration);
+		if (histogram != nullptr) { histogram->record(duration); }
+	}
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+/** TRACE_ZONE("name") times the rest of the enclosing scope. The name must be a literal.
+*/
+#if TRACE_ZONES_ENABLED
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_ZONE_HISTOGRAM(name, histogram) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name, &(histogram))
+#else
+#define TRACE_ZONE(name) do {} while (0)
+#define TRACE_ZONE_HISTOGRAM(name, histogram) do {} while (0)
+#endif
+
+#define TRACE_COUNT(counter, n) (counter).add(n)
+
+#define TRACE_MESSAGE(level, fmt, ...) \
+	do { if ((level) >= TRACE_MIN_LEVEL) Trace::message((level), __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__); } while (0)
+
+#endif
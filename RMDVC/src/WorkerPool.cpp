@@ -0,0 +1,87 @@
+#include "WorkerPool.hpp"
+#include "Trace.hpp"
+
+#include <string>
+
+WorkerPool::WorkerPool(int worker_count) : task(nullptr), item_count(0), busy_threads(0), run_count(0), stopping(false)
+{
+	next_item = 0;
+
+	if (worker_count <= 0) { worker_count = (int)std::thread::hardware_concurrency(); }
+	if (worker_count <= 0) { worker_count = 1; }
+
+	for (int i = 1; i < worker_count; i++)
+	{
+		threads.push_back(std::thread(&WorkerPool::work, this, i));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+
+	for (auto it = threads.begin(); it != threads.end(); it++) { it->join(); }
+}
+
+void WorkerPool::process(int worker)
+{
+	for (int item = next_item++; item < item_count; item = next_item++)
+	{
+		(*task)(item, worker);
+	}
+}
+
+void WorkerPool::work(int worker)
+{
+	Trace::setThreadName(("worker " + std::to_string(worker)).c_str());
+
+	unsigned long long last_run = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && run_count == last_run) { work_ready.wait(lock); }
+			if (stopping) { return; }
+			last_run = run_count;
+		}
+
+		process(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy_threads--;
+		}
+		work_done.notify_one();
+	}
+}
+
+void WorkerPool::run(int count, const std::function<void(int item, int worker)>& task)
+{
+	//Not worth waking up the threads for
+	if (threads.empty() || count <= 1)
+	{
+		for (int item = 0; item < count; item++) { task(item, 0); }
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		item_count = count;
+		next_item = 0;
+		busy_threads = (int)threads.size();
+		run_count++;
+	}
+	work_ready.notify_all();
+
+	process(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (busy_threads > 0) { work_done.wait(lock); }
+	this->task = nullptr;
+}
@@ -0,0 +1,60 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** The pool runs one task on a range of items at a time: run() hands the items out to the worker
+* threads and to the calling thread (which is worker 0) and returns when all of them are done.
+* Items are taken in whatever order the threads get to them, so a task must only write to memory
+* belonging to its item (or to its worker) for the result not to depend on the number of threads.
+*
+* @brief A fixed set of threads for running independent work items in parallel.
+*/
+class WorkerPool
+{
+private:
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+
+	/** The task of the current run, its number of items, the next item to be taken
+	* and the number of threads still working on it.
+	*/
+	const std::function<void(int, int)>* task;
+	int item_count;
+	std::atomic<int> next_item;
+	int busy_threads;
+
+	/** Incremented by every run, so the threads can tell a new run from a spurious wakeup.
+	*/
+	unsigned long long run_count;
+	bool stopping;
+
+	void work(int worker);
+	void process(int worker);
+
+public:
+	/** @brief Returns the number of workers, including the thread calling run().
+	*/
+	int getWorkerCount() const { return (int)threads.size() + 1; }
+
+	/** Calls task(item, worker) for every item in [0, count) and returns when all calls have
+	* returned. The worker is in [0, getWorkerCount()), so the task can use memory of its own per worker.
+	*/
+	void run(int count, const std::function<void(int item, int worker)>& task);
+
+	/** Creates a pool of the given number of workers (the calling thread being one of them).
+	* With 0, one worker per hardware thread is used; with 1, all work is done by the calling thread.
+	*/
+	WorkerPool(int worker_count);
+	~WorkerPool();
+};
+
+#endif
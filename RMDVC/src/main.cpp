@@ -8,12 +8,20 @@ int main() {
 	setvbuf(stdout, NULL, _IONBF, 0);
 	setvbuf(stderr, NULL, _IONBF, 0);
 
-	Engine* engine = new Engine();
+	EngineConfig config;
+#ifdef _DEBUG
+	//Diagnostics are not printed (except errors) but traced, see Trace
+	config.trace_path = "trace.json";
+#endif
+
+	Engine* engine = new Engine(config);
 
     while ( !TCODConsole::isWindowClosed() ) {
     	engine->update();
     	engine->render();
 		TCODConsole::flush();
+		//Waits for the next frame or key, working ahead on the next turn meanwhile
+		engine->idle();
     }
 
 	delete engine;